@@ -9,6 +9,9 @@
 #include <ngx_core.h>
 
 
+ngx_uint_t  ngx_cpu_features;
+
+
 #if (( __i386__ || __amd64__ ) && ( __GNUC__ || __INTEL_COMPILER ))
 
 
@@ -75,6 +78,18 @@ ngx_cpuinfo(void)
     u_char    *vendor;
     uint32_t   vbuf[5], cpu[4], model;
 
+#if (NGX_HAVE_GCC_X86_SIMD)
+
+    /* the builtin also checks that the OS saves the AVX state */
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        ngx_cpu_features |= NGX_CPU_AVX2;
+    }
+
+#endif
+
     vbuf[0] = 0;
     vbuf[1] = 0;
     vbuf[2] = 0;
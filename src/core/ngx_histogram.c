@@ -0,0 +1,119 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_HISTOGRAM_SUB  (1 << NGX_HISTOGRAM_SUB_BITS)
+
+
+static ngx_uint_t ngx_histogram_bucket(ngx_msec_t value);
+
+
+void
+ngx_histogram_add(ngx_histogram_t *h, ngx_msec_t value)
+{
+    h->count++;
+    h->sum += value;
+    h->bucket[ngx_histogram_bucket(value)]++;
+}
+
+
+void
+ngx_histogram_add_atomic(ngx_histogram_t *h, ngx_msec_t value)
+{
+    (void) ngx_atomic_fetch_add(&h->count, 1);
+    (void) ngx_atomic_fetch_add(&h->sum, value);
+    (void) ngx_atomic_fetch_add(&h->bucket[ngx_histogram_bucket(value)], 1);
+}
+
+
+static ngx_uint_t
+ngx_histogram_bucket(ngx_msec_t value)
+{
+    ngx_uint_t  bits;
+
+    if (value < NGX_HISTOGRAM_SUB) {
+        return value;
+    }
+
+    for (bits = NGX_HISTOGRAM_SUB_BITS; value >> (bits + 1); bits++) {
+        /* void */
+    }
+
+    if (bits >= NGX_HISTOGRAM_MAX_BITS) {
+        return NGX_HISTOGRAM_BUCKETS - 1;
+    }
+
+    return ((bits - NGX_HISTOGRAM_SUB_BITS + 1) << NGX_HISTOGRAM_SUB_BITS)
+           + (value >> (bits - NGX_HISTOGRAM_SUB_BITS)) - NGX_HISTOGRAM_SUB;
+}
+
+
+void
+ngx_histogram_merge(ngx_histogram_t *dst, ngx_histogram_t *src)
+{
+    ngx_uint_t  i;
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+
+    for (i = 0; i < NGX_HISTOGRAM_BUCKETS; i++) {
+        dst->bucket[i] += src->bucket[i];
+    }
+}
+
+
+ngx_msec_t
+ngx_histogram_bucket_max(ngx_uint_t n)
+{
+    ngx_uint_t  bits, m;
+
+    if (n < NGX_HISTOGRAM_SUB) {
+        return n;
+    }
+
+    bits = (n >> NGX_HISTOGRAM_SUB_BITS) + NGX_HISTOGRAM_SUB_BITS - 1;
+    m = (n & (NGX_HISTOGRAM_SUB - 1)) + NGX_HISTOGRAM_SUB;
+
+    return ((m + 1) << (bits - NGX_HISTOGRAM_SUB_BITS)) - 1;
+}
+
+
+/* q is in thousandths, e.g. 999 for the 99.9th percentile */
+
+ngx_msec_t
+ngx_histogram_quantile(ngx_histogram_t *h, ngx_uint_t q)
+{
+    ngx_uint_t  i, rank, total;
+
+    if (h->count == 0) {
+        return 0;
+    }
+
+    rank = (h->count * q + 999) / 1000;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    total = 0;
+
+    for (i = 0; i < NGX_HISTOGRAM_BUCKETS; i++) {
+        total += h->bucket[i];
+
+        if (total >= rank) {
+            break;
+        }
+    }
+
+    if (i == NGX_HISTOGRAM_BUCKETS) {
+        i--;
+    }
+
+    return ngx_histogram_bucket_max(i);
+}
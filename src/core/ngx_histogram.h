@@ -0,0 +1,46 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_HISTOGRAM_H_INCLUDED_
+#define _NGX_HISTOGRAM_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/*
+ * log-linear histogram of millisecond values: each power of two range
+ * is split into 2^NGX_HISTOGRAM_SUB_BITS linear buckets, so a value is
+ * reported with a relative error of less than 12.5%; the counters are
+ * atomic so that a histogram in shared memory can be updated by several
+ * processes without a lock, and, like stub_status counters, they may
+ * wrap on 32-bit platforms
+ */
+
+#define NGX_HISTOGRAM_SUB_BITS  3
+#define NGX_HISTOGRAM_MAX_BITS  22
+
+#define NGX_HISTOGRAM_BUCKETS                                                 \
+    ((NGX_HISTOGRAM_MAX_BITS - NGX_HISTOGRAM_SUB_BITS + 1)                    \
+     << NGX_HISTOGRAM_SUB_BITS)
+
+
+typedef struct {
+    ngx_atomic_uint_t   count;
+    ngx_atomic_uint_t   sum;
+    ngx_atomic_uint_t   bucket[NGX_HISTOGRAM_BUCKETS];
+} ngx_histogram_t;
+
+
+void ngx_histogram_add(ngx_histogram_t *h, ngx_msec_t value);
+void ngx_histogram_add_atomic(ngx_histogram_t *h, ngx_msec_t value);
+void ngx_histogram_merge(ngx_histogram_t *dst, ngx_histogram_t *src);
+ngx_msec_t ngx_histogram_bucket_max(ngx_uint_t n);
+ngx_msec_t ngx_histogram_quantile(ngx_histogram_t *h, ngx_uint_t q);
+
+
+#endif /* _NGX_HISTOGRAM_H_INCLUDED_ */
@@ -8,6 +8,19 @@
 #include <ngx_core.h>
 
 
+#define ngx_murmur_rotl64(x, n)  (((x) << (n)) | ((x) >> (64 - (n))))
+
+#define NGX_MURMUR_C1  0x87c37b91114253d5ULL
+#define NGX_MURMUR_C2  0x4cf5ad432745937fULL
+
+
+static void ngx_murmur_hash3_128_block(ngx_murmur_hash3_128_t *ctx,
+    const u_char *p);
+static uint64_t ngx_murmur_get64(const u_char *p);
+static void ngx_murmur_put64(u_char *p, uint64_t n);
+static uint64_t ngx_murmur_fmix64(uint64_t k);
+
+
 uint32_t
 ngx_murmur_hash2(u_char *data, size_t len)
 {
@@ -50,3 +63,179 @@ ngx_murmur_hash2(u_char *data, size_t len)
 
     return h;
 }
+
+
+/* MurmurHash3 x64 128-bit variant, in an incremental form */
+
+void
+ngx_murmur_hash3_128_init(ngx_murmur_hash3_128_t *ctx, uint32_t seed)
+{
+    ctx->h1 = seed;
+    ctx->h2 = seed;
+    ctx->len = 0;
+}
+
+
+void
+ngx_murmur_hash3_128_update(ngx_murmur_hash3_128_t *ctx, const void *data,
+    size_t size)
+{
+    size_t         used, free;
+    const u_char  *p;
+
+    p = data;
+
+    used = (size_t) (ctx->len & 0x0f);
+    ctx->len += size;
+
+    if (used) {
+        free = 16 - used;
+
+        if (size < free) {
+            ngx_memcpy(&ctx->buffer[used], p, size);
+            return;
+        }
+
+        ngx_memcpy(&ctx->buffer[used], p, free);
+        ngx_murmur_hash3_128_block(ctx, ctx->buffer);
+
+        p += free;
+        size -= free;
+    }
+
+    while (size >= 16) {
+        ngx_murmur_hash3_128_block(ctx, p);
+
+        p += 16;
+        size -= 16;
+    }
+
+    ngx_memcpy(ctx->buffer, p, size);
+}
+
+
+void
+ngx_murmur_hash3_128_final(u_char result[16], ngx_murmur_hash3_128_t *ctx)
+{
+    size_t    n, i;
+    uint64_t  h1, h2, k1, k2;
+
+    h1 = ctx->h1;
+    h2 = ctx->h2;
+
+    n = (size_t) (ctx->len & 0x0f);
+
+    k1 = 0;
+    k2 = 0;
+
+    for (i = n; i > 8; i--) {
+        k2 ^= (uint64_t) ctx->buffer[i - 1] << ((i - 9) * 8);
+    }
+
+    if (n > 8) {
+        k2 *= NGX_MURMUR_C2;
+        k2 = ngx_murmur_rotl64(k2, 33);
+        k2 *= NGX_MURMUR_C1;
+        h2 ^= k2;
+    }
+
+    for (i = ngx_min(n, 8); i > 0; i--) {
+        k1 ^= (uint64_t) ctx->buffer[i - 1] << ((i - 1) * 8);
+    }
+
+    if (n) {
+        k1 *= NGX_MURMUR_C1;
+        k1 = ngx_murmur_rotl64(k1, 31);
+        k1 *= NGX_MURMUR_C2;
+        h1 ^= k1;
+    }
+
+    h1 ^= ctx->len;
+    h2 ^= ctx->len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = ngx_murmur_fmix64(h1);
+    h2 = ngx_murmur_fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    ngx_murmur_put64(result, h1);
+    ngx_murmur_put64(result + 8, h2);
+}
+
+
+static void
+ngx_murmur_hash3_128_block(ngx_murmur_hash3_128_t *ctx, const u_char *p)
+{
+    uint64_t  h1, h2, k1, k2;
+
+    h1 = ctx->h1;
+    h2 = ctx->h2;
+
+    k1 = ngx_murmur_get64(p);
+    k2 = ngx_murmur_get64(p + 8);
+
+    k1 *= NGX_MURMUR_C1;
+    k1 = ngx_murmur_rotl64(k1, 31);
+    k1 *= NGX_MURMUR_C2;
+    h1 ^= k1;
+
+    h1 = ngx_murmur_rotl64(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= NGX_MURMUR_C2;
+    k2 = ngx_murmur_rotl64(k2, 33);
+    k2 *= NGX_MURMUR_C1;
+    h2 ^= k2;
+
+    h2 = ngx_murmur_rotl64(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+
+    ctx->h1 = h1;
+    ctx->h2 = h2;
+}
+
+
+static uint64_t
+ngx_murmur_get64(const u_char *p)
+{
+    /* the hash is defined on little-endian words on all platforms */
+
+    return (uint64_t) p[0]
+           | (uint64_t) p[1] << 8
+           | (uint64_t) p[2] << 16
+           | (uint64_t) p[3] << 24
+           | (uint64_t) p[4] << 32
+           | (uint64_t) p[5] << 40
+           | (uint64_t) p[6] << 48
+           | (uint64_t) p[7] << 56;
+}
+
+
+static void
+ngx_murmur_put64(u_char *p, uint64_t n)
+{
+    ngx_uint_t  i;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (u_char) (n >> (i * 8));
+    }
+}
+
+
+static uint64_t
+ngx_murmur_fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+
+    return k;
+}
@@ -13,7 +13,21 @@
 #include <ngx_core.h>
 
 
+typedef struct {
+    uint64_t  h1;
+    uint64_t  h2;
+    uint64_t  len;
+    u_char    buffer[16];
+} ngx_murmur_hash3_128_t;
+
+
 uint32_t ngx_murmur_hash2(u_char *data, size_t len);
 
+void ngx_murmur_hash3_128_init(ngx_murmur_hash3_128_t *ctx, uint32_t seed);
+void ngx_murmur_hash3_128_update(ngx_murmur_hash3_128_t *ctx,
+    const void *data, size_t size);
+void ngx_murmur_hash3_128_final(u_char result[16],
+    ngx_murmur_hash3_128_t *ctx);
+
 
 #endif /* _NGX_MURMURHASH_H_INCLUDED_ */
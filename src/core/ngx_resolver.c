@@ -15,6 +15,8 @@
 #define NGX_RESOLVER_TCP_RSIZE  (2 + 65535)
 #define NGX_RESOLVER_TCP_WSIZE  8192
 
+#define NGX_RESOLVER_SHM_POLL   20
+
 
 typedef struct {
     u_char  ident_hi;
@@ -51,6 +53,37 @@ typedef struct {
 } ngx_resolver_an_t;
 
 
+typedef struct {
+    ngx_rbtree_t                  rbtree;
+    ngx_rbtree_node_t             sentinel;
+    ngx_queue_t                   queue;
+} ngx_resolver_shm_sh_t;
+
+
+typedef struct {
+    ngx_resolver_shm_sh_t        *sh;
+    ngx_slab_pool_t              *shpool;
+} ngx_resolver_shm_t;
+
+
+typedef struct {
+    ngx_str_node_t                sn;
+    ngx_queue_t                   queue;
+
+    time_t                        valid;
+    time_t                        updating;
+    uint32_t                      ttl;
+
+    u_short                       cnlen;
+    u_short                       naddrs;
+    u_short                       naddrs6;
+    u_char                        ipv6;
+
+    /* name, cname, IPv4 addresses, IPv6 addresses */
+    u_char                        data[1];
+} ngx_resolver_shm_node_t;
+
+
 #define ngx_resolver_node(n)  ngx_rbtree_data(n, ngx_resolver_node_t, node)
 
 
@@ -121,6 +154,18 @@ static void ngx_resolver_resolve_srv_names(ngx_resolver_ctx_t *ctx,
 static void ngx_resolver_srv_names_handler(ngx_resolver_ctx_t *ctx);
 static ngx_int_t ngx_resolver_cmp_srvs(const void *one, const void *two);
 
+static ngx_int_t ngx_resolver_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+static ngx_int_t ngx_resolver_shm_lookup(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn, uint32_t hash);
+static void ngx_resolver_shm_store(ngx_resolver_t *r, ngx_resolver_node_t *rn);
+static void ngx_resolver_shm_release(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn);
+static ngx_resolver_shm_node_t *ngx_resolver_shm_alloc(
+    ngx_resolver_shm_t *shm, size_t size);
+static void ngx_resolver_shm_free(ngx_resolver_shm_t *shm,
+    ngx_resolver_shm_node_t *sn);
+static void ngx_resolver_shm_handler(ngx_event_t *ev);
+
 #if (NGX_HAVE_INET6)
 static void ngx_resolver_rbtree_insert_addr6_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
@@ -132,10 +177,13 @@ static ngx_resolver_node_t *ngx_resolver_lookup_addr6(ngx_resolver_t *r,
 ngx_resolver_t *
 ngx_resolver_create(ngx_conf_t *cf, ngx_str_t *names, ngx_uint_t n)
 {
-    ngx_str_t                   s;
+    u_char                     *p;
+    ssize_t                     size;
+    ngx_str_t                   s, name;
     ngx_url_t                   u;
     ngx_uint_t                  i, j;
     ngx_resolver_t             *r;
+    ngx_resolver_shm_t         *shm;
     ngx_pool_cleanup_t         *cln;
     ngx_resolver_connection_t  *rec;
 
@@ -243,6 +291,66 @@ ngx_resolver_create(ngx_conf_t *cf, ngx_str_t *names, ngx_uint_t n)
         }
 #endif
 
+        if (ngx_strncmp(names[i].data, "zone=", 5) == 0) {
+
+            name.data = names[i].data + 5;
+
+            p = (u_char *) ngx_strchr(name.data, ':');
+
+            if (p == NULL) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid zone size \"%V\"", &names[i]);
+                return NULL;
+            }
+
+            name.len = p - name.data;
+
+            s.data = p + 1;
+            s.len = names[i].data + names[i].len - s.data;
+
+            size = ngx_parse_size(&s);
+
+            if (size == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid zone size \"%V\"", &names[i]);
+                return NULL;
+            }
+
+            if (size < (ssize_t) (8 * ngx_pagesize)) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "zone \"%V\" is too small", &names[i]);
+                return NULL;
+            }
+
+            r->shm_zone = ngx_shared_memory_add(cf, &name, size,
+                                                &ngx_core_module);
+            if (r->shm_zone == NULL) {
+                return NULL;
+            }
+
+            if (r->shm_zone->data == NULL) {
+                shm = ngx_pcalloc(cf->pool, sizeof(ngx_resolver_shm_t));
+                if (shm == NULL) {
+                    return NULL;
+                }
+
+                r->shm_zone->init = ngx_resolver_init_zone;
+                r->shm_zone->data = shm;
+            }
+
+            r->shm_event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+            if (r->shm_event == NULL) {
+                return NULL;
+            }
+
+            r->shm_event->handler = ngx_resolver_shm_handler;
+            r->shm_event->data = r;
+            r->shm_event->log = &cf->cycle->new_log;
+            r->shm_event->cancelable = 1;
+
+            continue;
+        }
+
         ngx_memzero(&u, sizeof(ngx_url_t));
 
         u.url = names[i];
@@ -306,6 +414,10 @@ ngx_resolver_cleanup(void *data)
         ngx_del_timer(r->event);
     }
 
+    if (r->shm_event && r->shm_event->timer_set) {
+        ngx_del_timer(r->shm_event);
+    }
+
     rec = r->connections.elts;
 
     for (i = 0; i < r->connections.nelts; i++) {
@@ -582,7 +694,7 @@ ngx_resolve_name_locked(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
     uint32_t              hash;
     ngx_int_t             rc;
     ngx_str_t             cname;
-    ngx_uint_t            i, naddrs;
+    ngx_uint_t            i, naddrs, shared;
     ngx_queue_t          *resend_queue, *expire_queue;
     ngx_rbtree_t         *tree;
     ngx_resolver_ctx_t   *next, *last;
@@ -801,6 +913,26 @@ ngx_resolve_name_locked(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
         ngx_rbtree_insert(tree, &rn->node);
     }
 
+    shared = 0;
+
+    if (r->shm_zone && ctx->service.len == 0) {
+
+        rc = ngx_resolver_shm_lookup(r, rn, hash);
+
+        if (rc == NGX_OK) {
+            rn->waiting = NULL;
+            rn->expire = ngx_time() + r->expire;
+
+            ngx_queue_insert_head(expire_queue, &rn->queue);
+
+            return ngx_resolve_name_locked(r, ctx, name);
+        }
+
+        if (rc == NGX_BUSY) {
+            shared = 1;
+        }
+    }
+
     if (ctx->service.len) {
         rc = ngx_resolver_create_srv_query(r, rn, name);
 
@@ -843,8 +975,20 @@ ngx_resolve_name_locked(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
     rn->tcp6 = 0;
 #endif
     rn->nsrvs = 0;
+    rn->shared = shared;
 
-    if (ngx_resolver_send_query(r, rn) != NGX_OK) {
+    if (shared) {
+
+        /*
+         * another worker process is already resolving the name,
+         * wait for its answer to appear in the shared zone
+         */
+
+        if (!r->shm_event->timer_set) {
+            ngx_add_timer(r->shm_event, NGX_RESOLVER_SHM_POLL);
+        }
+
+    } else if (ngx_resolver_send_query(r, rn) != NGX_OK) {
 
         /* immediately retry once on failure */
 
@@ -1515,7 +1659,10 @@ ngx_resolver_resend(ngx_resolver_t *r, ngx_rbtree_t *tree, ngx_queue_t *queue)
 
         if (rn->waiting) {
 
-            if (++rn->last_connection == r->connections.nelts) {
+            if (rn->shared) {
+                rn->shared = 0;
+
+            } else if (++rn->last_connection == r->connections.nelts) {
                 rn->last_connection = 0;
             }
 
@@ -2097,6 +2244,10 @@ ngx_resolver_process_a(ngx_resolver_t *r, u_char *buf, size_t n,
         }
 #endif
 
+        if (r->shm_zone) {
+            ngx_resolver_shm_release(r, rn);
+        }
+
         next = rn->waiting;
         rn->waiting = NULL;
 
@@ -2416,6 +2567,10 @@ ngx_resolver_process_a(ngx_resolver_t *r, u_char *buf, size_t n,
 
         ngx_queue_insert_head(&r->name_expire_queue, &rn->queue);
 
+        if (r->shm_zone) {
+            ngx_resolver_shm_store(r, rn);
+        }
+
         next = rn->waiting;
         rn->waiting = NULL;
 
@@ -2488,6 +2643,10 @@ ngx_resolver_process_a(ngx_resolver_t *r, u_char *buf, size_t n,
 
         ngx_queue_insert_head(&r->name_expire_queue, &rn->queue);
 
+        if (r->shm_zone) {
+            ngx_resolver_shm_store(r, rn);
+        }
+
         ngx_resolver_free(r, rn->query);
         rn->query = NULL;
 #if (NGX_HAVE_INET6)
@@ -3629,6 +3788,480 @@ ngx_resolver_rbtree_insert_addr6_value(ngx_rbtree_node_t *temp,
 #endif
 
 
+static ngx_int_t
+ngx_resolver_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_resolver_shm_t  *oshm = data;
+
+    size_t               len;
+    ngx_resolver_shm_t  *shm;
+
+    shm = shm_zone->data;
+
+    if (oshm) {
+        shm->sh = oshm->sh;
+        shm->shpool = oshm->shpool;
+
+        return NGX_OK;
+    }
+
+    shm->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        shm->sh = shm->shpool->data;
+
+        return NGX_OK;
+    }
+
+    shm->sh = ngx_slab_alloc(shm->shpool, sizeof(ngx_resolver_shm_sh_t));
+    if (shm->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    shm->shpool->data = shm->sh;
+
+    ngx_rbtree_init(&shm->sh->rbtree, &shm->sh->sentinel,
+                    ngx_str_rbtree_insert_value);
+
+    ngx_queue_init(&shm->sh->queue);
+
+    len = sizeof(" in resolver zone \"\"") + shm_zone->shm.name.len;
+
+    shm->shpool->log_ctx = ngx_slab_alloc(shm->shpool, len);
+    if (shm->shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(shm->shpool->log_ctx, " in resolver zone \"%V\"%Z",
+                &shm_zone->shm.name);
+
+    shm->shpool->log_nomem = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_resolver_shm_lookup(ngx_resolver_t *r, ngx_resolver_node_t *rn,
+    uint32_t hash)
+{
+    u_char                   *p;
+    time_t                    now;
+    ngx_str_t                 name;
+    ngx_uint_t                ipv6;
+    ngx_resolver_shm_t       *shm;
+    ngx_resolver_shm_node_t  *sn;
+
+    shm = r->shm_zone->data;
+
+    name.len = rn->nlen;
+    name.data = rn->name;
+
+#if (NGX_HAVE_INET6)
+    ipv6 = r->ipv6;
+#else
+    ipv6 = 0;
+#endif
+
+    now = ngx_time();
+
+    ngx_shmtx_lock(&shm->shpool->mutex);
+
+    sn = (ngx_resolver_shm_node_t *)
+             ngx_str_rbtree_lookup(&shm->sh->rbtree, &name, hash);
+
+    if (sn && sn->valid >= now && sn->ipv6 == ipv6) {
+        goto found;
+    }
+
+    if (sn && sn->updating > now) {
+        ngx_shmtx_unlock(&shm->shpool->mutex);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_CORE, r->log, 0,
+                       "resolve shared wait \"%V\"", &name);
+
+        return NGX_BUSY;
+    }
+
+    if (sn == NULL) {
+        sn = ngx_resolver_shm_alloc(shm, name.len);
+
+        if (sn == NULL) {
+            ngx_shmtx_unlock(&shm->shpool->mutex);
+            return NGX_DECLINED;
+        }
+
+        ngx_memcpy(sn->data, name.data, name.len);
+
+        sn->sn.node.key = hash;
+        sn->sn.str.len = name.len;
+        sn->sn.str.data = sn->data;
+
+        sn->valid = 0;
+        sn->ttl = 0;
+        sn->cnlen = 0;
+        sn->naddrs = 0;
+        sn->naddrs6 = 0;
+        sn->ipv6 = (u_char) ipv6;
+
+        ngx_rbtree_insert(&shm->sh->rbtree, &sn->sn.node);
+
+    } else {
+        ngx_queue_remove(&sn->queue);
+    }
+
+    ngx_queue_insert_head(&shm->sh->queue, &sn->queue);
+
+    /* mark the name as being resolved by this worker process */
+
+    sn->updating = now + r->resend_timeout;
+
+    ngx_shmtx_unlock(&shm->shpool->mutex);
+
+    return NGX_DECLINED;
+
+found:
+
+    p = sn->data + sn->sn.str.len;
+
+    if (sn->cnlen) {
+        rn->u.cname = ngx_resolver_dup(r, p, sn->cnlen);
+        if (rn->u.cname == NULL) {
+            goto failed;
+        }
+
+        rn->naddrs = 0;
+#if (NGX_HAVE_INET6)
+        rn->naddrs6 = 0;
+#endif
+
+    } else {
+
+        if (sn->naddrs == 1) {
+            ngx_memcpy(&rn->u.addr, p, sizeof(in_addr_t));
+
+        } else if (sn->naddrs) {
+            rn->u.addrs = ngx_resolver_dup(r, p,
+                                           sn->naddrs * sizeof(in_addr_t));
+            if (rn->u.addrs == NULL) {
+                goto failed;
+            }
+        }
+
+        rn->naddrs = sn->naddrs;
+
+#if (NGX_HAVE_INET6)
+
+        p += sn->naddrs * sizeof(in_addr_t);
+
+        if (sn->naddrs6 == 1) {
+            ngx_memcpy(&rn->u6.addr6, p, sizeof(struct in6_addr));
+
+        } else if (sn->naddrs6) {
+            rn->u6.addrs6 = ngx_resolver_dup(r, p, sn->naddrs6
+                                                   * sizeof(struct in6_addr));
+            if (rn->u6.addrs6 == NULL) {
+
+                if (rn->naddrs > 1) {
+                    ngx_resolver_free(r, rn->u.addrs);
+                }
+
+                goto failed;
+            }
+        }
+
+        rn->naddrs6 = sn->naddrs6;
+#endif
+    }
+
+    rn->cnlen = sn->cnlen;
+    rn->valid = sn->valid;
+    rn->ttl = sn->ttl;
+    rn->code = 0;
+    rn->nsrvs = 0;
+
+    ngx_queue_remove(&sn->queue);
+    ngx_queue_insert_head(&shm->sh->queue, &sn->queue);
+
+    ngx_shmtx_unlock(&shm->shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, r->log, 0,
+                   "resolve shared cached \"%V\"", &name);
+
+    return NGX_OK;
+
+failed:
+
+    ngx_shmtx_unlock(&shm->shpool->mutex);
+
+    return NGX_ERROR;
+}
+
+
+static void
+ngx_resolver_shm_store(ngx_resolver_t *r, ngx_resolver_node_t *rn)
+{
+    u_char                   *p;
+    size_t                    len;
+    ngx_str_t                 name;
+    ngx_uint_t                naddrs, naddrs6;
+    ngx_resolver_shm_t       *shm;
+    ngx_resolver_shm_node_t  *sn;
+
+    shm = r->shm_zone->data;
+
+    name.len = rn->nlen;
+    name.data = rn->name;
+
+    naddrs = 0;
+    naddrs6 = 0;
+
+    if (rn->cnlen == 0) {
+        naddrs = (rn->naddrs == (u_short) -1) ? 0 : rn->naddrs;
+#if (NGX_HAVE_INET6)
+        naddrs6 = (rn->naddrs6 == (u_short) -1) ? 0 : rn->naddrs6;
+#endif
+    }
+
+    len = name.len + rn->cnlen + naddrs * sizeof(in_addr_t) + naddrs6 * 16;
+
+    ngx_shmtx_lock(&shm->shpool->mutex);
+
+    sn = (ngx_resolver_shm_node_t *)
+             ngx_str_rbtree_lookup(&shm->sh->rbtree, &name, rn->node.key);
+
+    if (sn
+        && sn->sn.str.len + sn->cnlen + sn->naddrs * sizeof(in_addr_t)
+           + sn->naddrs6 * 16 != len)
+    {
+        ngx_resolver_shm_free(shm, sn);
+        sn = NULL;
+    }
+
+    if (sn == NULL) {
+        sn = ngx_resolver_shm_alloc(shm, len);
+
+        if (sn == NULL) {
+            ngx_shmtx_unlock(&shm->shpool->mutex);
+
+            ngx_log_error(NGX_LOG_WARN, r->log, 0,
+                          "could not allocate node%s",
+                          shm->shpool->log_ctx);
+            return;
+        }
+
+        ngx_memcpy(sn->data, name.data, name.len);
+
+        sn->sn.node.key = rn->node.key;
+        sn->sn.str.len = name.len;
+        sn->sn.str.data = sn->data;
+
+        ngx_rbtree_insert(&shm->sh->rbtree, &sn->sn.node);
+
+    } else {
+        ngx_queue_remove(&sn->queue);
+    }
+
+    ngx_queue_insert_head(&shm->sh->queue, &sn->queue);
+
+    sn->valid = rn->valid;
+    sn->updating = 0;
+    sn->ttl = rn->ttl;
+    sn->cnlen = rn->cnlen;
+    sn->naddrs = (u_short) naddrs;
+    sn->naddrs6 = (u_short) naddrs6;
+#if (NGX_HAVE_INET6)
+    sn->ipv6 = (u_char) r->ipv6;
+#else
+    sn->ipv6 = 0;
+#endif
+
+    p = sn->data + name.len;
+
+    if (rn->cnlen) {
+        ngx_memcpy(p, rn->u.cname, rn->cnlen);
+
+    } else {
+        p = ngx_cpymem(p, (naddrs == 1) ? &rn->u.addr : rn->u.addrs,
+                       naddrs * sizeof(in_addr_t));
+
+#if (NGX_HAVE_INET6)
+        ngx_memcpy(p, (naddrs6 == 1) ? &rn->u6.addr6 : rn->u6.addrs6,
+                   naddrs6 * sizeof(struct in6_addr));
+#endif
+    }
+
+    ngx_shmtx_unlock(&shm->shpool->mutex);
+}
+
+
+static void
+ngx_resolver_shm_release(ngx_resolver_t *r, ngx_resolver_node_t *rn)
+{
+    ngx_str_t                 name;
+    ngx_resolver_shm_t       *shm;
+    ngx_resolver_shm_node_t  *sn;
+
+    shm = r->shm_zone->data;
+
+    name.len = rn->nlen;
+    name.data = rn->name;
+
+    ngx_shmtx_lock(&shm->shpool->mutex);
+
+    sn = (ngx_resolver_shm_node_t *)
+             ngx_str_rbtree_lookup(&shm->sh->rbtree, &name, rn->node.key);
+
+    if (sn) {
+        sn->updating = 0;
+    }
+
+    ngx_shmtx_unlock(&shm->shpool->mutex);
+}
+
+
+static ngx_resolver_shm_node_t *
+ngx_resolver_shm_alloc(ngx_resolver_shm_t *shm, size_t size)
+{
+    time_t                    now;
+    ngx_uint_t                i;
+    ngx_queue_t              *q;
+    ngx_resolver_shm_node_t  *sn;
+
+    now = ngx_time();
+
+    size += offsetof(ngx_resolver_shm_node_t, data);
+
+    /* free up to two stale nodes */
+
+    for (i = 0; i < 2; i++) {
+
+        if (ngx_queue_empty(&shm->sh->queue)) {
+            break;
+        }
+
+        q = ngx_queue_last(&shm->sh->queue);
+        sn = ngx_queue_data(q, ngx_resolver_shm_node_t, queue);
+
+        if (sn->valid >= now || sn->updating > now) {
+            break;
+        }
+
+        ngx_resolver_shm_free(shm, sn);
+    }
+
+    sn = ngx_slab_alloc_locked(shm->shpool, size);
+
+    if (sn == NULL && !ngx_queue_empty(&shm->sh->queue)) {
+
+        /* evict the least recently used node and try again */
+
+        q = ngx_queue_last(&shm->sh->queue);
+        ngx_resolver_shm_free(shm,
+                              ngx_queue_data(q, ngx_resolver_shm_node_t, queue));
+
+        sn = ngx_slab_alloc_locked(shm->shpool, size);
+    }
+
+    return sn;
+}
+
+
+static void
+ngx_resolver_shm_free(ngx_resolver_shm_t *shm, ngx_resolver_shm_node_t *sn)
+{
+    ngx_queue_remove(&sn->queue);
+    ngx_rbtree_delete(&shm->sh->rbtree, &sn->sn.node);
+    ngx_slab_free_locked(shm->shpool, sn);
+}
+
+
+static void
+ngx_resolver_shm_handler(ngx_event_t *ev)
+{
+    ngx_int_t             rc;
+    ngx_str_t             name;
+    ngx_uint_t            pending;
+    ngx_queue_t          *q;
+    ngx_resolver_t       *r;
+    ngx_resolver_ctx_t   *ctx, *next;
+    ngx_resolver_node_t  *rn;
+
+    r = ev->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, r->log, 0,
+                   "resolver shared handler");
+
+    /* lock name mutex */
+
+again:
+
+    pending = 0;
+
+    for (q = ngx_queue_head(&r->name_resend_queue);
+         q != ngx_queue_sentinel(&r->name_resend_queue);
+         q = ngx_queue_next(q))
+    {
+        rn = ngx_queue_data(q, ngx_resolver_node_t, queue);
+
+        if (!rn->shared || rn->waiting == NULL) {
+            continue;
+        }
+
+        rc = ngx_resolver_shm_lookup(r, rn, rn->node.key);
+
+        if (rc == NGX_BUSY) {
+            pending = 1;
+            continue;
+        }
+
+        rn->shared = 0;
+
+        if (rc != NGX_OK) {
+
+            /* the other worker process failed, resolve the name here */
+
+            (void) ngx_resolver_send_query(r, rn);
+            continue;
+        }
+
+        ngx_queue_remove(&rn->queue);
+
+        ngx_resolver_free(r, rn->query);
+        rn->query = NULL;
+#if (NGX_HAVE_INET6)
+        rn->query6 = NULL;
+#endif
+
+        rn->expire = ngx_time() + r->expire;
+
+        ngx_queue_insert_head(&r->name_expire_queue, &rn->queue);
+
+        ctx = rn->waiting;
+        rn->waiting = NULL;
+
+        for (next = ctx; next; next = next->next) {
+            next->node = NULL;
+        }
+
+        name.len = rn->nlen;
+        name.data = rn->name;
+
+        (void) ngx_resolve_name_locked(r, ctx, &name);
+
+        /* the queue might have been changed by the handlers */
+
+        goto again;
+    }
+
+    /* unlock name mutex */
+
+    if (pending) {
+        ngx_add_timer(ev, NGX_RESOLVER_SHM_POLL);
+    }
+}
+
+
 static ngx_int_t
 ngx_resolver_create_name_query(ngx_resolver_t *r, ngx_resolver_node_t *rn,
     ngx_str_t *name)
@@ -138,6 +138,7 @@ typedef struct {
 #if (NGX_HAVE_INET6)
     unsigned                  tcp6:1;
 #endif
+    unsigned                  shared:1;
 
     ngx_uint_t                last_connection;
 
@@ -189,6 +190,9 @@ struct ngx_resolver_s {
     time_t                    valid;
 
     ngx_uint_t                log_level;
+
+    ngx_shm_zone_t           *shm_zone;
+    ngx_event_t              *shm_event;
 };
 
 
@@ -37,6 +37,7 @@ struct ngx_thread_pool_s {
     ngx_str_t                 name;
     ngx_uint_t                threads;
     ngx_int_t                 max_queue;
+    ngx_uint_t                helper;  /* unsigned  helper:1; */
 
     u_char                   *file;
     ngx_uint_t                line;
@@ -554,6 +555,27 @@ ngx_thread_pool_add(ngx_conf_t *cf, ngx_str_t *name)
 }
 
 
+/*
+ * unlike other thread pools, pools added this way are also started
+ * in helper processes, such as the cache manager
+ */
+
+ngx_thread_pool_t *
+ngx_thread_pool_add_helper(ngx_conf_t *cf, ngx_str_t *name)
+{
+    ngx_thread_pool_t  *tp;
+
+    tp = ngx_thread_pool_add(cf, name);
+    if (tp == NULL) {
+        return NULL;
+    }
+
+    tp->helper = 1;
+
+    return tp;
+}
+
+
 ngx_thread_pool_t *
 ngx_thread_pool_get(ngx_cycle_t *cycle, ngx_str_t *name)
 {
@@ -587,7 +609,8 @@ ngx_thread_pool_init_worker(ngx_cycle_t *cycle)
     ngx_thread_pool_conf_t   *tcf;
 
     if (ngx_process != NGX_PROCESS_WORKER
-        && ngx_process != NGX_PROCESS_SINGLE)
+        && ngx_process != NGX_PROCESS_SINGLE
+        && ngx_process != NGX_PROCESS_HELPER)
     {
         return NGX_OK;
     }
@@ -604,6 +627,11 @@ ngx_thread_pool_init_worker(ngx_cycle_t *cycle)
     tpp = tcf->pools.elts;
 
     for (i = 0; i < tcf->pools.nelts; i++) {
+
+        if (ngx_process == NGX_PROCESS_HELPER && !tpp[i]->helper) {
+            continue;
+        }
+
         if (ngx_thread_pool_init(tpp[i], cycle->log, cycle->pool) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -621,7 +649,8 @@ ngx_thread_pool_exit_worker(ngx_cycle_t *cycle)
     ngx_thread_pool_conf_t   *tcf;
 
     if (ngx_process != NGX_PROCESS_WORKER
-        && ngx_process != NGX_PROCESS_SINGLE)
+        && ngx_process != NGX_PROCESS_SINGLE
+        && ngx_process != NGX_PROCESS_HELPER)
     {
         return;
     }
@@ -636,6 +665,11 @@ ngx_thread_pool_exit_worker(ngx_cycle_t *cycle)
     tpp = tcf->pools.elts;
 
     for (i = 0; i < tcf->pools.nelts; i++) {
+
+        if (ngx_process == NGX_PROCESS_HELPER && !tpp[i]->helper) {
+            continue;
+        }
+
         ngx_thread_pool_destroy(tpp[i]);
     }
 }
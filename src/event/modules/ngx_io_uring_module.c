@@ -0,0 +1,834 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+#include <poll.h>
+#include <linux/io_uring.h>
+
+
+/*
+ * The io_uring event module submits readiness requests (IORING_OP_POLL_ADD)
+ * through the submission ring and harvests them from the completion ring.
+ * Additions and deletions of events do not cause syscalls: the accumulated
+ * submissions are passed to the kernel in a single io_uring_enter() call,
+ * which also waits for the completions.
+ *
+ * Poll requests are oneshot, so the module behaves like event ports: an event
+ * is deactivated after a notification and is added again by the
+ * ngx_handle_read_event() and ngx_handle_write_event() functions.
+ *
+ * The user data of a request is the event pointer, the event instance bit,
+ * and the request generation in the upper 16 bits.  The generation is kept
+ * in the ev->index field and allows to skip completions of the requests
+ * that were deleted or replaced.
+ */
+
+
+#define NGX_IO_URING_GEN_SHIFT  48
+#define NGX_IO_URING_GEN_MASK   0xffff
+
+
+typedef struct {
+    ngx_uint_t  entries;
+} ngx_io_uring_conf_t;
+
+
+static ngx_int_t ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer);
+static ngx_int_t ngx_io_uring_setup(ngx_cycle_t *cycle,
+    ngx_io_uring_conf_t *urcf);
+static ngx_int_t ngx_io_uring_notify_init(ngx_log_t *log);
+static void ngx_io_uring_notify_handler(ngx_event_t *ev);
+static void ngx_io_uring_done(ngx_cycle_t *cycle);
+static ngx_int_t ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_notify(ngx_event_handler_pt handler);
+static ngx_int_t ngx_io_uring_process_events(ngx_cycle_t *cycle,
+    ngx_msec_t timer, ngx_uint_t flags);
+static struct io_uring_sqe *ngx_io_uring_get_sqe(ngx_log_t *log);
+static int ngx_io_uring_enter(u_int to_submit, u_int min_complete,
+    u_int flags, struct __kernel_timespec *ts);
+
+static void *ngx_io_uring_create_conf(ngx_cycle_t *cycle);
+static char *ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf);
+
+
+extern ngx_module_t  ngx_epoll_module;
+
+
+typedef struct {
+    uint32_t                 *head;
+    uint32_t                 *tail;
+    uint32_t                 *flags;
+    uint32_t                 *array;
+    uint32_t                  mask;
+    uint32_t                  entries;
+    struct io_uring_sqe      *sqes;
+    uint32_t                  sqe_tail;
+    void                     *ring;
+    size_t                    ring_size;
+    size_t                    sqes_size;
+} ngx_io_uring_sq_t;
+
+
+typedef struct {
+    uint32_t                 *head;
+    uint32_t                 *tail;
+    uint32_t                  mask;
+    struct io_uring_cqe      *cqes;
+    void                     *ring;
+    size_t                    ring_size;
+} ngx_io_uring_cq_t;
+
+
+static int                    ring = -1;
+static ngx_io_uring_sq_t      sq;
+static ngx_io_uring_cq_t      cq;
+
+static int                    notify_fd = -1;
+static ngx_event_t            notify_event;
+static ngx_connection_t       notify_conn;
+static ngx_event_handler_pt   notify_handler;
+
+static ngx_str_t      io_uring_name = ngx_string("io_uring");
+
+static ngx_command_t  ngx_io_uring_commands[] = {
+
+    { ngx_string("io_uring_entries"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_io_uring_conf_t, entries),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_event_module_t  ngx_io_uring_module_ctx = {
+    &io_uring_name,
+    ngx_io_uring_create_conf,            /* create configuration */
+    ngx_io_uring_init_conf,              /* init configuration */
+
+    {
+        ngx_io_uring_add_event,          /* add an event */
+        ngx_io_uring_del_event,          /* delete an event */
+        ngx_io_uring_add_event,          /* enable an event */
+        ngx_io_uring_del_event,          /* disable an event */
+        NULL,                            /* add an connection */
+        NULL,                            /* delete an connection */
+        ngx_io_uring_notify,             /* trigger a notify */
+        ngx_io_uring_process_events,     /* process the events */
+        ngx_io_uring_init,               /* init the events */
+        ngx_io_uring_done,               /* done the events */
+    }
+};
+
+ngx_module_t  ngx_io_uring_module = {
+    NGX_MODULE_V1,
+    &ngx_io_uring_module_ctx,            /* module context */
+    ngx_io_uring_commands,               /* module directives */
+    NGX_EVENT_MODULE,                    /* module type */
+    NULL,                                /* init master */
+    NULL,                                /* init module */
+    NULL,                                /* init process */
+    NULL,                                /* init thread */
+    NULL,                                /* exit thread */
+    NULL,                                /* exit process */
+    NULL,                                /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/*
+ * We call io_uring_setup() and io_uring_enter() directly as syscalls
+ * instead of liburing usage to avoid an external dependency.
+ */
+
+static int
+io_uring_setup(u_int entries, struct io_uring_params *p)
+{
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+
+static ngx_int_t
+ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer)
+{
+    ngx_event_module_t   *module;
+    ngx_io_uring_conf_t  *urcf;
+
+    urcf = ngx_event_get_conf(cycle->conf_ctx, ngx_io_uring_module);
+
+    if (ring == -1) {
+        if (ngx_io_uring_setup(cycle, urcf) != NGX_OK) {
+
+            ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                          "io_uring is not available, using epoll");
+
+            module = ngx_epoll_module.ctx;
+
+            return module->actions.init(cycle, timer);
+        }
+
+        if (ngx_io_uring_notify_init(cycle->log) != NGX_OK) {
+            ngx_io_uring_module_ctx.actions.notify = NULL;
+        }
+    }
+
+    ngx_io = ngx_os_io;
+
+    ngx_event_actions = ngx_io_uring_module_ctx.actions;
+
+    ngx_event_flags = NGX_USE_EVENTPORT_EVENT;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_setup(ngx_cycle_t *cycle, ngx_io_uring_conf_t *urcf)
+{
+    u_char                 *p;
+    struct io_uring_params  params;
+
+    ngx_memzero(&params, sizeof(struct io_uring_params));
+
+    ring = io_uring_setup(urcf->entries, &params);
+
+    if (ring == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "io_uring_setup() failed");
+        return NGX_ERROR;
+    }
+
+    if (!(params.features & IORING_FEAT_EXT_ARG)
+        || !(params.features & IORING_FEAT_NODROP))
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "io_uring does not support required features: %08xD",
+                      params.features);
+        goto failed;
+    }
+
+    sq.ring_size = params.sq_off.array
+                   + params.sq_entries * sizeof(uint32_t);
+    cq.ring_size = params.cq_off.cqes
+                   + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq.ring_size = ngx_max(sq.ring_size, cq.ring_size);
+        cq.ring_size = sq.ring_size;
+    }
+
+    sq.ring = mmap(NULL, sq.ring_size, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+
+    if (sq.ring == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQ_RING) failed");
+        sq.ring = NULL;
+        goto failed;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq.ring = sq.ring;
+
+    } else {
+        cq.ring = mmap(NULL, cq.ring_size, PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+
+        if (cq.ring == MAP_FAILED) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "mmap(IORING_OFF_CQ_RING) failed");
+            cq.ring = NULL;
+            goto failed;
+        }
+    }
+
+    sq.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sq.sqes = mmap(NULL, sq.sqes_size, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQES);
+
+    if (sq.sqes == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQES) failed");
+        sq.sqes = NULL;
+        goto failed;
+    }
+
+    p = sq.ring;
+
+    sq.head = (uint32_t *) (p + params.sq_off.head);
+    sq.tail = (uint32_t *) (p + params.sq_off.tail);
+    sq.flags = (uint32_t *) (p + params.sq_off.flags);
+    sq.array = (uint32_t *) (p + params.sq_off.array);
+    sq.mask = *(uint32_t *) (p + params.sq_off.ring_mask);
+    sq.entries = *(uint32_t *) (p + params.sq_off.ring_entries);
+    sq.sqe_tail = *sq.tail;
+
+    p = cq.ring;
+
+    cq.head = (uint32_t *) (p + params.cq_off.head);
+    cq.tail = (uint32_t *) (p + params.cq_off.tail);
+    cq.mask = *(uint32_t *) (p + params.cq_off.ring_mask);
+    cq.cqes = (struct io_uring_cqe *) (p + params.cq_off.cqes);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring: fd:%d sq:%uD cq:%uD",
+                   ring, params.sq_entries, params.cq_entries);
+
+    return NGX_OK;
+
+failed:
+
+    ngx_io_uring_done(cycle);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify_init(ngx_log_t *log)
+{
+#if (NGX_HAVE_SYS_EVENTFD_H)
+    notify_fd = eventfd(0, 0);
+#else
+    notify_fd = syscall(SYS_eventfd, 0);
+#endif
+
+    if (notify_fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno, "eventfd() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "notify eventfd: %d", notify_fd);
+
+    notify_event.handler = ngx_io_uring_notify_handler;
+    notify_event.log = log;
+    notify_event.data = &notify_conn;
+
+    notify_conn.fd = notify_fd;
+    notify_conn.read = &notify_event;
+    notify_conn.log = log;
+
+    if (ngx_io_uring_add_event(&notify_event, NGX_READ_EVENT, 0) != NGX_OK) {
+
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_io_uring_notify_handler(ngx_event_t *ev)
+{
+    ssize_t               n;
+    uint64_t              count;
+    ngx_event_handler_pt  handler;
+
+    /* the eventfd stays readable until it is read, poll requests are oneshot */
+
+    n = read(notify_fd, &count, sizeof(uint64_t));
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "read() eventfd %d: %z count:%uL", notify_fd, n, count);
+
+    if ((size_t) n != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                      "read() eventfd %d failed", notify_fd);
+    }
+
+    ev->ready = 0;
+
+    if (ngx_io_uring_add_event(ev, NGX_READ_EVENT, 0) != NGX_OK) {
+        return;
+    }
+
+    handler = notify_handler;
+    handler(ev);
+}
+
+
+static void
+ngx_io_uring_done(ngx_cycle_t *cycle)
+{
+    if (sq.sqes) {
+        if (munmap(sq.sqes, sq.sqes_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_SQES) failed");
+        }
+    }
+
+    if (cq.ring && cq.ring != sq.ring) {
+        if (munmap(cq.ring, cq.ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_CQ_RING) failed");
+        }
+    }
+
+    if (sq.ring) {
+        if (munmap(sq.ring, sq.ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "munmap(IORING_OFF_SQ_RING) failed");
+        }
+    }
+
+    ngx_memzero(&sq, sizeof(ngx_io_uring_sq_t));
+    ngx_memzero(&cq, sizeof(ngx_io_uring_cq_t));
+
+    if (ring != -1 && close(ring) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "io_uring close() failed");
+    }
+
+    ring = -1;
+
+    if (notify_fd != -1 && close(notify_fd) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "eventfd close() failed");
+    }
+
+    notify_fd = -1;
+}
+
+
+static ngx_int_t
+ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    uint32_t              events;
+    ngx_connection_t     *c;
+    struct io_uring_sqe  *sqe;
+
+    if (ev->active) {
+        return NGX_OK;
+    }
+
+    c = ev->data;
+
+    if (event == NGX_READ_EVENT) {
+        events = POLLIN|POLLRDHUP;
+
+    } else {
+        events = POLLOUT;
+    }
+
+    sqe = ngx_io_uring_get_sqe(ev->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    ev->index = (ev->index + 1) & NGX_IO_URING_GEN_MASK;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = c->fd;
+    sqe->poll32_events = events;
+    sqe->user_data = (uint64_t) ((uintptr_t) ev | ev->instance)
+                     | ((uint64_t) ev->index << NGX_IO_URING_GEN_SHIFT);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring add event: fd:%d ev:%04XD gen:%ui",
+                   c->fd, events, ev->index);
+
+    ev->active = 1;
+    ev->oneshot = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    struct io_uring_sqe  *sqe;
+
+    /*
+     * a pending poll request holds a reference to the file, so the request
+     * is removed explicitly even if the file descriptor is going to be closed
+     */
+
+    if (ev->active) {
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "io_uring del event: fd:%d gen:%ui",
+                       ((ngx_connection_t *) ev->data)->fd, ev->index);
+
+        sqe = ngx_io_uring_get_sqe(ev->log);
+        if (sqe == NULL) {
+            return NGX_ERROR;
+        }
+
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t) ((uintptr_t) ev | ev->instance)
+                    | ((uint64_t) ev->index << NGX_IO_URING_GEN_SHIFT);
+        sqe->user_data = 0;
+
+        ev->index = (ev->index + 1) & NGX_IO_URING_GEN_MASK;
+    }
+
+    ev->active = 0;
+    ev->oneshot = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify(ngx_event_handler_pt handler)
+{
+    static uint64_t inc = 1;
+
+    notify_handler = handler;
+
+    if ((size_t) write(notify_fd, &inc, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, notify_event.log, ngx_errno,
+                      "write() to eventfd %d failed", notify_fd);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
+    ngx_uint_t flags)
+{
+    int                        n, res;
+    uint32_t                   head, tail, revents;
+    uint64_t                   data;
+    ngx_err_t                  err;
+    ngx_int_t                  instance;
+    ngx_uint_t                 level, gen;
+    ngx_event_t               *ev;
+    ngx_queue_t               *queue;
+    struct io_uring_cqe       *cqe;
+    struct __kernel_timespec   ts, *tp;
+
+    if (timer == NGX_TIMER_INFINITE) {
+        tp = NULL;
+
+    } else {
+        ts.tv_sec = timer / 1000;
+        ts.tv_nsec = (timer % 1000) * 1000000;
+        tp = &ts;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring timer: %M, submit: %uD",
+                   timer, sq.sqe_tail - *sq.head);
+
+    n = ngx_io_uring_enter(sq.sqe_tail - *sq.head, 1,
+                           IORING_ENTER_GETEVENTS, tp);
+
+    err = (n == -1) ? ngx_errno : 0;
+
+    if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
+        ngx_time_update();
+    }
+
+    if (err) {
+        if (err == NGX_EINTR) {
+
+            if (ngx_event_timer_alarm) {
+                ngx_event_timer_alarm = 0;
+                return NGX_OK;
+            }
+
+            level = NGX_LOG_INFO;
+
+        } else if (err == ETIME) {
+
+            if (timer != NGX_TIMER_INFINITE) {
+                return NGX_OK;
+            }
+
+            level = NGX_LOG_ALERT;
+
+        } else if (err == NGX_EBUSY || err == NGX_EAGAIN) {
+
+            /* the completion ring is overflown, reap the completions */
+
+            level = 0;
+
+        } else {
+            level = NGX_LOG_ALERT;
+        }
+
+        if (level) {
+            ngx_log_error(level, cycle->log, err, "io_uring_enter() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    head = *cq.head;
+    tail = *cq.tail;
+
+    ngx_memory_barrier();
+
+    for ( /* void */ ; head != tail; head++) {
+
+        cqe = &cq.cqes[head & cq.mask];
+
+        data = cqe->user_data;
+        res = cqe->res;
+
+        if (data == 0) {
+            /* poll remove request */
+            continue;
+        }
+
+        gen = (ngx_uint_t) (data >> NGX_IO_URING_GEN_SHIFT);
+        data &= ((uint64_t) 1 << NGX_IO_URING_GEN_SHIFT) - 1;
+
+        instance = data & 1;
+        ev = (ngx_event_t *) (uintptr_t) (data & (uint64_t) ~1);
+
+        if (res == -ECANCELED
+            || !ev->active
+            || ev->closed
+            || ev->instance != instance
+            || ev->index != gen)
+        {
+            /*
+             * the stale event from a request that was removed
+             * or from a file descriptor that was closed
+             */
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring: stale event %p res:%d", ev, res);
+            continue;
+        }
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "io_uring: fd:%d res:%04Xd d:%p",
+                       ((ngx_connection_t *) ev->data)->fd, res, ev);
+
+        if (res < 0) {
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, -res,
+                           "io_uring poll error on fd:%d ev:%p",
+                           ((ngx_connection_t *) ev->data)->fd, ev);
+
+            /* handle the error in the event handler */
+
+            revents = POLLIN|POLLOUT;
+
+        } else {
+            revents = (uint32_t) res;
+
+            if (revents & (POLLERR|POLLHUP|POLLNVAL)) {
+                revents |= POLLIN|POLLOUT;
+            }
+        }
+
+        ev->active = 0;
+
+        if (ev == &notify_event) {
+            ev->handler(ev);
+            continue;
+        }
+
+        if (ev->write) {
+            if (!(revents & POLLOUT)) {
+                continue;
+            }
+
+            ev->ready = 1;
+#if (NGX_THREADS)
+            ev->complete = 1;
+#endif
+
+            if (flags & NGX_POST_EVENTS) {
+                ngx_post_event(ev, &ngx_posted_events);
+
+            } else {
+                ev->handler(ev);
+            }
+
+            continue;
+        }
+
+        if (!(revents & POLLIN)) {
+            continue;
+        }
+
+        ev->ready = 1;
+        ev->available = -1;
+
+        if (flags & NGX_POST_EVENTS) {
+            queue = ev->accept ? &ngx_posted_accept_events
+                               : &ngx_posted_events;
+
+            ngx_post_event(ev, queue);
+
+        } else {
+            ev->handler(ev);
+
+            if (ev->closed || ev->instance != instance) {
+                continue;
+            }
+        }
+
+        if (ev->accept) {
+            if (ngx_use_accept_mutex) {
+                ngx_accept_events = 1;
+                continue;
+            }
+
+            if (ngx_io_uring_add_event(ev, NGX_READ_EVENT, 0) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    ngx_memory_barrier();
+
+    *cq.head = head;
+
+    return NGX_OK;
+}
+
+
+static struct io_uring_sqe *
+ngx_io_uring_get_sqe(ngx_log_t *log)
+{
+    uint32_t              head;
+    struct io_uring_sqe  *sqe;
+
+    head = *sq.head;
+
+    ngx_memory_barrier();
+
+    if (sq.sqe_tail - head >= sq.entries) {
+
+        /* the submission ring is full, flush it */
+
+        if (ngx_io_uring_enter(sq.sqe_tail - head, 0, 0, NULL) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "io_uring_enter() failed");
+            return NULL;
+        }
+
+        head = *sq.head;
+
+        ngx_memory_barrier();
+
+        if (sq.sqe_tail - head >= sq.entries) {
+            ngx_log_error(NGX_LOG_ALERT, log, 0,
+                          "io_uring submission queue is full");
+            return NULL;
+        }
+    }
+
+    sqe = &sq.sqes[sq.sqe_tail & sq.mask];
+
+    ngx_memzero(sqe, sizeof(struct io_uring_sqe));
+
+    sq.array[sq.sqe_tail & sq.mask] = sq.sqe_tail & sq.mask;
+    sq.sqe_tail++;
+
+    ngx_memory_barrier();
+
+    *sq.tail = sq.sqe_tail;
+
+    return sqe;
+}
+
+
+static int
+ngx_io_uring_enter(u_int to_submit, u_int min_complete, u_int flags,
+    struct __kernel_timespec *ts)
+{
+    struct io_uring_getevents_arg  arg;
+
+    ngx_memzero(&arg, sizeof(struct io_uring_getevents_arg));
+
+    arg.ts = (uint64_t) (uintptr_t) ts;
+
+    return syscall(SYS_io_uring_enter, ring, to_submit, min_complete,
+                   flags|IORING_ENTER_EXT_ARG, &arg,
+                   sizeof(struct io_uring_getevents_arg));
+}
+
+
+static void *
+ngx_io_uring_create_conf(ngx_cycle_t *cycle)
+{
+    ngx_io_uring_conf_t  *urcf;
+
+    urcf = ngx_palloc(cycle->pool, sizeof(ngx_io_uring_conf_t));
+    if (urcf == NULL) {
+        return NULL;
+    }
+
+    urcf->entries = NGX_CONF_UNSET;
+
+    return urcf;
+}
+
+
+static char *
+ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf)
+{
+    ngx_io_uring_conf_t *urcf = conf;
+
+    int                     fd;
+    ngx_event_conf_t       *ecf;
+    ngx_event_module_t     *module;
+    struct io_uring_params  params;
+
+    ngx_conf_init_uint_value(urcf->entries, 512);
+
+    ecf = ngx_event_get_conf(cycle->conf_ctx, ngx_event_core_module);
+
+    if (ecf->use != ngx_io_uring_module.ctx_index) {
+        return NGX_CONF_OK;
+    }
+
+    ngx_memzero(&params, sizeof(struct io_uring_params));
+
+    fd = io_uring_setup(1, &params);
+
+    if (fd != -1) {
+        (void) close(fd);
+
+        if ((params.features & IORING_FEAT_EXT_ARG)
+            && (params.features & IORING_FEAT_NODROP))
+        {
+            return NGX_CONF_OK;
+        }
+
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "io_uring does not support required features, "
+                      "using epoll");
+
+    } else {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, ngx_errno,
+                      "io_uring_setup() failed, using epoll");
+    }
+
+    module = ngx_epoll_module.ctx;
+
+    ecf->use = ngx_epoll_module.ctx_index;
+    ecf->name = module->name->data;
+
+    return NGX_CONF_OK;
+}
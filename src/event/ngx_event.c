@@ -22,12 +22,21 @@ extern ngx_module_t ngx_select_module;
 
 static char *ngx_event_init_conf(ngx_cycle_t *cycle, void *conf);
 static ngx_int_t ngx_event_module_init(ngx_cycle_t *cycle);
+#if (NGX_STAT_STUB)
+static void ngx_event_stat_set_slot(ngx_uint_t slot);
+#endif
 static ngx_int_t ngx_event_process_init(ngx_cycle_t *cycle);
+#if (NGX_HAVE_REUSEPORT && NGX_HAVE_INCOMING_CPU && NGX_HAVE_CPU_AFFINITY)
+static void ngx_event_set_incoming_cpu(ngx_cycle_t *cycle,
+    ngx_listening_t *ls);
+#endif
 static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
 static char *ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_event_multi_accept(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 
@@ -75,6 +84,12 @@ ngx_atomic_t         *ngx_stat_writing = &ngx_stat_writing0;
 static ngx_atomic_t   ngx_stat_waiting0;
 ngx_atomic_t         *ngx_stat_waiting = &ngx_stat_waiting0;
 
+#define NGX_STAT_SLOT_SIZE  128
+
+static u_char        *ngx_stat_shared;
+static ngx_uint_t     ngx_stat_slots;
+static ngx_uint_t     ngx_stat_slot;
+
 #endif
 
 
@@ -135,10 +150,10 @@ static ngx_command_t  ngx_event_core_commands[] = {
       NULL },
 
     { ngx_string("multi_accept"),
-      NGX_EVENT_CONF|NGX_CONF_FLAG,
-      ngx_conf_set_flag_slot,
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_event_multi_accept,
+      0,
       0,
-      offsetof(ngx_event_conf_t, multi_accept),
       NULL },
 
     { ngx_string("accept_mutex"),
@@ -155,6 +170,13 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex_delay),
       NULL },
 
+    { ngx_string("reuseport_cpu_affinity"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, reuseport_cpu_affinity),
+      NULL },
+
     { ngx_string("debug_connection"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
       ngx_event_debug_connection,
@@ -307,7 +329,7 @@ ngx_handle_read_event(ngx_event_t *rev, ngx_uint_t flags)
 
     } else if (ngx_event_flags & NGX_USE_EVENTPORT_EVENT) {
 
-        /* event ports */
+        /* event ports, io_uring */
 
         if (!rev->active && !rev->ready) {
             if (ngx_add_event(rev, NGX_READ_EVENT, 0) == NGX_ERROR) {
@@ -386,7 +408,7 @@ ngx_handle_write_event(ngx_event_t *wev, size_t lowat)
 
     } else if (ngx_event_flags & NGX_USE_EVENTPORT_EVENT) {
 
-        /* event ports */
+        /* event ports, io_uring */
 
         if (!wev->active && !wev->ready) {
             if (ngx_add_event(wev, NGX_WRITE_EVENT, 0) == NGX_ERROR) {
@@ -415,9 +437,11 @@ static char *
 ngx_event_init_conf(ngx_cycle_t *cycle, void *conf)
 {
 #if (NGX_HAVE_REUSEPORT)
-    ngx_uint_t        i;
-    ngx_listening_t  *ls;
+    ngx_uint_t         i;
+    ngx_listening_t   *ls;
 #endif
+    ngx_core_conf_t   *ccf;
+    ngx_event_conf_t  *ecf;
 
     if (ngx_get_conf(cycle->conf_ctx, ngx_events_module) == NULL) {
         ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
@@ -440,6 +464,15 @@ ngx_event_init_conf(ngx_cycle_t *cycle, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+    ecf = ngx_event_get_conf(cycle->conf_ctx, ngx_event_core_module);
+
+    if (ecf->reuseport_cpu_affinity && ccf->cpu_affinity == NULL) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "\"reuseport_cpu_affinity\" is ignored "
+                      "without \"worker_cpu_affinity\"");
+    }
+
 #if (NGX_HAVE_REUSEPORT)
 
     if (!ngx_test_config) {
@@ -536,13 +569,14 @@ ngx_event_module_init(ngx_cycle_t *cycle)
 
 #if (NGX_STAT_STUB)
 
-    size += cl           /* ngx_stat_accepted */
-           + cl          /* ngx_stat_handled */
-           + cl          /* ngx_stat_requests */
-           + cl          /* ngx_stat_active */
-           + cl          /* ngx_stat_reading */
-           + cl          /* ngx_stat_writing */
-           + cl;         /* ngx_stat_waiting */
+    /*
+     * each process updates its own cache line with the ngx_stat_* counters,
+     * the slots are summed up when the counters are read
+     */
+
+    ngx_stat_slots = ngx_max(ccf->worker_processes, ngx_ncpu);
+
+    size += ngx_stat_slots * NGX_STAT_SLOT_SIZE;
 
 #endif
 
@@ -582,13 +616,9 @@ ngx_event_module_init(ngx_cycle_t *cycle)
 
 #if (NGX_STAT_STUB)
 
-    ngx_stat_accepted = (ngx_atomic_t *) (shared + 3 * cl);
-    ngx_stat_handled = (ngx_atomic_t *) (shared + 4 * cl);
-    ngx_stat_requests = (ngx_atomic_t *) (shared + 5 * cl);
-    ngx_stat_active = (ngx_atomic_t *) (shared + 6 * cl);
-    ngx_stat_reading = (ngx_atomic_t *) (shared + 7 * cl);
-    ngx_stat_writing = (ngx_atomic_t *) (shared + 8 * cl);
-    ngx_stat_waiting = (ngx_atomic_t *) (shared + 9 * cl);
+    ngx_stat_shared = shared + 3 * cl;
+
+    ngx_event_stat_set_slot(0);
 
 #endif
 
@@ -596,6 +626,52 @@ ngx_event_module_init(ngx_cycle_t *cycle)
 }
 
 
+#if (NGX_STAT_STUB)
+
+static void
+ngx_event_stat_set_slot(ngx_uint_t slot)
+{
+    ngx_atomic_t  *stat;
+
+    ngx_stat_slot = slot;
+
+    stat = (ngx_atomic_t *) (ngx_stat_shared + slot * NGX_STAT_SLOT_SIZE);
+
+    ngx_stat_accepted = &stat[0];
+    ngx_stat_handled = &stat[1];
+    ngx_stat_requests = &stat[2];
+    ngx_stat_active = &stat[3];
+    ngx_stat_reading = &stat[4];
+    ngx_stat_writing = &stat[5];
+    ngx_stat_waiting = &stat[6];
+}
+
+
+ngx_atomic_int_t
+ngx_event_stat(ngx_atomic_t *stat)
+{
+    u_char            *p;
+    ngx_uint_t         i;
+    ngx_atomic_int_t   value;
+
+    if (ngx_stat_shared == NULL) {
+        return *stat;
+    }
+
+    p = (u_char *) stat - ngx_stat_slot * NGX_STAT_SLOT_SIZE;
+
+    value = 0;
+
+    for (i = 0; i < ngx_stat_slots; i++) {
+        value += *(ngx_atomic_t *) (p + i * NGX_STAT_SLOT_SIZE);
+    }
+
+    return value;
+}
+
+#endif
+
+
 #if !(NGX_WIN32)
 
 static void
@@ -634,6 +710,14 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         ngx_use_accept_mutex = 0;
     }
 
+#if (NGX_STAT_STUB)
+
+    if (ngx_stat_shared) {
+        ngx_event_stat_set_slot(ngx_worker % ngx_stat_slots);
+    }
+
+#endif
+
 #if (NGX_WIN32)
 
     /*
@@ -787,6 +871,12 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         if (ls[i].reuseport && ls[i].worker != ngx_worker) {
             continue;
         }
+
+#if (NGX_HAVE_INCOMING_CPU && NGX_HAVE_CPU_AFFINITY)
+        if (ls[i].reuseport && ecf->reuseport_cpu_affinity) {
+            ngx_event_set_incoming_cpu(cycle, &ls[i]);
+        }
+#endif
 #endif
 
         c = ngx_get_connection(ls[i].fd, cycle->log);
@@ -917,6 +1007,54 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 }
 
 
+#if (NGX_HAVE_REUSEPORT && NGX_HAVE_INCOMING_CPU && NGX_HAVE_CPU_AFFINITY)
+
+/*
+ * SO_INCOMING_CPU makes the kernel to prefer the socket of the reuseport
+ * group that is bound to the CPU which received the packet, so connections
+ * are accepted and processed on the CPU where the RX softirq was handled;
+ * the first CPU from the worker's affinity mask is used
+ */
+
+static void
+ngx_event_set_incoming_cpu(ngx_cycle_t *cycle, ngx_listening_t *ls)
+{
+    int            cpu;
+    ngx_cpuset_t  *mask;
+
+    mask = ngx_get_cpu_affinity(ngx_worker);
+
+    if (mask == NULL) {
+        return;
+    }
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, mask)) {
+            break;
+        }
+    }
+
+    if (cpu == CPU_SETSIZE) {
+        return;
+    }
+
+    if (setsockopt(ls->fd, SOL_SOCKET, SO_INCOMING_CPU,
+                   (const void *) &cpu, sizeof(int))
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                      "setsockopt(SO_INCOMING_CPU, %d) for %V failed, "
+                      "ignored", cpu, &ls->addr_text);
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "incoming cpu %d for %V", cpu, &ls->addr_text);
+}
+
+#endif
+
+
 ngx_int_t
 ngx_send_lowat(ngx_connection_t *c, size_t lowat)
 {
@@ -1119,6 +1257,48 @@ ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_event_multi_accept(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_event_conf_t  *ecf = conf;
+
+    ngx_int_t   n;
+    ngx_str_t  *value;
+
+    if (ecf->multi_accept != NGX_CONF_UNSET) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcasecmp(value[1].data, (u_char *) "on") == 0) {
+        ecf->multi_accept = NGX_MAX_INT32_VALUE;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcasecmp(value[1].data, (u_char *) "off") == 0) {
+        ecf->multi_accept = 0;
+        return NGX_CONF_OK;
+    }
+
+    /* the number limits connections accepted on a single event */
+
+    n = ngx_atoi(value[1].data, value[1].len);
+
+    if (n == NGX_ERROR || n == 0 || n > NGX_MAX_INT32_VALUE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\" in \"%V\" directive, "
+                           "it must be \"on\", \"off\", or a number",
+                           &value[1], &cmd->name);
+        return NGX_CONF_ERROR;
+    }
+
+    ecf->multi_accept = n;
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -1237,6 +1417,7 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle)
     ecf->use = NGX_CONF_UNSET_UINT;
     ecf->multi_accept = NGX_CONF_UNSET;
     ecf->accept_mutex = NGX_CONF_UNSET;
+    ecf->reuseport_cpu_affinity = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
     ecf->name = (void *) NGX_CONF_UNSET;
 
@@ -1336,6 +1517,7 @@ ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf)
 
     ngx_conf_init_value(ecf->multi_accept, 0);
     ngx_conf_init_value(ecf->accept_mutex, 0);
+    ngx_conf_init_value(ecf->reuseport_cpu_affinity, 0);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
 
     return NGX_CONF_OK;
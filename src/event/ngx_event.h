@@ -258,7 +258,7 @@ extern ngx_uint_t            ngx_use_epoll_rdhup;
 
 /*
  * All event filters on file descriptor are deleted after a notification:
- * Solaris 10's event ports.
+ * Solaris 10's event ports, Linux io_uring.
  */
 #define NGX_USE_EVENTPORT_EVENT  0x00001000
 
@@ -430,8 +430,9 @@ typedef struct {
     ngx_uint_t    connections;
     ngx_uint_t    use;
 
-    ngx_flag_t    multi_accept;
+    ngx_int_t     multi_accept;
     ngx_flag_t    accept_mutex;
+    ngx_flag_t    reuseport_cpu_affinity;
 
     ngx_msec_t    accept_mutex_delay;
 
@@ -475,6 +476,8 @@ extern ngx_atomic_t  *ngx_stat_reading;
 extern ngx_atomic_t  *ngx_stat_writing;
 extern ngx_atomic_t  *ngx_stat_waiting;
 
+ngx_atomic_int_t ngx_event_stat(ngx_atomic_t *stat);
+
 #endif
 
 
@@ -100,7 +100,9 @@ ngx_event_accept(ngx_event_t *ev)
 #endif
 
             if (err == NGX_ECONNABORTED) {
-                if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+                if ((ngx_event_flags & NGX_USE_KQUEUE_EVENT)
+                    || ev->available > 0)
+                {
                     ev->available--;
                 }
 
@@ -312,7 +314,12 @@ ngx_event_accept(ngx_event_t *ev)
 
         ls->handler(c);
 
-        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+        /*
+         * kqueue reports the listen queue length, otherwise the "available"
+         * field is the number of connections still allowed by multi_accept
+         */
+
+        if ((ngx_event_flags & NGX_USE_KQUEUE_EVENT) || ev->available > 0) {
             ev->available--;
         }
 
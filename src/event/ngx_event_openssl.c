@@ -9,15 +9,46 @@
 #include <ngx_core.h>
 #include <ngx_event.h>
 
+#if (NGX_SSL_ASYNC)
+#include <ngx_thread_pool.h>
+#endif
+
 
 #define NGX_SSL_PASSWORD_BUFFER_SIZE  4096
 
+#define NGX_SSL_SESSION_CACHE_SHARDS  16
+#define NGX_SSL_SESSION_SHARD_SIZE    (1024 * 1024)
+
 
 typedef struct {
     ngx_uint_t  engine;   /* unsigned  engine:1; */
 } ngx_openssl_conf_t;
 
 
+#if (NGX_SSL_ASYNC)
+
+#define NGX_SSL_ASYNC_RSA_ENC     1
+#define NGX_SSL_ASYNC_RSA_DEC     2
+#define NGX_SSL_ASYNC_ECDSA_SIGN  3
+
+
+typedef struct {
+    ngx_uint_t                  op;
+    int                         type;
+    int                         flen;
+    int                         ret;
+    unsigned int                siglen;
+    u_char                     *from;
+    u_char                     *to;
+    void                       *key;
+    ngx_connection_t           *connection;
+    ngx_thread_pool_t          *thread_pool;
+    ngx_uint_t                  done;
+} ngx_ssl_async_ctx_t;
+
+#endif
+
+
 static X509 *ngx_ssl_load_certificate(ngx_pool_t *pool, char **err,
     ngx_str_t *cert, STACK_OF(X509) **chain);
 static EVP_PKEY *ngx_ssl_load_certificate_key(ngx_pool_t *pool, char **err,
@@ -55,6 +86,32 @@ static void ngx_ssl_connection_error(ngx_connection_t *c, int sslerr,
     ngx_err_t err, char *text);
 static void ngx_ssl_clear_error(ngx_log_t *log);
 
+#if (NGX_SSL_ASYNC)
+static ngx_int_t ngx_ssl_async_init_methods(ngx_log_t *log);
+static EVP_PKEY *ngx_ssl_async_key(EVP_PKEY *pkey, ngx_log_t *log);
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+static ngx_int_t ngx_ssl_async_disable_rsa_kx(ngx_ssl_t *ssl);
+#endif
+static int ngx_ssl_async_rsa_priv_enc(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding);
+static int ngx_ssl_async_rsa_priv_dec(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding);
+static int ngx_ssl_async_rsa(ngx_uint_t op, int flen,
+    const unsigned char *from, unsigned char *to, RSA *rsa, int padding);
+static int ngx_ssl_async_rsa_call(ngx_uint_t op, int flen,
+    const unsigned char *from, unsigned char *to, RSA *rsa, int padding);
+#ifndef OPENSSL_NO_EC
+static int ngx_ssl_async_ecdsa_sign(int type, const unsigned char *dgst,
+    int dlen, unsigned char *sig, unsigned int *siglen, const BIGNUM *kinv,
+    const BIGNUM *r, EC_KEY *eckey);
+#endif
+static ngx_ssl_async_ctx_t *ngx_ssl_async_ctx(int flen, int tlen);
+static void ngx_ssl_async_wait(ngx_ssl_async_ctx_t *ctx);
+static void ngx_ssl_async_thread_handler(void *data, ngx_log_t *log);
+static void ngx_ssl_async_event_handler(ngx_event_t *ev);
+static ngx_int_t ngx_ssl_async_shutdown(ngx_connection_t *c);
+#endif
+
 static ngx_int_t ngx_ssl_session_id_context(ngx_ssl_t *ssl,
     ngx_str_t *sess_ctx, ngx_array_t *certificates);
 static int ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn,
@@ -65,8 +122,8 @@ static ngx_ssl_session_t *ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 #endif
     u_char *id, int len, int *copy);
 static void ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess);
-static void ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
-    ngx_slab_pool_t *shpool, ngx_uint_t n);
+static void ngx_ssl_expire_sessions(ngx_ssl_session_shard_t *shard,
+    ngx_uint_t n);
 static void ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 
@@ -74,6 +131,9 @@ static void ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
 static int ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx,
     HMAC_CTX *hctx, int enc);
+static ngx_int_t ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log);
+static ngx_int_t ngx_ssl_generate_ticket_key(
+    ngx_ssl_session_ticket_key_t *key, ngx_log_t *log);
 static void ngx_ssl_session_ticket_keys_cleanup(void *data);
 #endif
 
@@ -137,6 +197,30 @@ int  ngx_ssl_certificate_index;
 int  ngx_ssl_next_certificate_index;
 int  ngx_ssl_certificate_name_index;
 int  ngx_ssl_stapling_index;
+int  ngx_ssl_async_offload_index;
+
+
+#if (NGX_SSL_ASYNC)
+
+static ngx_connection_t  *ngx_ssl_async_connection;
+
+static RSA_METHOD        *ngx_ssl_async_rsa_method;
+
+#ifndef OPENSSL_NO_EC
+
+static EC_KEY_METHOD     *ngx_ssl_async_ec_method;
+
+static int (*ngx_ssl_ecdsa_sign)(int type, const unsigned char *dgst,
+    int dlen, unsigned char *sig, unsigned int *siglen, const BIGNUM *kinv,
+    const BIGNUM *r, EC_KEY *eckey);
+static int (*ngx_ssl_ecdsa_sign_setup)(EC_KEY *eckey, BN_CTX *ctx,
+    BIGNUM **kinv, BIGNUM **r);
+static ECDSA_SIG *(*ngx_ssl_ecdsa_sign_sig)(const unsigned char *dgst,
+    int dlen, const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey);
+
+#endif
+
+#endif
 
 
 ngx_int_t
@@ -253,6 +337,18 @@ ngx_ssl_init(ngx_log_t *log)
         return NGX_ERROR;
     }
 
+#if (NGX_SSL_ASYNC)
+
+    ngx_ssl_async_offload_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL,
+                                                           NULL);
+    if (ngx_ssl_async_offload_index == -1) {
+        ngx_ssl_error(NGX_LOG_ALERT, log, 0,
+                      "SSL_CTX_get_ex_new_index() failed");
+        return NGX_ERROR;
+    }
+
+#endif
+
     return NGX_OK;
 }
 
@@ -1505,81 +1601,660 @@ ngx_ssl_early_data(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_uint_t enable)
                   "ignored");
 #endif
 
-    return NGX_OK;
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_ssl_conf_commands(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *commands)
+{
+    if (commands == NULL) {
+        return NGX_OK;
+    }
+
+#ifdef SSL_CONF_FLAG_FILE
+    {
+    int            type;
+    u_char        *key, *value;
+    ngx_uint_t     i;
+    ngx_keyval_t  *cmd;
+    SSL_CONF_CTX  *cctx;
+
+    cctx = SSL_CONF_CTX_new();
+    if (cctx == NULL) {
+        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "SSL_CONF_CTX_new() failed");
+        return NGX_ERROR;
+    }
+
+    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_FILE);
+    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_SERVER);
+    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_CLIENT);
+    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_CERTIFICATE);
+    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_SHOW_ERRORS);
+
+    SSL_CONF_CTX_set_ssl_ctx(cctx, ssl->ctx);
+
+    cmd = commands->elts;
+    for (i = 0; i < commands->nelts; i++) {
+
+        key = cmd[i].key.data;
+        type = SSL_CONF_cmd_value_type(cctx, (char *) key);
+
+        if (type == SSL_CONF_TYPE_FILE || type == SSL_CONF_TYPE_DIR) {
+            if (ngx_conf_full_name(cf->cycle, &cmd[i].value, 1) != NGX_OK) {
+                SSL_CONF_CTX_free(cctx);
+                return NGX_ERROR;
+            }
+        }
+
+        value = cmd[i].value.data;
+
+        if (SSL_CONF_cmd(cctx, (char *) key, (char *) value) <= 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "SSL_CONF_cmd(\"%s\", \"%s\") failed", key, value);
+            SSL_CONF_CTX_free(cctx);
+            return NGX_ERROR;
+        }
+    }
+
+    if (SSL_CONF_CTX_finish(cctx) != 1) {
+        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "SSL_CONF_finish() failed");
+        SSL_CONF_CTX_free(cctx);
+        return NGX_ERROR;
+    }
+
+    SSL_CONF_CTX_free(cctx);
+
+    return NGX_OK;
+    }
+#else
+    ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                  "SSL_CONF_cmd() is not available on this platform");
+    return NGX_ERROR;
+#endif
+}
+
+
+ngx_int_t
+ngx_ssl_async_offload(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_thread_pool_t *tp)
+{
+#if (NGX_SSL_ASYNC)
+
+    int         rc;
+    EVP_PKEY   *pkey, *key;
+    ngx_uint_t  rsa;
+
+    if (ngx_ssl_async_init_methods(ssl->log) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    /*
+     * private keys of the configured certificates are replaced with
+     * copies which use key methods offloading private key operations
+     * to the thread pool; certificates loaded dynamically are not
+     * affected
+     */
+
+    rsa = 0;
+
+    for (rc = SSL_CTX_set_current_cert(ssl->ctx, SSL_CERT_SET_FIRST);
+         rc;
+         rc = SSL_CTX_set_current_cert(ssl->ctx, SSL_CERT_SET_NEXT))
+    {
+        pkey = SSL_CTX_get0_privatekey(ssl->ctx);
+        if (pkey == NULL) {
+            continue;
+        }
+
+        key = ngx_ssl_async_key(pkey, ssl->log);
+        if (key == NULL) {
+            return NGX_ERROR;
+        }
+
+        if (key == pkey) {
+            continue;
+        }
+
+        if (EVP_PKEY_base_id(key) == EVP_PKEY_RSA) {
+            rsa = 1;
+        }
+
+        if (SSL_CTX_use_PrivateKey(ssl->ctx, key) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                          "SSL_CTX_use_PrivateKey() failed");
+            EVP_PKEY_free(key);
+            return NGX_ERROR;
+        }
+
+        EVP_PKEY_free(key);
+    }
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+
+    if (rsa && ngx_ssl_async_disable_rsa_kx(ssl) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+#else
+
+    (void) rsa;
+
+#endif
+
+    if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_async_offload_index, tp) == 0) {
+        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "SSL_CTX_set_ex_data() failed");
+        return NGX_ERROR;
+    }
+
+    SSL_CTX_set_mode(ssl->ctx, SSL_MODE_ASYNC);
+
+    return NGX_OK;
+
+#else
+
+    ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                  "asynchronous private key operations "
+                  "are not supported on this platform");
+    return NGX_ERROR;
+
+#endif
+}
+
+
+#if (NGX_SSL_ASYNC)
+
+static ngx_int_t
+ngx_ssl_async_init_methods(ngx_log_t *log)
+{
+    if (ngx_ssl_async_rsa_method) {
+        return NGX_OK;
+    }
+
+    ngx_ssl_async_rsa_method = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+    if (ngx_ssl_async_rsa_method == NULL) {
+        ngx_ssl_error(NGX_LOG_EMERG, log, 0, "RSA_meth_dup() failed");
+        return NGX_ERROR;
+    }
+
+    if (RSA_meth_set_priv_enc(ngx_ssl_async_rsa_method,
+                              ngx_ssl_async_rsa_priv_enc)
+        == 0
+        || RSA_meth_set_priv_dec(ngx_ssl_async_rsa_method,
+                                 ngx_ssl_async_rsa_priv_dec)
+           == 0)
+    {
+        ngx_ssl_error(NGX_LOG_EMERG, log, 0, "RSA_meth_set() failed");
+        return NGX_ERROR;
+    }
+
+#ifndef OPENSSL_NO_EC
+
+    ngx_ssl_async_ec_method = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+    if (ngx_ssl_async_ec_method == NULL) {
+        ngx_ssl_error(NGX_LOG_EMERG, log, 0, "EC_KEY_METHOD_new() failed");
+        return NGX_ERROR;
+    }
+
+    EC_KEY_METHOD_get_sign(EC_KEY_OpenSSL(), &ngx_ssl_ecdsa_sign,
+                           &ngx_ssl_ecdsa_sign_setup, &ngx_ssl_ecdsa_sign_sig);
+
+    EC_KEY_METHOD_set_sign(ngx_ssl_async_ec_method, ngx_ssl_async_ecdsa_sign,
+                           ngx_ssl_ecdsa_sign_setup, ngx_ssl_ecdsa_sign_sig);
+
+#endif
+
+    return NGX_OK;
+}
+
+
+static EVP_PKEY *
+ngx_ssl_async_key(EVP_PKEY *pkey, ngx_log_t *log)
+{
+    RSA       *rsa;
+    EVP_PKEY  *key;
+#ifndef OPENSSL_NO_EC
+    EC_KEY    *eckey;
+#endif
+
+    switch (EVP_PKEY_base_id(pkey)) {
+
+    case EVP_PKEY_RSA:
+
+        rsa = RSAPrivateKey_dup(EVP_PKEY_get0_RSA(pkey));
+        if (rsa == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0, "RSAPrivateKey_dup() failed");
+            return NULL;
+        }
+
+        if (RSA_set_method(rsa, ngx_ssl_async_rsa_method) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0, "RSA_set_method() failed");
+            RSA_free(rsa);
+            return NULL;
+        }
+
+        key = EVP_PKEY_new();
+        if (key == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0, "EVP_PKEY_new() failed");
+            RSA_free(rsa);
+            return NULL;
+        }
+
+        if (EVP_PKEY_assign_RSA(key, rsa) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0,
+                          "EVP_PKEY_assign_RSA() failed");
+            RSA_free(rsa);
+            EVP_PKEY_free(key);
+            return NULL;
+        }
+
+        return key;
+
+#ifndef OPENSSL_NO_EC
+
+    case EVP_PKEY_EC:
+
+        eckey = EC_KEY_dup(EVP_PKEY_get0_EC_KEY(pkey));
+        if (eckey == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0, "EC_KEY_dup() failed");
+            return NULL;
+        }
+
+        if (EC_KEY_set_method(eckey, ngx_ssl_async_ec_method) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0, "EC_KEY_set_method() failed");
+            EC_KEY_free(eckey);
+            return NULL;
+        }
+
+        key = EVP_PKEY_new();
+        if (key == NULL) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0, "EVP_PKEY_new() failed");
+            EC_KEY_free(eckey);
+            return NULL;
+        }
+
+        if (EVP_PKEY_assign_EC_KEY(key, eckey) == 0) {
+            ngx_ssl_error(NGX_LOG_EMERG, log, 0,
+                          "EVP_PKEY_assign_EC_KEY() failed");
+            EC_KEY_free(eckey);
+            EVP_PKEY_free(key);
+            return NULL;
+        }
+
+        return key;
+
+#endif
+
+    default:
+
+        /* other key types are used synchronously */
+
+        return pkey;
+    }
+}
+
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+
+static ngx_int_t
+ngx_ssl_async_disable_rsa_kx(ngx_ssl_t *ssl)
+{
+    int                    i, n;
+    u_char                *p, *list;
+    size_t                 len;
+    const char            *name;
+    const SSL_CIPHER      *cipher;
+    STACK_OF(SSL_CIPHER)  *ciphers;
+
+    /*
+     * since OpenSSL 3.0, decryption of the RSA key exchange premaster
+     * secret is not available for keys with a custom RSA method, so
+     * the RSA key exchange ciphers are disabled
+     */
+
+    ciphers = SSL_CTX_get_ciphers(ssl->ctx);
+    if (ciphers == NULL) {
+        return NGX_OK;
+    }
+
+    n = sk_SSL_CIPHER_num(ciphers);
+    len = 1;
+
+    for (i = 0; i < n; i++) {
+        cipher = sk_SSL_CIPHER_value(ciphers, i);
+        len += ngx_strlen(SSL_CIPHER_get_name(cipher)) + 1;
+    }
+
+    list = ngx_alloc(len, ssl->log);
+    if (list == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = list;
+
+    for (i = 0; i < n; i++) {
+        cipher = sk_SSL_CIPHER_value(ciphers, i);
+
+        if (SSL_CIPHER_get_kx_nid(cipher) == NID_kx_rsa) {
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ssl->log, 0,
+                           "ssl async offload disables cipher \"%s\"",
+                           SSL_CIPHER_get_name(cipher));
+            continue;
+        }
+
+        /* TLSv1.3 ciphersuites are configured separately */
+
+        if (SSL_CIPHER_get_kx_nid(cipher) == NID_kx_any) {
+            continue;
+        }
+
+        name = SSL_CIPHER_get_name(cipher);
+
+        if (p != list) {
+            *p++ = ':';
+        }
+
+        p = ngx_cpymem(p, name, ngx_strlen(name));
+    }
+
+    *p = '\0';
+
+    if (p != list && SSL_CTX_set_cipher_list(ssl->ctx, (char *) list) == 0) {
+        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "SSL_CTX_set_cipher_list(\"%s\") failed", list);
+        ngx_free(list);
+        return NGX_ERROR;
+    }
+
+    ngx_free(list);
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static int
+ngx_ssl_async_rsa_priv_enc(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding)
+{
+    return ngx_ssl_async_rsa(NGX_SSL_ASYNC_RSA_ENC, flen, from, to, rsa,
+                             padding);
+}
+
+
+static int
+ngx_ssl_async_rsa_priv_dec(int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding)
+{
+    return ngx_ssl_async_rsa(NGX_SSL_ASYNC_RSA_DEC, flen, from, to, rsa,
+                             padding);
+}
+
+
+static int
+ngx_ssl_async_rsa(ngx_uint_t op, int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding)
+{
+    ngx_ssl_async_ctx_t  *ctx;
+
+    ctx = ngx_ssl_async_ctx(flen, RSA_size(rsa));
+
+    if (ctx == NULL) {
+        return ngx_ssl_async_rsa_call(op, flen, from, to, rsa, padding);
+    }
+
+    ctx->op = op;
+    ctx->type = padding;
+    ctx->key = rsa;
+    ngx_memcpy(ctx->from, from, flen);
+
+    ngx_ssl_async_wait(ctx);
+
+    if (ctx->ret > 0) {
+        ngx_memcpy(to, ctx->to, ctx->ret);
+    }
+
+    return ctx->ret;
+}
+
+
+static int
+ngx_ssl_async_rsa_call(ngx_uint_t op, int flen, const unsigned char *from,
+    unsigned char *to, RSA *rsa, int padding)
+{
+    const RSA_METHOD  *meth;
+
+    meth = RSA_PKCS1_OpenSSL();
+
+    if (op == NGX_SSL_ASYNC_RSA_ENC) {
+        return RSA_meth_get_priv_enc(meth)(flen, from, to, rsa, padding);
+    }
+
+    return RSA_meth_get_priv_dec(meth)(flen, from, to, rsa, padding);
+}
+
+
+#ifndef OPENSSL_NO_EC
+
+static int
+ngx_ssl_async_ecdsa_sign(int type, const unsigned char *dgst, int dlen,
+    unsigned char *sig, unsigned int *siglen, const BIGNUM *kinv,
+    const BIGNUM *r, EC_KEY *eckey)
+{
+    ngx_ssl_async_ctx_t  *ctx;
+
+    if (kinv || r) {
+        ctx = NULL;
+
+    } else {
+        ctx = ngx_ssl_async_ctx(dlen, ECDSA_size(eckey));
+    }
+
+    if (ctx == NULL) {
+        return ngx_ssl_ecdsa_sign(type, dgst, dlen, sig, siglen, kinv, r,
+                                  eckey);
+    }
+
+    ctx->op = NGX_SSL_ASYNC_ECDSA_SIGN;
+    ctx->type = type;
+    ctx->key = eckey;
+    ngx_memcpy(ctx->from, dgst, dlen);
+
+    ngx_ssl_async_wait(ctx);
+
+    if (ctx->ret == 1) {
+        ngx_memcpy(sig, ctx->to, ctx->siglen);
+        *siglen = ctx->siglen;
+    }
+
+    return ctx->ret;
+}
+
+#endif
+
+
+static ngx_ssl_async_ctx_t *
+ngx_ssl_async_ctx(int flen, int tlen)
+{
+    ngx_connection_t     *c;
+    ngx_thread_pool_t    *tp;
+    ngx_thread_task_t    *task;
+    ngx_ssl_async_ctx_t  *ctx;
+
+    c = ngx_ssl_async_connection;
+
+    if (c == NULL || flen < 0 || tlen <= 0
+        || ASYNC_get_current_job() == NULL)
+    {
+        return NULL;
+    }
+
+    tp = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(c->ssl->connection),
+                             ngx_ssl_async_offload_index);
+    if (tp == NULL) {
+        return NULL;
+    }
+
+    task = c->ssl->async_task;
+
+    if (task == NULL) {
+        task = ngx_thread_task_alloc(c->pool, sizeof(ngx_ssl_async_ctx_t));
+        if (task == NULL) {
+            return NULL;
+        }
+
+        task->handler = ngx_ssl_async_thread_handler;
+
+        c->ssl->async_task = task;
+
+    } else if (task->event.active) {
+
+        /* the previous operation was not yet reported as complete */
+
+        return NULL;
+    }
+
+    ctx = task->ctx;
+
+    ctx->from = ngx_pnalloc(c->pool, flen);
+    if (ctx->from == NULL) {
+        return NULL;
+    }
+
+    ctx->to = ngx_pnalloc(c->pool, tlen);
+    if (ctx->to == NULL) {
+        return NULL;
+    }
+
+    ctx->flen = flen;
+    ctx->ret = -1;
+    ctx->done = 0;
+    ctx->connection = c;
+    ctx->thread_pool = tp;
+
+    return ctx;
+}
+
+
+static void
+ngx_ssl_async_wait(ngx_ssl_async_ctx_t *ctx)
+{
+    ngx_connection_t   *c;
+    ngx_thread_task_t  *task;
+
+    c = ctx->connection;
+    task = c->ssl->async_task;
+
+    task->event.data = c;
+    task->event.handler = ngx_ssl_async_event_handler;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "ssl async offload: %ui", ctx->op);
+
+    if (ngx_thread_task_post(ctx->thread_pool, task) != NGX_OK) {
+        ngx_ssl_async_thread_handler(ctx, c->log);
+        return;
+    }
+
+    /*
+     * the job is paused and SSL_do_handshake() returns SSL_ERROR_WANT_ASYNC;
+     * the job is resumed by the next SSL_do_handshake() call, which may
+     * also happen due to an unrelated event before the operation is done
+     */
+
+    while (!ctx->done) {
+        (void) ASYNC_pause_job();
+    }
+
+    ngx_memory_barrier();
+}
+
+
+static void
+ngx_ssl_async_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_ssl_async_ctx_t *ctx = data;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, log, 0,
+                   "ssl async thread: %ui", ctx->op);
+
+    switch (ctx->op) {
+
+    case NGX_SSL_ASYNC_RSA_ENC:
+    case NGX_SSL_ASYNC_RSA_DEC:
+        ctx->ret = ngx_ssl_async_rsa_call(ctx->op, ctx->flen, ctx->from,
+                                          ctx->to, ctx->key, ctx->type);
+        break;
+
+#ifndef OPENSSL_NO_EC
+
+    case NGX_SSL_ASYNC_ECDSA_SIGN:
+        ctx->ret = ngx_ssl_ecdsa_sign(ctx->type, ctx->from, ctx->flen,
+                                      ctx->to, &ctx->siglen, NULL, NULL,
+                                      ctx->key);
+        break;
+
+#endif
+    }
+
+    ngx_memory_barrier();
+
+    ctx->done = 1;
 }
 
 
-ngx_int_t
-ngx_ssl_conf_commands(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *commands)
+static void
+ngx_ssl_async_event_handler(ngx_event_t *ev)
 {
-    if (commands == NULL) {
-        return NGX_OK;
-    }
+    ngx_connection_t  *c;
 
-#ifdef SSL_CONF_FLAG_FILE
-    {
-    int            type;
-    u_char        *key, *value;
-    ngx_uint_t     i;
-    ngx_keyval_t  *cmd;
-    SSL_CONF_CTX  *cctx;
+    c = ev->data;
 
-    cctx = SSL_CONF_CTX_new();
-    if (cctx == NULL) {
-        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
-                      "SSL_CONF_CTX_new() failed");
-        return NGX_ERROR;
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0, "ssl async event");
+
+    if (c->ssl && SSL_waiting_for_async(c->ssl->connection)) {
+        ngx_post_event(c->read, &ngx_posted_events);
     }
+}
 
-    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_FILE);
-    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_SERVER);
-    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_CLIENT);
-    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_CERTIFICATE);
-    SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_SHOW_ERRORS);
 
-    SSL_CONF_CTX_set_ssl_ctx(cctx, ssl->ctx);
+static ngx_int_t
+ngx_ssl_async_shutdown(ngx_connection_t *c)
+{
+    ngx_thread_task_t  *task;
 
-    cmd = commands->elts;
-    for (i = 0; i < commands->nelts; i++) {
+    /*
+     * the connection cannot be freed while a thread uses the operation
+     * context, and a paused job has to be completed before SSL_free()
+     */
 
-        key = cmd[i].key.data;
-        type = SSL_CONF_cmd_value_type(cctx, (char *) key);
+    task = c->ssl->async_task;
 
-        if (type == SSL_CONF_TYPE_FILE || type == SSL_CONF_TYPE_DIR) {
-            if (ngx_conf_full_name(cf->cycle, &cmd[i].value, 1) != NGX_OK) {
-                SSL_CONF_CTX_free(cctx);
-                return NGX_ERROR;
-            }
-        }
+    for ( ;; ) {
 
-        value = cmd[i].value.data;
+        if (task->event.active) {
+            return NGX_AGAIN;
+        }
 
-        if (SSL_CONF_cmd(cctx, (char *) key, (char *) value) <= 0) {
-            ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
-                          "SSL_CONF_cmd(\"%s\", \"%s\") failed", key, value);
-            SSL_CONF_CTX_free(cctx);
-            return NGX_ERROR;
+        if (!SSL_waiting_for_async(c->ssl->connection)) {
+            return NGX_OK;
         }
-    }
 
-    if (SSL_CONF_CTX_finish(cctx) != 1) {
-        ngx_ssl_error(NGX_LOG_EMERG, ssl->log, 0,
-                      "SSL_CONF_finish() failed");
-        SSL_CONF_CTX_free(cctx);
-        return NGX_ERROR;
-    }
+        ngx_ssl_async_connection = c;
 
-    SSL_CONF_CTX_free(cctx);
+        (void) SSL_do_handshake(c->ssl->connection);
 
-    return NGX_OK;
+        ngx_ssl_async_connection = NULL;
+
+        ngx_ssl_clear_error(c->log);
     }
-#else
-    ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
-                  "SSL_CONF_cmd() is not available on this platform");
-    return NGX_ERROR;
-#endif
 }
 
+#endif
+
 
 ngx_int_t
 ngx_ssl_client_session_cache(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_uint_t enable)
@@ -1730,12 +2405,24 @@ ngx_ssl_handshake(ngx_connection_t *c)
 
     ngx_ssl_clear_error(c->log);
 
+#if (NGX_SSL_ASYNC)
+    ngx_ssl_async_connection = c;
+#endif
+
     n = SSL_do_handshake(c->ssl->connection);
 
+#if (NGX_SSL_ASYNC)
+    ngx_ssl_async_connection = NULL;
+#endif
+
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_do_handshake: %d", n);
 
     if (n == 1) {
 
+#if (NGX_SSL_ASYNC)
+        SSL_clear_mode(c->ssl->connection, SSL_MODE_ASYNC);
+#endif
+
         if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -1832,6 +2519,17 @@ ngx_ssl_handshake(ngx_connection_t *c)
         return NGX_AGAIN;
     }
 
+#if (NGX_SSL_ASYNC)
+
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        c->read->handler = ngx_ssl_handshake_handler;
+        c->write->handler = ngx_ssl_handshake_handler;
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
 
     c->ssl->no_wait_shutdown = 1;
@@ -1875,8 +2573,16 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
 
     readbytes = 0;
 
+#if (NGX_SSL_ASYNC)
+    ngx_ssl_async_connection = c;
+#endif
+
     n = SSL_read_early_data(c->ssl->connection, &buf, 1, &readbytes);
 
+#if (NGX_SSL_ASYNC)
+    ngx_ssl_async_connection = NULL;
+#endif
+
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
                    "SSL_read_early_data: %d, %uz", n, readbytes);
 
@@ -1887,6 +2593,10 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
 
     if (n == SSL_READ_EARLY_DATA_SUCCESS) {
 
+#if (NGX_SSL_ASYNC)
+        SSL_clear_mode(c->ssl->connection, SSL_MODE_ASYNC);
+#endif
+
         if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -1979,6 +2689,17 @@ ngx_ssl_try_early_data(ngx_connection_t *c)
         return NGX_AGAIN;
     }
 
+#if (NGX_SSL_ASYNC)
+
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        c->read->handler = ngx_ssl_handshake_handler;
+        c->write->handler = ngx_ssl_handshake_handler;
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
 
     c->ssl->no_wait_shutdown = 1;
@@ -3153,6 +3874,17 @@ ngx_ssl_shutdown(ngx_connection_t *c)
 
     ngx_ssl_ocsp_cleanup(c);
 
+#if (NGX_SSL_ASYNC)
+
+    if (c->ssl->async_task && ngx_ssl_async_shutdown(c) == NGX_AGAIN) {
+        c->read->handler = ngx_ssl_shutdown_handler;
+        c->write->handler = ngx_ssl_shutdown_handler;
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     if (SSL_in_init(c->ssl->connection)) {
         /*
          * OpenSSL 1.0.2f complains if SSL_shutdown() is called during
@@ -3720,8 +4452,10 @@ failed:
 ngx_int_t
 ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
-    size_t                    len;
-    ngx_slab_pool_t          *shpool;
+    size_t                    len, size;
+    ngx_uint_t                i, n;
+    ngx_slab_pool_t          *shpool, *sp;
+    ngx_ssl_session_shard_t  *shard;
     ngx_ssl_session_cache_t  *cache;
 
     if (data) {
@@ -3736,7 +4470,32 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
         return NGX_OK;
     }
 
-    cache = ngx_slab_alloc(shpool, sizeof(ngx_ssl_session_cache_t));
+    /*
+     * sessions are spread over several partitions, each with its own
+     * slab pool and mutex, to reduce lock contention between workers;
+     * a partition is allocated per megabyte of the zone, and small zones
+     * use the zone's slab pool directly
+     */
+
+#if (NGX_HAVE_ATOMIC_OPS)
+
+    n = shm_zone->shm.size / NGX_SSL_SESSION_SHARD_SIZE;
+
+    if (n > NGX_SSL_SESSION_CACHE_SHARDS) {
+        n = NGX_SSL_SESSION_CACHE_SHARDS;
+    }
+
+    if (n == 0) {
+        n = 1;
+    }
+
+#else
+    n = 1;
+#endif
+
+    len = sizeof(ngx_ssl_session_cache_t) + n * sizeof(ngx_ssl_session_shard_t);
+
+    cache = ngx_slab_calloc(shpool, len);
     if (cache == NULL) {
         return NGX_ERROR;
     }
@@ -3744,10 +4503,8 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
     shpool->data = cache;
     shm_zone->data = cache;
 
-    ngx_rbtree_init(&cache->session_rbtree, &cache->sentinel,
-                    ngx_ssl_session_rbtree_insert_value);
-
-    ngx_queue_init(&cache->expire_queue);
+    cache->nshards = n;
+    cache->shards = (ngx_ssl_session_shard_t *) &cache[1];
 
     len = sizeof(" in SSL session shared cache \"\"") + shm_zone->shm.name.len;
 
@@ -3761,6 +4518,42 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     shpool->log_nomem = 0;
 
+    size = (shpool->pfree / n) * ngx_pagesize;
+
+    for (i = 0; i < n; i++) {
+        shard = &cache->shards[i];
+
+        if (n == 1) {
+            sp = shpool;
+
+        } else {
+            sp = ngx_slab_calloc(shpool, size);
+            if (sp == NULL) {
+                return NGX_ERROR;
+            }
+
+            sp->end = (u_char *) sp + size;
+            sp->min_shift = 3;
+            sp->addr = sp;
+
+            if (ngx_shmtx_create(&sp->mutex, &sp->lock, NULL) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            ngx_slab_init(sp);
+
+            sp->log_ctx = shpool->log_ctx;
+            sp->log_nomem = 0;
+        }
+
+        shard->shpool = sp;
+
+        ngx_rbtree_init(&shard->session_rbtree, &shard->sentinel,
+                        ngx_ssl_session_rbtree_insert_value);
+
+        ngx_queue_init(&shard->expire_queue);
+    }
+
     return NGX_OK;
 }
 
@@ -3794,6 +4587,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
     ngx_connection_t         *c;
     ngx_slab_pool_t          *shpool;
     ngx_ssl_sess_id_t        *sess_id;
+    ngx_ssl_session_shard_t  *shard;
     ngx_ssl_session_cache_t  *cache;
     u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
 
@@ -3813,13 +4607,18 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
     ssl_ctx = c->ssl->session_ctx;
     shm_zone = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_cache_index);
 
+    session_id = (u_char *) SSL_SESSION_get_id(sess, &session_id_length);
+
+    hash = ngx_crc32_short(session_id, session_id_length);
+
     cache = shm_zone->data;
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    shard = &cache->shards[hash % cache->nshards];
+    shpool = shard->shpool;
 
     ngx_shmtx_lock(&shpool->mutex);
 
     /* drop one or two expired sessions */
-    ngx_ssl_expire_sessions(cache, shpool, 1);
+    ngx_ssl_expire_sessions(shard, 1);
 
     cached_sess = ngx_slab_alloc_locked(shpool, len);
 
@@ -3827,7 +4626,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
         /* drop the oldest non-expired session and try once more */
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+        ngx_ssl_expire_sessions(shard, 0);
 
         cached_sess = ngx_slab_alloc_locked(shpool, len);
 
@@ -3843,7 +4642,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
         /* drop the oldest non-expired session and try once more */
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+        ngx_ssl_expire_sessions(shard, 0);
 
         sess_id = ngx_slab_alloc_locked(shpool, sizeof(ngx_ssl_sess_id_t));
 
@@ -3852,8 +4651,6 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
         }
     }
 
-    session_id = (u_char *) SSL_SESSION_get_id(sess, &session_id_length);
-
 #if (NGX_PTR_SIZE == 8)
 
     id = sess_id->sess_id;
@@ -3866,7 +4663,7 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
         /* drop the oldest non-expired session and try once more */
 
-        ngx_ssl_expire_sessions(cache, shpool, 0);
+        ngx_ssl_expire_sessions(shard, 0);
 
         id = ngx_slab_alloc_locked(shpool, session_id_length);
 
@@ -3881,8 +4678,6 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
     ngx_memcpy(id, session_id, session_id_length);
 
-    hash = ngx_crc32_short(session_id, session_id_length);
-
     ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
                    "ssl new session: %08XD:%ud:%d",
                    hash, session_id_length, len);
@@ -3895,9 +4690,9 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
 
     sess_id->expire = ngx_time() + SSL_CTX_get_timeout(ssl_ctx);
 
-    ngx_queue_insert_head(&cache->expire_queue, &sess_id->queue);
+    ngx_queue_insert_head(&shard->expire_queue, &sess_id->queue);
 
-    ngx_rbtree_insert(&cache->session_rbtree, &sess_id->node);
+    ngx_rbtree_insert(&shard->session_rbtree, &sess_id->node);
 
     ngx_shmtx_unlock(&shpool->mutex);
 
@@ -3938,6 +4733,7 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
     ngx_rbtree_node_t        *node, *sentinel;
     ngx_ssl_session_t        *sess;
     ngx_ssl_sess_id_t        *sess_id;
+    ngx_ssl_session_shard_t  *shard;
     ngx_ssl_session_cache_t  *cache;
     u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
     ngx_connection_t         *c;
@@ -3954,15 +4750,16 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
                                    ngx_ssl_session_cache_index);
 
     cache = shm_zone->data;
+    shard = &cache->shards[hash % cache->nshards];
 
     sess = NULL;
 
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    shpool = shard->shpool;
 
     ngx_shmtx_lock(&shpool->mutex);
 
-    node = cache->session_rbtree.root;
-    sentinel = cache->session_rbtree.sentinel;
+    node = shard->session_rbtree.root;
+    sentinel = shard->session_rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -4000,7 +4797,7 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
 
             ngx_queue_remove(&sess_id->queue);
 
-            ngx_rbtree_delete(&cache->session_rbtree, node);
+            ngx_rbtree_delete(&shard->session_rbtree, node);
 
             ngx_slab_free_locked(shpool, sess_id->session);
 #if (NGX_PTR_SIZE == 4)
@@ -4044,6 +4841,7 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_slab_pool_t          *shpool;
     ngx_rbtree_node_t        *node, *sentinel;
     ngx_ssl_sess_id_t        *sess_id;
+    ngx_ssl_session_shard_t  *shard;
     ngx_ssl_session_cache_t  *cache;
 
     shm_zone = SSL_CTX_get_ex_data(ssl, ngx_ssl_session_cache_index);
@@ -4061,12 +4859,13 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                    "ssl remove session: %08XD:%ud", hash, len);
 
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    shard = &cache->shards[hash % cache->nshards];
+    shpool = shard->shpool;
 
     ngx_shmtx_lock(&shpool->mutex);
 
-    node = cache->session_rbtree.root;
-    sentinel = cache->session_rbtree.sentinel;
+    node = shard->session_rbtree.root;
+    sentinel = shard->session_rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -4090,7 +4889,7 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
 
             ngx_queue_remove(&sess_id->queue);
 
-            ngx_rbtree_delete(&cache->session_rbtree, node);
+            ngx_rbtree_delete(&shard->session_rbtree, node);
 
             ngx_slab_free_locked(shpool, sess_id->session);
 #if (NGX_PTR_SIZE == 4)
@@ -4111,22 +4910,24 @@ done:
 
 
 static void
-ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
-    ngx_slab_pool_t *shpool, ngx_uint_t n)
+ngx_ssl_expire_sessions(ngx_ssl_session_shard_t *shard, ngx_uint_t n)
 {
     time_t              now;
     ngx_queue_t        *q;
+    ngx_slab_pool_t    *shpool;
     ngx_ssl_sess_id_t  *sess_id;
 
+    shpool = shard->shpool;
+
     now = ngx_time();
 
     while (n < 3) {
 
-        if (ngx_queue_empty(&cache->expire_queue)) {
+        if (ngx_queue_empty(&shard->expire_queue)) {
             return;
         }
 
-        q = ngx_queue_last(&cache->expire_queue);
+        q = ngx_queue_last(&shard->expire_queue);
 
         sess_id = ngx_queue_data(q, ngx_ssl_sess_id_t, queue);
 
@@ -4139,7 +4940,7 @@ ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
         ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                        "expire session: %08Xi", sess_id->node.key);
 
-        ngx_rbtree_delete(&cache->session_rbtree, &sess_id->node);
+        ngx_rbtree_delete(&shard->session_rbtree, &sess_id->node);
 
         ngx_slab_free_locked(shpool, sess_id->session);
 #if (NGX_PTR_SIZE == 4)
@@ -4209,10 +5010,26 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
     ngx_ssl_session_ticket_key_t  *key;
 
     if (paths == NULL) {
-        return NGX_OK;
+
+        /*
+         * without ticket key files, keys are kept in the shared session
+         * cache and rotated automatically, see ngx_ssl_rotate_ticket_keys()
+         */
+
+        if (SSL_CTX_get_ex_data(ssl->ctx, ngx_ssl_session_cache_index)
+            == NULL)
+        {
+            return NGX_OK;
+        }
+
+#ifdef SSL_OP_NO_TICKET
+        if (SSL_CTX_get_options(ssl->ctx) & SSL_OP_NO_TICKET) {
+            return NGX_OK;
+        }
+#endif
     }
 
-    keys = ngx_array_create(cf->pool, paths->nelts,
+    keys = ngx_array_create(cf->pool, paths ? paths->nelts : 3,
                             sizeof(ngx_ssl_session_ticket_key_t));
     if (keys == NULL) {
         return NGX_ERROR;
@@ -4226,6 +5043,24 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
     cln->handler = ngx_ssl_session_ticket_keys_cleanup;
     cln->data = keys;
 
+    if (paths == NULL) {
+
+        /* placeholders for the current, previous, and next shared keys */
+
+        key = ngx_array_push_n(keys, 3);
+        if (key == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(key, 3 * sizeof(ngx_ssl_session_ticket_key_t));
+
+        key[0].shared = 1;
+        key[1].shared = 1;
+        key[2].shared = 1;
+
+        goto done;
+    }
+
     path = paths->elts;
     for (i = 0; i < paths->nelts; i++) {
 
@@ -4280,6 +5115,9 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
             goto failed;
         }
 
+        key->expire = 0;
+        key->shared = 0;
+
         if (size == 48) {
             key->size = 48;
             ngx_memcpy(key->name, buf, 16);
@@ -4301,6 +5139,8 @@ ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl, ngx_array_t *paths)
         ngx_explicit_memzero(&buf, 80);
     }
 
+done:
+
     if (SSL_CTX_set_ex_data(ssl->ctx, ngx_ssl_session_ticket_keys_index, keys)
         == 0)
     {
@@ -4358,6 +5198,10 @@ ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
     digest = EVP_sha256();
 #endif
 
+    if (ngx_ssl_rotate_ticket_keys(ssl_ctx, c->log) != NGX_OK) {
+        return -1;
+    }
+
     keys = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_ticket_keys_index);
     if (keys == NULL) {
         return -1;
@@ -4470,6 +5314,129 @@ ngx_ssl_session_ticket_key_callback(ngx_ssl_conn_t *ssl_conn,
 }
 
 
+static ngx_int_t
+ngx_ssl_rotate_ticket_keys(SSL_CTX *ssl_ctx, ngx_log_t *log)
+{
+    time_t                         now, expire;
+    ngx_array_t                   *keys;
+    ngx_shm_zone_t                *shm_zone;
+    ngx_slab_pool_t               *shpool;
+    ngx_ssl_session_cache_t       *cache;
+    ngx_ssl_session_ticket_key_t  *key, next;
+
+    keys = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_ticket_keys_index);
+    if (keys == NULL) {
+        return NGX_OK;
+    }
+
+    key = keys->elts;
+
+    if (!key[0].shared) {
+        return NGX_OK;
+    }
+
+    /*
+     * The current key is used to encrypt new tickets, the previous and
+     * the next keys are only used to decrypt them.  The current key has to
+     * be kept at least till the sessions issued with it expire, so its
+     * expiration time is moved forward on use.  When the previous key
+     * expires, it is retired, the current key becomes the previous one,
+     * the next key is promoted to the current one, and a new next key
+     * is generated.  As all workers know the next key in advance, they
+     * are able to decrypt tickets issued by a worker which has already
+     * switched to it.
+     *
+     * To avoid taking the lock on each handshake, worker's copy of keys
+     * is synchronized with the shared memory at most once per second.
+     */
+
+    now = ngx_time();
+    expire = now + SSL_CTX_get_timeout(ssl_ctx);
+
+    if (key[0].expire >= expire && key[1].expire >= now) {
+        return NGX_OK;
+    }
+
+    shm_zone = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_cache_index);
+
+    cache = shm_zone->data;
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    key = cache->ticket_keys;
+
+    if (key[0].expire == 0) {
+
+        /* the first key is also used as the previous one */
+
+        if (ngx_ssl_generate_ticket_key(&key[0], log) != NGX_OK
+            || ngx_ssl_generate_ticket_key(&key[2], log) != NGX_OK)
+        {
+            ngx_memzero(key, 3 * sizeof(ngx_ssl_session_ticket_key_t));
+            ngx_shmtx_unlock(&shpool->mutex);
+            return NGX_ERROR;
+        }
+
+        key[0].expire = expire;
+        key[1] = key[0];
+    }
+
+    if (key[1].expire < now) {
+
+        if (ngx_ssl_generate_ticket_key(&next, log) != NGX_OK) {
+            ngx_shmtx_unlock(&shpool->mutex);
+            return NGX_ERROR;
+        }
+
+        key[1] = key[0];
+        key[0] = key[2];
+        key[2] = next;
+
+        ngx_explicit_memzero(&next, sizeof(ngx_ssl_session_ticket_key_t));
+    }
+
+    if (key[0].expire < expire) {
+        key[0].expire = expire;
+    }
+
+    ngx_memcpy(keys->elts, key, 3 * sizeof(ngx_ssl_session_ticket_key_t));
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_ssl_generate_ticket_key(ngx_ssl_session_ticket_key_t *key,
+    ngx_log_t *log)
+{
+    u_char  buf[80];
+
+    if (RAND_bytes(buf, 80) != 1) {
+        ngx_ssl_error(NGX_LOG_ALERT, log, 0, "RAND_bytes() failed");
+        return NGX_ERROR;
+    }
+
+    key->size = 80;
+    key->shared = 1;
+    key->expire = 0;
+
+    ngx_memcpy(key->name, buf, 16);
+    ngx_memcpy(key->hmac_key, buf + 16, 32);
+    ngx_memcpy(key->aes_key, buf + 48, 32);
+
+    ngx_explicit_memzero(&buf, 80);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "ssl session ticket key: \"%*xs\"",
+                   (size_t) 16, key->name);
+
+    return NGX_OK;
+}
+
+
 static void
 ngx_ssl_session_ticket_keys_cleanup(void *data)
 {
@@ -32,6 +32,15 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#if (NGX_THREADS && defined SSL_MODE_ASYNC && !defined OPENSSL_NO_ASYNC)
+#define NGX_SSL_ASYNC    1
+#include <openssl/async.h>
+#include <openssl/rsa.h>
+#ifndef OPENSSL_NO_EC
+#include <openssl/ec.h>
+#endif
+#endif
+
 #define NGX_SSL_NAME     "OpenSSL"
 
 
@@ -103,6 +112,10 @@ struct ngx_ssl_connection_s {
 
     ngx_ssl_ocsp_t             *ocsp;
 
+#if (NGX_SSL_ASYNC)
+    ngx_thread_task_t          *async_task;
+#endif
+
     u_char                      early_buf;
 
     unsigned                    handshaked:1;
@@ -147,24 +160,36 @@ struct ngx_ssl_sess_id_s {
 
 
 typedef struct {
+    ngx_slab_pool_t            *shpool;
     ngx_rbtree_t                session_rbtree;
     ngx_rbtree_node_t           sentinel;
     ngx_queue_t                 expire_queue;
-} ngx_ssl_session_cache_t;
+} ngx_ssl_session_shard_t;
 
 
 #ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
 
 typedef struct {
-    size_t                      size;
     u_char                      name[16];
     u_char                      hmac_key[32];
     u_char                      aes_key[32];
+    time_t                      expire;
+    unsigned                    size:8;
+    unsigned                    shared:1;
 } ngx_ssl_session_ticket_key_t;
 
 #endif
 
 
+typedef struct {
+    ngx_uint_t                      nshards;
+    ngx_ssl_session_shard_t        *shards;
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+    ngx_ssl_session_ticket_key_t    ticket_keys[3];
+#endif
+} ngx_ssl_session_cache_t;
+
+
 #define NGX_SSL_SSLv2    0x0002
 #define NGX_SSL_SSLv3    0x0004
 #define NGX_SSL_TLSv1    0x0008
@@ -217,6 +242,8 @@ ngx_int_t ngx_ssl_early_data(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_uint_t enable);
 ngx_int_t ngx_ssl_conf_commands(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_array_t *commands);
+ngx_int_t ngx_ssl_async_offload(ngx_conf_t *cf, ngx_ssl_t *ssl,
+    ngx_thread_pool_t *tp);
 
 ngx_int_t ngx_ssl_client_session_cache(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_uint_t enable);
@@ -316,6 +343,7 @@ extern int  ngx_ssl_server_conf_index;
 extern int  ngx_ssl_session_cache_index;
 extern int  ngx_ssl_session_ticket_keys_index;
 extern int  ngx_ssl_ocsp_index;
+extern int  ngx_ssl_async_offload_index;
 extern int  ngx_ssl_certificate_index;
 extern int  ngx_ssl_next_certificate_index;
 extern int  ngx_ssl_certificate_name_index;
@@ -12,6 +12,15 @@
 
 #if !(NGX_WIN32)
 
+#if (NGX_HAVE_RECVMMSG)
+#define NGX_UDP_RECV_BATCH  16
+#else
+#define NGX_UDP_RECV_BATCH  1
+#endif
+
+#define NGX_UDP_RECV_SIZE   65535
+
+
 struct ngx_udp_connection_s {
     ngx_rbtree_node_t   node;
     ngx_connection_t   *connection;
@@ -19,6 +28,8 @@ struct ngx_udp_connection_s {
 };
 
 
+static ngx_int_t ngx_event_udp_handle_datagram(ngx_event_t *ev,
+    struct msghdr *msg, ssize_t n);
 static void ngx_close_accepted_udp_connection(ngx_connection_t *c);
 static ssize_t ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf,
     size_t size);
@@ -32,30 +43,36 @@ void
 ngx_event_recvmsg(ngx_event_t *ev)
 {
     ssize_t            n;
-    ngx_buf_t          buf;
-    ngx_log_t         *log;
     ngx_err_t          err;
-    socklen_t          socklen, local_socklen;
-    ngx_event_t       *rev, *wev;
-    struct iovec       iov[1];
-    struct msghdr      msg;
-    ngx_sockaddr_t     sa, lsa;
-    struct sockaddr   *sockaddr, *local_sockaddr;
+    ngx_uint_t         i, nmsg, vlen, failed;
+    struct iovec       iov[NGX_UDP_RECV_BATCH];
+    struct msghdr     *msg;
+    ngx_sockaddr_t     sa[NGX_UDP_RECV_BATCH];
     ngx_listening_t   *ls;
     ngx_event_conf_t  *ecf;
-    ngx_connection_t  *c, *lc;
-    static u_char      buffer[65535];
+    ngx_connection_t  *lc;
+    static u_char     *buffer[NGX_UDP_RECV_BATCH];
+
+#if (NGX_HAVE_RECVMMSG)
+    int                rc;
+    struct mmsghdr     msgs[NGX_UDP_RECV_BATCH];
+#else
+    struct msghdr      msgs[1];
+#endif
 
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
 #if (NGX_HAVE_IP_RECVDSTADDR)
-    u_char             msg_control[CMSG_SPACE(sizeof(struct in_addr))];
+    u_char             msg_control[NGX_UDP_RECV_BATCH]
+                                  [CMSG_SPACE(sizeof(struct in_addr))];
 #elif (NGX_HAVE_IP_PKTINFO)
-    u_char             msg_control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    u_char             msg_control[NGX_UDP_RECV_BATCH]
+                                  [CMSG_SPACE(sizeof(struct in_pktinfo))];
 #endif
 
 #if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
-    u_char             msg_control6[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+    u_char             msg_control6[NGX_UDP_RECV_BATCH]
+                                   [CMSG_SPACE(sizeof(struct in6_pktinfo))];
 #endif
 
 #endif
@@ -82,38 +99,109 @@ ngx_event_recvmsg(ngx_event_t *ev)
                    "recvmsg on %V, ready: %d", &ls->addr_text, ev->available);
 
     do {
-        ngx_memzero(&msg, sizeof(struct msghdr));
 
-        iov[0].iov_base = (void *) buffer;
-        iov[0].iov_len = sizeof(buffer);
+        /*
+         * with "multi_accept" datagrams are received in batches,
+         * the batch size is limited by the number of datagrams
+         * still allowed to be handled on this event
+         */
+
+        if ((ngx_event_flags & NGX_USE_KQUEUE_EVENT)
+            || ev->available >= NGX_UDP_RECV_BATCH)
+        {
+            vlen = NGX_UDP_RECV_BATCH;
+
+        } else if (ev->available > 1) {
+            vlen = ev->available;
 
-        msg.msg_name = &sa;
-        msg.msg_namelen = sizeof(ngx_sockaddr_t);
-        msg.msg_iov = iov;
-        msg.msg_iovlen = 1;
+        } else {
+            vlen = 1;
+        }
+
+        for (i = 0; i < vlen; i++) {
+
+            /*
+             * receive buffers are allocated on first use, so without
+             * "multi_accept" only one buffer is allocated
+             */
+
+            if (buffer[i] == NULL) {
+                buffer[i] = ngx_alloc(NGX_UDP_RECV_SIZE, ev->log);
+                if (buffer[i] == NULL) {
+                    break;
+                }
+            }
+
+#if (NGX_HAVE_RECVMMSG)
+            msg = &msgs[i].msg_hdr;
+#else
+            msg = &msgs[i];
+#endif
+
+            ngx_memzero(msg, sizeof(struct msghdr));
+
+            iov[i].iov_base = (void *) buffer[i];
+            iov[i].iov_len = NGX_UDP_RECV_SIZE;
+
+            msg->msg_name = &sa[i];
+            msg->msg_namelen = sizeof(ngx_sockaddr_t);
+            msg->msg_iov = &iov[i];
+            msg->msg_iovlen = 1;
 
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
-        if (ls->wildcard) {
+            if (ls->wildcard) {
 
 #if (NGX_HAVE_IP_RECVDSTADDR || NGX_HAVE_IP_PKTINFO)
-            if (ls->sockaddr->sa_family == AF_INET) {
-                msg.msg_control = &msg_control;
-                msg.msg_controllen = sizeof(msg_control);
-            }
+                if (ls->sockaddr->sa_family == AF_INET) {
+                    msg->msg_control = &msg_control[i];
+                    msg->msg_controllen = sizeof(msg_control[i]);
+                }
 #endif
 
 #if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
-            if (ls->sockaddr->sa_family == AF_INET6) {
-                msg.msg_control = &msg_control6;
-                msg.msg_controllen = sizeof(msg_control6);
+                if (ls->sockaddr->sa_family == AF_INET6) {
+                    msg->msg_control = &msg_control6[i];
+                    msg->msg_controllen = sizeof(msg_control6[i]);
+                }
+#endif
             }
+
 #endif
         }
 
-#endif
+        if (i == 0) {
+            return;
+        }
+
+        vlen = i;
 
-        n = recvmsg(lc->fd, &msg, 0);
+#if (NGX_HAVE_RECVMMSG)
+
+        rc = recvmmsg(lc->fd, msgs, vlen, 0, NULL);
+
+        if (rc == -1) {
+            err = ngx_socket_errno;
+
+            if (err == NGX_EAGAIN) {
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                               "recvmmsg() not ready");
+                return;
+            }
+
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmmsg() failed");
+
+            return;
+        }
+
+        nmsg = rc;
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "recvmmsg: %ui of %ui", nmsg, vlen);
+
+#else
+
+        n = recvmsg(lc->fd, msgs, 0);
 
         if (n == -1) {
             err = ngx_socket_errno;
@@ -129,299 +217,359 @@ ngx_event_recvmsg(ngx_event_t *ev)
             return;
         }
 
-#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
-        if (msg.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) {
-            ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
-                          "recvmsg() truncated data");
-            continue;
-        }
+        nmsg = 1;
+
 #endif
 
-        sockaddr = msg.msg_name;
-        socklen = msg.msg_namelen;
+        failed = 0;
 
-        if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
-            socklen = sizeof(ngx_sockaddr_t);
-        }
+        for (i = 0; i < nmsg; i++) {
 
-        if (socklen == 0) {
+#if (NGX_HAVE_RECVMMSG)
+            msg = &msgs[i].msg_hdr;
+            n = msgs[i].msg_len;
+#else
+            msg = &msgs[i];
+#endif
 
             /*
-             * on Linux recvmsg() returns zero msg_namelen
-             * when receiving packets from unbound AF_UNIX sockets
+             * the datagrams are already removed from the socket queue,
+             * so the rest of the batch is handled even if one fails
              */
 
-            socklen = sizeof(struct sockaddr);
-            ngx_memzero(&sa, sizeof(struct sockaddr));
-            sa.sockaddr.sa_family = ls->sockaddr->sa_family;
+            if (ngx_event_udp_handle_datagram(ev, msg, n) == NGX_ERROR) {
+                failed = 1;
+            }
+
+            if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+                ev->available -= n;
+
+            } else if (ev->available > 0) {
+                ev->available--;
+            }
+        }
+
+        if (failed) {
+            return;
+        }
+
+        if (nmsg < vlen) {
+            /* no more datagrams in the socket receive queue */
+            return;
         }
 
-        local_sockaddr = ls->sockaddr;
-        local_socklen = ls->socklen;
+    } while (ev->available);
+}
+
+
+static ngx_int_t
+ngx_event_udp_handle_datagram(ngx_event_t *ev, struct msghdr *msg, ssize_t n)
+{
+    u_char            *buffer;
+    ngx_buf_t          buf;
+    ngx_log_t         *log;
+    socklen_t          socklen, local_socklen;
+    ngx_event_t       *rev, *wev;
+    ngx_sockaddr_t     lsa;
+    struct sockaddr   *sockaddr, *local_sockaddr;
+    ngx_listening_t   *ls;
+    ngx_connection_t  *c, *lc;
+
+    lc = ev->data;
+    ls = lc->listening;
 
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+    if (msg->msg_flags & (MSG_TRUNC|MSG_CTRUNC)) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                      "recvmsg() truncated data");
+        return NGX_DECLINED;
+    }
+#endif
 
-        if (ls->wildcard) {
-            struct cmsghdr  *cmsg;
+    buffer = msg->msg_iov[0].iov_base;
 
-            ngx_memcpy(&lsa, local_sockaddr, local_socklen);
-            local_sockaddr = &lsa.sockaddr;
+    sockaddr = msg->msg_name;
+    socklen = msg->msg_namelen;
 
-            for (cmsg = CMSG_FIRSTHDR(&msg);
-                 cmsg != NULL;
-                 cmsg = CMSG_NXTHDR(&msg, cmsg))
-            {
+    if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
+        socklen = sizeof(ngx_sockaddr_t);
+    }
+
+    if (socklen == 0) {
+
+        /*
+         * on Linux recvmsg() returns zero msg_namelen
+         * when receiving packets from unbound AF_UNIX sockets
+         */
+
+        socklen = sizeof(struct sockaddr);
+        ngx_memzero(sockaddr, sizeof(struct sockaddr));
+        sockaddr->sa_family = ls->sockaddr->sa_family;
+    }
+
+    local_sockaddr = ls->sockaddr;
+    local_socklen = ls->socklen;
+
+#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+
+    if (ls->wildcard) {
+        struct cmsghdr  *cmsg;
+
+        ngx_memcpy(&lsa, local_sockaddr, local_socklen);
+        local_sockaddr = &lsa.sockaddr;
+
+        for (cmsg = CMSG_FIRSTHDR(msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR(msg, cmsg))
+        {
 
 #if (NGX_HAVE_IP_RECVDSTADDR)
 
-                if (cmsg->cmsg_level == IPPROTO_IP
-                    && cmsg->cmsg_type == IP_RECVDSTADDR
-                    && local_sockaddr->sa_family == AF_INET)
-                {
-                    struct in_addr      *addr;
-                    struct sockaddr_in  *sin;
+            if (cmsg->cmsg_level == IPPROTO_IP
+                && cmsg->cmsg_type == IP_RECVDSTADDR
+                && local_sockaddr->sa_family == AF_INET)
+            {
+                struct in_addr      *addr;
+                struct sockaddr_in  *sin;
 
-                    addr = (struct in_addr *) CMSG_DATA(cmsg);
-                    sin = (struct sockaddr_in *) local_sockaddr;
-                    sin->sin_addr = *addr;
+                addr = (struct in_addr *) CMSG_DATA(cmsg);
+                sin = (struct sockaddr_in *) local_sockaddr;
+                sin->sin_addr = *addr;
 
-                    break;
-                }
+                break;
+            }
 
 #elif (NGX_HAVE_IP_PKTINFO)
 
-                if (cmsg->cmsg_level == IPPROTO_IP
-                    && cmsg->cmsg_type == IP_PKTINFO
-                    && local_sockaddr->sa_family == AF_INET)
-                {
-                    struct in_pktinfo   *pkt;
-                    struct sockaddr_in  *sin;
+            if (cmsg->cmsg_level == IPPROTO_IP
+                && cmsg->cmsg_type == IP_PKTINFO
+                && local_sockaddr->sa_family == AF_INET)
+            {
+                struct in_pktinfo   *pkt;
+                struct sockaddr_in  *sin;
 
-                    pkt = (struct in_pktinfo *) CMSG_DATA(cmsg);
-                    sin = (struct sockaddr_in *) local_sockaddr;
-                    sin->sin_addr = pkt->ipi_addr;
+                pkt = (struct in_pktinfo *) CMSG_DATA(cmsg);
+                sin = (struct sockaddr_in *) local_sockaddr;
+                sin->sin_addr = pkt->ipi_addr;
 
-                    break;
-                }
+                break;
+            }
 
 #endif
 
 #if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
 
-                if (cmsg->cmsg_level == IPPROTO_IPV6
-                    && cmsg->cmsg_type == IPV6_PKTINFO
-                    && local_sockaddr->sa_family == AF_INET6)
-                {
-                    struct in6_pktinfo   *pkt6;
-                    struct sockaddr_in6  *sin6;
+            if (cmsg->cmsg_level == IPPROTO_IPV6
+                && cmsg->cmsg_type == IPV6_PKTINFO
+                && local_sockaddr->sa_family == AF_INET6)
+            {
+                struct in6_pktinfo   *pkt6;
+                struct sockaddr_in6  *sin6;
 
-                    pkt6 = (struct in6_pktinfo *) CMSG_DATA(cmsg);
-                    sin6 = (struct sockaddr_in6 *) local_sockaddr;
-                    sin6->sin6_addr = pkt6->ipi6_addr;
+                pkt6 = (struct in6_pktinfo *) CMSG_DATA(cmsg);
+                sin6 = (struct sockaddr_in6 *) local_sockaddr;
+                sin6->sin6_addr = pkt6->ipi6_addr;
 
-                    break;
-                }
+                break;
+            }
 
 #endif
 
-            }
         }
+    }
 
 #endif
 
-        c = ngx_lookup_udp_connection(ls, sockaddr, socklen, local_sockaddr,
-                                      local_socklen);
+    c = ngx_lookup_udp_connection(ls, sockaddr, socklen, local_sockaddr,
+                                  local_socklen);
 
-        if (c) {
+    if (c) {
 
 #if (NGX_DEBUG)
-            if (c->log->log_level & NGX_LOG_DEBUG_EVENT) {
-                ngx_log_handler_pt  handler;
+        if (c->log->log_level & NGX_LOG_DEBUG_EVENT) {
+            ngx_log_handler_pt  handler;
 
-                handler = c->log->handler;
-                c->log->handler = NULL;
+            handler = c->log->handler;
+            c->log->handler = NULL;
 
-                ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
-                               "recvmsg: fd:%d n:%z", c->fd, n);
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "recvmsg: fd:%d n:%z", c->fd, n);
 
-                c->log->handler = handler;
-            }
+            c->log->handler = handler;
+        }
 #endif
 
-            ngx_memzero(&buf, sizeof(ngx_buf_t));
+        ngx_memzero(&buf, sizeof(ngx_buf_t));
 
-            buf.pos = buffer;
-            buf.last = buffer + n;
+        buf.pos = buffer;
+        buf.last = buffer + n;
 
-            rev = c->read;
+        rev = c->read;
 
-            c->udp->buffer = &buf;
+        c->udp->buffer = &buf;
 
-            rev->ready = 1;
-            rev->active = 0;
+        rev->ready = 1;
+        rev->active = 0;
 
-            rev->handler(rev);
+        rev->handler(rev);
 
-            if (c->udp) {
-                c->udp->buffer = NULL;
-            }
+        if (c->udp) {
+            c->udp->buffer = NULL;
+        }
 
-            rev->ready = 0;
-            rev->active = 1;
+        rev->ready = 0;
+        rev->active = 1;
 
-            goto next;
-        }
+        return NGX_OK;
+    }
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
 #endif
 
-        ngx_accept_disabled = ngx_cycle->connection_n / 8
-                              - ngx_cycle->free_connection_n;
+    ngx_accept_disabled = ngx_cycle->connection_n / 8
+                          - ngx_cycle->free_connection_n;
 
-        c = ngx_get_connection(lc->fd, ev->log);
-        if (c == NULL) {
-            return;
-        }
+    c = ngx_get_connection(lc->fd, ev->log);
+    if (c == NULL) {
+        return NGX_ERROR;
+    }
 
-        c->shared = 1;
-        c->type = SOCK_DGRAM;
-        c->socklen = socklen;
+    c->shared = 1;
+    c->type = SOCK_DGRAM;
+    c->socklen = socklen;
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
 #endif
 
-        c->pool = ngx_create_pool(ls->pool_size, ev->log);
-        if (c->pool == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
-
-        c->sockaddr = ngx_palloc(c->pool, socklen);
-        if (c->sockaddr == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    c->pool = ngx_create_pool(ls->pool_size, ev->log);
+    if (c->pool == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        ngx_memcpy(c->sockaddr, sockaddr, socklen);
+    c->sockaddr = ngx_palloc(c->pool, socklen);
+    if (c->sockaddr == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        log = ngx_palloc(c->pool, sizeof(ngx_log_t));
-        if (log == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    ngx_memcpy(c->sockaddr, sockaddr, socklen);
 
-        *log = ls->log;
+    log = ngx_palloc(c->pool, sizeof(ngx_log_t));
+    if (log == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        c->recv = ngx_udp_shared_recv;
-        c->send = ngx_udp_send;
-        c->send_chain = ngx_udp_send_chain;
+    *log = ls->log;
 
-        c->log = log;
-        c->pool->log = log;
-        c->listening = ls;
+    c->recv = ngx_udp_shared_recv;
+    c->send = ngx_udp_send;
+    c->send_chain = ngx_udp_send_chain;
 
-        if (local_sockaddr == &lsa.sockaddr) {
-            local_sockaddr = ngx_palloc(c->pool, local_socklen);
-            if (local_sockaddr == NULL) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+    c->log = log;
+    c->pool->log = log;
+    c->listening = ls;
 
-            ngx_memcpy(local_sockaddr, &lsa, local_socklen);
+    if (local_sockaddr == &lsa.sockaddr) {
+        local_sockaddr = ngx_palloc(c->pool, local_socklen);
+        if (local_sockaddr == NULL) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
         }
 
-        c->local_sockaddr = local_sockaddr;
-        c->local_socklen = local_socklen;
+        ngx_memcpy(local_sockaddr, &lsa, local_socklen);
+    }
+
+    c->local_sockaddr = local_sockaddr;
+    c->local_socklen = local_socklen;
 
-        c->buffer = ngx_create_temp_buf(c->pool, n);
-        if (c->buffer == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    c->buffer = ngx_create_temp_buf(c->pool, n);
+    if (c->buffer == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
+    c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
 
-        rev = c->read;
-        wev = c->write;
+    rev = c->read;
+    wev = c->write;
 
-        rev->active = 1;
-        wev->ready = 1;
+    rev->active = 1;
+    wev->ready = 1;
 
-        rev->log = log;
-        wev->log = log;
+    rev->log = log;
+    wev->log = log;
 
-        /*
-         * TODO: MT: - ngx_atomic_fetch_add()
-         *             or protection by critical section or light mutex
-         *
-         * TODO: MP: - allocated in a shared memory
-         *           - ngx_atomic_fetch_add()
-         *             or protection by critical section or light mutex
-         */
+    /*
+     * TODO: MT: - ngx_atomic_fetch_add()
+     *             or protection by critical section or light mutex
+     *
+     * TODO: MP: - allocated in a shared memory
+     *           - ngx_atomic_fetch_add()
+     *             or protection by critical section or light mutex
+     */
 
-        c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
 
-        c->start_time = ngx_current_msec;
+    c->start_time = ngx_current_msec;
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
 #endif
 
-        if (ls->addr_ntop) {
-            c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
-            if (c->addr_text.data == NULL) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+    if (ls->addr_ntop) {
+        c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
+        if (c->addr_text.data == NULL) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
+        }
 
-            c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
-                                             c->addr_text.data,
-                                             ls->addr_text_max_len, 0);
-            if (c->addr_text.len == 0) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+        c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
+                                         c->addr_text.data,
+                                         ls->addr_text_max_len, 0);
+        if (c->addr_text.len == 0) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
         }
+    }
 
 #if (NGX_DEBUG)
-        {
-        ngx_str_t  addr;
-        u_char     text[NGX_SOCKADDR_STRLEN];
-
-        ngx_debug_accepted_connection(ecf, c);
+    {
+    ngx_str_t          addr;
+    ngx_event_conf_t  *ecf;
+    u_char             text[NGX_SOCKADDR_STRLEN];
 
-        if (log->log_level & NGX_LOG_DEBUG_EVENT) {
-            addr.data = text;
-            addr.len = ngx_sock_ntop(c->sockaddr, c->socklen, text,
-                                     NGX_SOCKADDR_STRLEN, 1);
+    ecf = ngx_event_get_conf(ngx_cycle->conf_ctx, ngx_event_core_module);
 
-            ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
-                           "*%uA recvmsg: %V fd:%d n:%z",
-                           c->number, &addr, c->fd, n);
-        }
+    ngx_debug_accepted_connection(ecf, c);
 
-        }
-#endif
+    if (log->log_level & NGX_LOG_DEBUG_EVENT) {
+        addr.data = text;
+        addr.len = ngx_sock_ntop(c->sockaddr, c->socklen, text,
+                                 NGX_SOCKADDR_STRLEN, 1);
 
-        if (ngx_insert_udp_connection(c) != NGX_OK) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+        ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
+                       "*%uA recvmsg: %V fd:%d n:%z",
+                       c->number, &addr, c->fd, n);
+    }
 
-        log->data = NULL;
-        log->handler = NULL;
+    }
+#endif
 
-        ls->handler(c);
+    if (ngx_insert_udp_connection(c) != NGX_OK) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-    next:
+    log->data = NULL;
+    log->handler = NULL;
 
-        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
-            ev->available -= n;
-        }
+    ls->handler(c);
 
-    } while (ev->available);
+    return NGX_OK;
 }
 
 
@@ -0,0 +1,2043 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_EXTENDED_STATUS_SERVER    0
+#define NGX_HTTP_EXTENDED_STATUS_LOCATION  1
+
+#define NGX_HTTP_EXTENDED_STATUS_JSON      0
+#define NGX_HTTP_EXTENDED_STATUS_PROM      1
+
+/* cache statuses from NGX_HTTP_CACHE_MISS to NGX_HTTP_CACHE_HIT */
+#define NGX_HTTP_EXTENDED_STATUS_CACHE     8
+
+#define NGX_HTTP_EXTENDED_STATUS_BUFSIZE   16384
+
+
+typedef struct {
+    ngx_uint_t                      requests;
+    ngx_uint_t                      responses[5];
+    ngx_uint_t                      discarded;
+    uint64_t                        received;
+    uint64_t                        sent;
+    ngx_histogram_t                 request_time;
+} ngx_http_extended_status_zone_stats_t;
+
+
+typedef struct {
+    ngx_uint_t                      responses[NGX_HTTP_EXTENDED_STATUS_CACHE];
+    uint64_t                        sent;
+} ngx_http_extended_status_cache_stats_t;
+
+
+typedef struct {
+    ngx_str_t                       name;
+    ngx_uint_t                      type;
+} ngx_http_extended_status_zone_t;
+
+
+typedef struct {
+    ngx_array_t                     zones;
+    ngx_array_t                     caches;    /* ngx_http_file_cache_t * */
+
+    ngx_uint_t                      enabled;   /* unsigned  enabled:1; */
+
+    /* per worker block of zone and cache statistics */
+    size_t                          size;
+
+    ngx_uint_t                      workers;
+    u_char                         *blocks;
+    u_char                         *block;
+
+    ngx_core_conf_t                *ccf;
+    ngx_shm_zone_t                 *shm_zone;
+} ngx_http_extended_status_main_conf_t;
+
+
+typedef struct {
+    ngx_uint_t                      zone;
+} ngx_http_extended_status_srv_conf_t;
+
+
+typedef struct {
+    ngx_uint_t                      zone;
+} ngx_http_extended_status_loc_conf_t;
+
+
+/* cache statistics follow the zone ones in a block */
+
+#define ngx_http_extended_status_caches(smcf, block)                          \
+    ((ngx_http_extended_status_cache_stats_t *)                               \
+         ((ngx_http_extended_status_zone_stats_t *) (block)                   \
+          + (smcf)->zones.nelts))
+
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+typedef struct {
+    ngx_str_t                       upstream;
+    ngx_str_t                       name;
+    ngx_str_t                       server;
+    ngx_uint_t                      backup;
+    ngx_uint_t                      active;
+    char                           *state;
+    ngx_http_upstream_rr_peer_stats_t  stats;
+
+    /* the whole upstream, shared by all peers of the upstream */
+    ngx_http_upstream_rr_peer_stats_t *total;
+} ngx_http_extended_status_peer_t;
+
+
+typedef struct {
+    char                           *name;
+    size_t                          offset;
+} ngx_http_extended_status_time_t;
+
+
+typedef struct {
+    char                           *label;
+    ngx_uint_t                      permille;
+} ngx_http_extended_status_quantile_t;
+
+#endif
+
+
+typedef struct {
+    ngx_http_request_t             *request;
+    ngx_http_extended_status_main_conf_t  *conf;
+
+    /* statistics of all worker processes summed up */
+    u_char                         *block;
+
+    ngx_array_t                     peers;
+
+    ngx_chain_t                    *out;
+    ngx_chain_t                   **last;
+    ngx_buf_t                      *buf;
+} ngx_http_extended_status_ctx_t;
+
+
+static ngx_int_t ngx_http_extended_status_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_extended_status_collect(
+    ngx_http_extended_status_ctx_t *ctx);
+#if (NGX_HTTP_UPSTREAM_ZONE)
+static ngx_int_t ngx_http_extended_status_collect_peers(
+    ngx_http_extended_status_ctx_t *ctx, ngx_http_upstream_srv_conf_t *uscf);
+static ngx_int_t ngx_http_extended_status_collect_peer_list(
+    ngx_http_extended_status_ctx_t *ctx, ngx_str_t *upstream,
+    ngx_http_upstream_rr_peer_stats_t *total,
+    ngx_http_upstream_rr_peers_t *peers, ngx_uint_t backup);
+#endif
+static ngx_int_t ngx_http_extended_status_json(
+    ngx_http_extended_status_ctx_t *ctx);
+#if (NGX_HTTP_UPSTREAM_ZONE)
+static ngx_int_t ngx_http_extended_status_json_times(
+    ngx_http_extended_status_ctx_t *ctx,
+    ngx_http_upstream_rr_peer_stats_t *stats);
+static ngx_int_t ngx_http_extended_status_json_peers(
+    ngx_http_extended_status_ctx_t *ctx);
+#endif
+#if (NGX_HTTP_CACHE)
+static ngx_int_t ngx_http_extended_status_json_caches(
+    ngx_http_extended_status_ctx_t *ctx);
+#endif
+static ngx_int_t ngx_http_extended_status_json_zones(
+    ngx_http_extended_status_ctx_t *ctx, ngx_uint_t type);
+static ngx_int_t ngx_http_extended_status_prometheus(
+    ngx_http_extended_status_ctx_t *ctx);
+#if (NGX_HTTP_UPSTREAM_ZONE)
+static ngx_int_t ngx_http_extended_status_prometheus_times(
+    ngx_http_extended_status_ctx_t *ctx, ngx_uint_t upstream);
+static ngx_int_t ngx_http_extended_status_prometheus_peers(
+    ngx_http_extended_status_ctx_t *ctx);
+#endif
+#if (NGX_HTTP_CACHE)
+static ngx_int_t ngx_http_extended_status_prometheus_caches(
+    ngx_http_extended_status_ctx_t *ctx);
+#endif
+static ngx_int_t ngx_http_extended_status_prometheus_zones(
+    ngx_http_extended_status_ctx_t *ctx, ngx_uint_t type);
+static ngx_int_t ngx_http_extended_status_printf(
+    ngx_http_extended_status_ctx_t *ctx, const char *fmt, ...);
+static ngx_int_t ngx_http_extended_status_escape(ngx_pool_t *pool,
+    ngx_str_t *dst, u_char *src, size_t len);
+
+static ngx_int_t ngx_http_extended_status_log_handler(ngx_http_request_t *r);
+static void ngx_http_extended_status_account(
+    ngx_http_extended_status_zone_stats_t *stats, ngx_http_request_t *r,
+    ngx_uint_t status, ngx_msec_t ms);
+
+static ngx_int_t ngx_http_extended_status_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_int_t ngx_http_extended_status_add_zone(ngx_conf_t *cf,
+    ngx_http_extended_status_main_conf_t *smcf, ngx_str_t *name,
+    ngx_uint_t type);
+
+static void *ngx_http_extended_status_create_main_conf(ngx_conf_t *cf);
+static void *ngx_http_extended_status_create_srv_conf(ngx_conf_t *cf);
+static void *ngx_http_extended_status_create_loc_conf(ngx_conf_t *cf);
+static char *ngx_http_extended_status_merge_loc_conf(ngx_conf_t *cf,
+    void *parent, void *child);
+static char *ngx_http_extended_status(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_extended_status_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static ngx_int_t ngx_http_extended_status_init(ngx_conf_t *cf);
+static ngx_int_t ngx_http_extended_status_init_worker(ngx_cycle_t *cycle);
+
+
+static ngx_command_t  ngx_http_extended_status_commands[] = {
+
+    { ngx_string("extended_status"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS,
+      ngx_http_extended_status,
+      0,
+      0,
+      NULL },
+
+    { ngx_string("status_zone"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_extended_status_zone,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_extended_status_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_extended_status_init,         /* postconfiguration */
+
+    ngx_http_extended_status_create_main_conf, /* create main conf */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_extended_status_create_srv_conf, /* create server conf */
+    NULL,                                  /* merge server configuration */
+
+    ngx_http_extended_status_create_loc_conf, /* create location conf */
+    ngx_http_extended_status_merge_loc_conf /* merge location conf */
+};
+
+
+ngx_module_t  ngx_http_extended_status_module = {
+    NGX_MODULE_V1,
+    &ngx_http_extended_status_module_ctx,  /* module context */
+    ngx_http_extended_status_commands,     /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    ngx_http_extended_status_init_worker,  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static ngx_http_extended_status_time_t  ngx_http_extended_status_times[] = {
+    { "connect",
+      offsetof(ngx_http_upstream_rr_peer_stats_t, connect_time) },
+    { "header",
+      offsetof(ngx_http_upstream_rr_peer_stats_t, header_time) },
+    { "response",
+      offsetof(ngx_http_upstream_rr_peer_stats_t, response_time) },
+    { NULL, 0 }
+};
+
+
+static ngx_http_extended_status_quantile_t
+    ngx_http_extended_status_quantiles[] = {
+    { "0.5", 500 },
+    { "0.99", 990 },
+    { "0.999", 999 },
+    { NULL, 0 }
+};
+
+#endif
+
+
+#if (NGX_HTTP_CACHE)
+
+static ngx_str_t  ngx_http_extended_status_cache_status[] = {
+    ngx_null_string,
+    ngx_string("miss"),
+    ngx_string("bypass"),
+    ngx_string("expired"),
+    ngx_string("stale"),
+    ngx_string("updating"),
+    ngx_string("revalidated"),
+    ngx_string("hit")
+};
+
+#endif
+
+
+static ngx_int_t
+ngx_http_extended_status_handler(ngx_http_request_t *r)
+{
+    ngx_int_t                              rc, format;
+    ngx_str_t                              value;
+    ngx_chain_t                           *cl;
+    ngx_http_extended_status_ctx_t        *ctx;
+    ngx_http_extended_status_main_conf_t  *smcf;
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_extended_status_module);
+
+    format = NGX_HTTP_EXTENDED_STATUS_JSON;
+
+    if (ngx_http_arg(r, (u_char *) "format", 6, &value) == NGX_OK) {
+
+        if (value.len == 10
+            && ngx_strncmp(value.data, "prometheus", 10) == 0)
+        {
+            format = NGX_HTTP_EXTENDED_STATUS_PROM;
+
+        } else if (value.len != 4 || ngx_strncmp(value.data, "json", 4) != 0) {
+            return NGX_HTTP_BAD_REQUEST;
+        }
+    }
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_extended_status_ctx_t));
+    if (ctx == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    ctx->request = r;
+    ctx->conf = smcf;
+    ctx->last = &ctx->out;
+
+    if (ngx_http_extended_status_collect(ctx) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    if (format == NGX_HTTP_EXTENDED_STATUS_PROM) {
+        ngx_str_set(&r->headers_out.content_type,
+                    "text/plain; version=0.0.4");
+        rc = ngx_http_extended_status_prometheus(ctx);
+
+    } else {
+        ngx_str_set(&r->headers_out.content_type, "application/json");
+        rc = ngx_http_extended_status_json(ctx);
+    }
+
+    if (rc != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    r->headers_out.content_type_len = r->headers_out.content_type.len;
+    r->headers_out.content_type_lowcase = NULL;
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = 0;
+
+    for (cl = ctx->out; cl; cl = cl->next) {
+        r->headers_out.content_length_n += ngx_buf_size(cl->buf);
+    }
+
+    ctx->buf->last_buf = (r == r->main) ? 1 : 0;
+    ctx->buf->last_in_chain = 1;
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, ctx->out);
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_collect(ngx_http_extended_status_ctx_t *ctx)
+{
+    u_char                                  *block;
+    ngx_uint_t                               i, j, k, nzones;
+    ngx_http_extended_status_main_conf_t    *smcf;
+    ngx_http_extended_status_zone_stats_t   *zs, *dzs;
+    ngx_http_extended_status_cache_stats_t  *cs, *dcs;
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    ngx_http_upstream_srv_conf_t           **uscfp;
+    ngx_http_upstream_main_conf_t           *umcf;
+#endif
+
+    smcf = ctx->conf;
+
+    ctx->block = ngx_pcalloc(ctx->request->pool, smcf->size);
+    if (ctx->block == NULL) {
+        return NGX_ERROR;
+    }
+
+    nzones = smcf->zones.nelts;
+
+    for (i = 0; i < smcf->workers; i++) {
+        block = smcf->blocks + i * smcf->size;
+
+        zs = (ngx_http_extended_status_zone_stats_t *) block;
+        dzs = (ngx_http_extended_status_zone_stats_t *) ctx->block;
+
+        for (j = 0; j < nzones; j++) {
+            dzs[j].requests += zs[j].requests;
+
+            for (k = 0; k < 5; k++) {
+                dzs[j].responses[k] += zs[j].responses[k];
+            }
+
+            dzs[j].discarded += zs[j].discarded;
+            dzs[j].received += zs[j].received;
+            dzs[j].sent += zs[j].sent;
+
+            ngx_histogram_merge(&dzs[j].request_time, &zs[j].request_time);
+        }
+
+        cs = ngx_http_extended_status_caches(smcf, block);
+        dcs = ngx_http_extended_status_caches(smcf, ctx->block);
+
+        for (j = 0; j < smcf->caches.nelts; j++) {
+
+            for (k = 0; k < NGX_HTTP_EXTENDED_STATUS_CACHE; k++) {
+                dcs[j].responses[k] += cs[j].responses[k];
+            }
+
+            dcs[j].sent += cs[j].sent;
+        }
+    }
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+    if (ngx_array_init(&ctx->peers, ctx->request->pool, 4,
+                       sizeof(ngx_http_extended_status_peer_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    umcf = ngx_http_get_module_main_conf(ctx->request,
+                                         ngx_http_upstream_module);
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+
+        if (uscfp[i]->shm_zone == NULL) {
+            continue;
+        }
+
+        if (ngx_http_extended_status_collect_peers(ctx, uscfp[i]) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+#endif
+
+    return NGX_OK;
+}
+
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static ngx_int_t
+ngx_http_extended_status_collect_peers(ngx_http_extended_status_ctx_t *ctx,
+    ngx_http_upstream_srv_conf_t *uscf)
+{
+    ngx_int_t                           rc;
+    ngx_str_t                           upstream;
+    ngx_http_upstream_rr_peers_t       *peers;
+    ngx_http_upstream_rr_peer_stats_t  *total;
+
+    if (ngx_http_extended_status_escape(ctx->request->pool, &upstream,
+                                        uscf->host.data, uscf->host.len)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    total = ngx_pcalloc(ctx->request->pool,
+                        sizeof(ngx_http_upstream_rr_peer_stats_t));
+    if (total == NULL) {
+        return NGX_ERROR;
+    }
+
+    peers = uscf->peer.data;
+
+    if (peers->stats) {
+        ngx_http_upstream_rr_stats_merge(total, peers->stats, peers->workers);
+    }
+
+    ngx_http_upstream_rr_peers_rlock(peers);
+
+    rc = ngx_http_extended_status_collect_peer_list(ctx, &upstream, total,
+                                                    peers, 0);
+
+    if (rc == NGX_OK && peers->next) {
+        ngx_http_upstream_rr_peers_rlock(peers->next);
+
+        rc = ngx_http_extended_status_collect_peer_list(ctx, &upstream, total,
+                                                        peers->next, 1);
+
+        ngx_http_upstream_rr_peers_unlock(peers->next);
+    }
+
+    ngx_http_upstream_rr_peers_unlock(peers);
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_collect_peer_list(
+    ngx_http_extended_status_ctx_t *ctx, ngx_str_t *upstream,
+    ngx_http_upstream_rr_peer_stats_t *total,
+    ngx_http_upstream_rr_peers_t *peers, ngx_uint_t backup)
+{
+    ngx_http_upstream_rr_peer_t      *peer;
+    ngx_http_extended_status_peer_t  *sp;
+
+    for (peer = peers->peer; peer; peer = peer->next) {
+
+        sp = ngx_array_push(&ctx->peers);
+        if (sp == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(sp, sizeof(ngx_http_extended_status_peer_t));
+
+        sp->upstream = *upstream;
+        sp->total = total;
+        sp->backup = backup;
+        sp->active = peer->conns;
+
+        if (peer->down & NGX_HTTP_UPSTREAM_RR_CHECK_DOWN) {
+            sp->state = "unhealthy";
+
+        } else if (peer->down) {
+            sp->state = "down";
+
+        } else {
+            sp->state = "up";
+        }
+
+        /* peers may be removed once the lock is released */
+
+        if (ngx_http_extended_status_escape(ctx->request->pool, &sp->name,
+                                            peer->name.data, peer->name.len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_extended_status_escape(ctx->request->pool, &sp->server,
+                                            peer->server.data,
+                                            peer->server.len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        if (peer->stats) {
+            ngx_http_upstream_rr_stats_merge(&sp->stats, peer->stats,
+                                             peers->workers);
+        }
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_extended_status_json(ngx_http_extended_status_ctx_t *ctx)
+{
+    if (ngx_http_extended_status_printf(ctx,
+            "{\"version\":\"" NGINX_VERSION "\","
+            "\"connections\":{\"accepted\":%uA,\"handled\":%uA,"
+            "\"active\":%uA,\"reading\":%uA,\"writing\":%uA,"
+            "\"waiting\":%uA},\"requests\":%uA,",
+            ngx_event_stat(ngx_stat_accepted), ngx_event_stat(ngx_stat_handled),
+            ngx_event_stat(ngx_stat_active), ngx_event_stat(ngx_stat_reading),
+            ngx_event_stat(ngx_stat_writing), ngx_event_stat(ngx_stat_waiting),
+            ngx_event_stat(ngx_stat_requests))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_extended_status_printf(ctx, "\"server_zones\":{") != NGX_OK
+        || ngx_http_extended_status_json_zones(ctx,
+                                        NGX_HTTP_EXTENDED_STATUS_SERVER)
+           != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_extended_status_printf(ctx, "},\"location_zones\":{")
+        != NGX_OK
+        || ngx_http_extended_status_json_zones(ctx,
+                                        NGX_HTTP_EXTENDED_STATUS_LOCATION)
+           != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_extended_status_printf(ctx, "},\"upstreams\":{") != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (ngx_http_extended_status_json_peers(ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+#endif
+
+    if (ngx_http_extended_status_printf(ctx, "},\"caches\":{") != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+#if (NGX_HTTP_CACHE)
+    if (ngx_http_extended_status_json_caches(ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+#endif
+
+    return ngx_http_extended_status_printf(ctx, "}}\n");
+}
+
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static ngx_int_t
+ngx_http_extended_status_json_peers(ngx_http_extended_status_ctx_t *ctx)
+{
+    ngx_uint_t                        i;
+    ngx_http_extended_status_peer_t  *sp;
+
+    sp = ctx->peers.elts;
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+
+        if (i == 0 || sp[i].upstream.data != sp[i - 1].upstream.data) {
+
+            if (i && (ngx_http_extended_status_printf(ctx, "],") != NGX_OK
+                      || ngx_http_extended_status_json_times(ctx,
+                                                             sp[i - 1].total)
+                         != NGX_OK
+                      || ngx_http_extended_status_printf(ctx, "},")
+                         != NGX_OK))
+            {
+                return NGX_ERROR;
+            }
+
+            if (ngx_http_extended_status_printf(ctx, "\"%V\":{\"peers\":[",
+                                                &sp[i].upstream)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+
+        } else if (ngx_http_extended_status_printf(ctx, ",") != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_extended_status_printf(ctx,
+                "{\"server\":\"%V\",\"name\":\"%V\",\"backup\":%s,"
+                "\"state\":\"%s\",\"active\":%ui,\"requests\":%ui,\"responses\":{"
+                "\"1xx\":%ui,\"2xx\":%ui,\"3xx\":%ui,\"4xx\":%ui,"
+                "\"5xx\":%ui},\"fails\":%ui,\"sent\":%uL,"
+                "\"received\":%uL,",
+                &sp[i].server, &sp[i].name, sp[i].backup ? "true" : "false",
+                sp[i].state, sp[i].active, sp[i].stats.requests,
+                sp[i].stats.responses[0], sp[i].stats.responses[1],
+                sp[i].stats.responses[2], sp[i].stats.responses[3],
+                sp[i].stats.responses[4], sp[i].stats.fails,
+                sp[i].stats.sent, sp[i].stats.received)
+            != NGX_OK
+            || ngx_http_extended_status_json_times(ctx, &sp[i].stats) != NGX_OK
+            || ngx_http_extended_status_printf(ctx, "}") != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ctx->peers.nelts == 0) {
+        return NGX_OK;
+    }
+
+    if (ngx_http_extended_status_printf(ctx, "],") != NGX_OK
+        || ngx_http_extended_status_json_times(ctx, sp[i - 1].total) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    return ngx_http_extended_status_printf(ctx, "}");
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_json_times(ngx_http_extended_status_ctx_t *ctx,
+    ngx_http_upstream_rr_peer_stats_t *stats)
+{
+    ngx_histogram_t                  *h;
+    ngx_http_extended_status_time_t  *t;
+
+    for (t = ngx_http_extended_status_times; t->name; t++) {
+
+        h = (ngx_histogram_t *) ((u_char *) stats + t->offset);
+
+        if (ngx_http_extended_status_printf(ctx,
+                "%s\"%s_time\":{\"count\":%uA,\"p50\":%M,\"p99\":%M,"
+                "\"p999\":%M}",
+                t == ngx_http_extended_status_times ? "" : ",", t->name,
+                h->count, ngx_histogram_quantile(h, 500),
+                ngx_histogram_quantile(h, 990),
+                ngx_histogram_quantile(h, 999))
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+#if (NGX_HTTP_CACHE)
+
+static ngx_int_t
+ngx_http_extended_status_json_caches(ngx_http_extended_status_ctx_t *ctx)
+{
+    ngx_str_t                                name;
+    ngx_uint_t                               i, k;
+    ngx_http_file_cache_t                  **cache;
+    ngx_http_extended_status_cache_stats_t  *cs;
+
+    cache = ctx->conf->caches.elts;
+    cs = ngx_http_extended_status_caches(ctx->conf, ctx->block);
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+
+        if (ngx_http_extended_status_escape(ctx->request->pool, &name,
+                                            cache[i]->shm_zone->shm.name.data,
+                                            cache[i]->shm_zone->shm.name.len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_extended_status_printf(ctx, "%s\"%V\":{",
+                                            i ? "," : "", &name)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        for (k = NGX_HTTP_CACHE_MISS; k < NGX_HTTP_EXTENDED_STATUS_CACHE; k++) {
+            if (ngx_http_extended_status_printf(ctx, "\"%V\":%ui,",
+                                &ngx_http_extended_status_cache_status[k],
+                                cs[i].responses[k])
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+
+        if (ngx_http_extended_status_printf(ctx,
+                "\"evicted\":%ui,\"evicted_bytes\":%O,"
+                "\"eviction_backlog\":%ui,\"sent\":%uL}",
+                cache[i]->sh->evicted, cache[i]->sh->evicted_size,
+                cache[i]->sh->backlog, cs[i].sent)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_extended_status_json_zones(ngx_http_extended_status_ctx_t *ctx,
+    ngx_uint_t type)
+{
+    ngx_str_t                               name;
+    ngx_uint_t                              i, n;
+    ngx_histogram_t                        *h;
+    ngx_http_extended_status_zone_t        *zone;
+    ngx_http_extended_status_zone_stats_t  *zs;
+
+    zone = ctx->conf->zones.elts;
+    zs = (ngx_http_extended_status_zone_stats_t *) ctx->block;
+
+    for (i = 0, n = 0; i < ctx->conf->zones.nelts; i++) {
+
+        if (zone[i].type != type) {
+            continue;
+        }
+
+        if (ngx_http_extended_status_escape(ctx->request->pool, &name,
+                                            zone[i].name.data,
+                                            zone[i].name.len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        h = &zs[i].request_time;
+
+        if (ngx_http_extended_status_printf(ctx,
+                "%s\"%V\":{\"requests\":%ui,\"responses\":{"
+                "\"1xx\":%ui,\"2xx\":%ui,\"3xx\":%ui,\"4xx\":%ui,"
+                "\"5xx\":%ui},\"discarded\":%ui,\"received\":%uL,"
+                "\"sent\":%uL,\"request_time\":{\"count\":%uA,\"sum\":%uA,"
+                "\"p50\":%M,\"p99\":%M,\"p999\":%M}}",
+                n++ ? "," : "", &name, zs[i].requests,
+                zs[i].responses[0], zs[i].responses[1], zs[i].responses[2],
+                zs[i].responses[3], zs[i].responses[4], zs[i].discarded,
+                zs[i].received, zs[i].sent, h->count, h->sum,
+                ngx_histogram_quantile(h, 500),
+                ngx_histogram_quantile(h, 990),
+                ngx_histogram_quantile(h, 999))
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_prometheus(ngx_http_extended_status_ctx_t *ctx)
+{
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_connections_accepted counter\n"
+            "nginx_connections_accepted %uA\n"
+            "# TYPE nginx_connections_handled counter\n"
+            "nginx_connections_handled %uA\n"
+            "# TYPE nginx_connections_active gauge\n"
+            "nginx_connections_active %uA\n"
+            "# TYPE nginx_connections_reading gauge\n"
+            "nginx_connections_reading %uA\n"
+            "# TYPE nginx_connections_writing gauge\n"
+            "nginx_connections_writing %uA\n"
+            "# TYPE nginx_connections_waiting gauge\n"
+            "nginx_connections_waiting %uA\n"
+            "# TYPE nginx_http_requests_total counter\n"
+            "nginx_http_requests_total %uA\n",
+            ngx_event_stat(ngx_stat_accepted), ngx_event_stat(ngx_stat_handled),
+            ngx_event_stat(ngx_stat_active), ngx_event_stat(ngx_stat_reading),
+            ngx_event_stat(ngx_stat_writing), ngx_event_stat(ngx_stat_waiting),
+            ngx_event_stat(ngx_stat_requests))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_extended_status_prometheus_zones(ctx,
+                                        NGX_HTTP_EXTENDED_STATUS_SERVER)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    if (ngx_http_extended_status_prometheus_zones(ctx,
+                                        NGX_HTTP_EXTENDED_STATUS_LOCATION)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (ngx_http_extended_status_prometheus_peers(ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+#endif
+
+#if (NGX_HTTP_CACHE)
+    if (ngx_http_extended_status_prometheus_caches(ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+#endif
+
+    return NGX_OK;
+}
+
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static ngx_int_t
+ngx_http_extended_status_prometheus_peers(ngx_http_extended_status_ctx_t *ctx)
+{
+    ngx_uint_t                        i, k;
+    ngx_http_extended_status_peer_t  *sp;
+
+    if (ctx->peers.nelts == 0) {
+        return NGX_OK;
+    }
+
+    sp = ctx->peers.elts;
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_up gauge\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_upstream_peer_up"
+                "{upstream=\"%V\",peer=\"%V\"} %d\n",
+                &sp[i].upstream, &sp[i].name,
+                ngx_strcmp(sp[i].state, "up") == 0)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_active gauge\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_upstream_peer_active"
+                "{upstream=\"%V\",peer=\"%V\"} %ui\n",
+                &sp[i].upstream, &sp[i].name, sp[i].active)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_requests_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_upstream_peer_requests_total"
+                "{upstream=\"%V\",peer=\"%V\"} %ui\n",
+                &sp[i].upstream, &sp[i].name, sp[i].stats.requests)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_responses_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        for (k = 0; k < 5; k++) {
+            if (ngx_http_extended_status_printf(ctx,
+                    "nginx_upstream_peer_responses_total"
+                    "{upstream=\"%V\",peer=\"%V\",code=\"%uixx\"} %ui\n",
+                    &sp[i].upstream, &sp[i].name, k + 1,
+                    sp[i].stats.responses[k])
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_fails_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_upstream_peer_fails_total"
+                "{upstream=\"%V\",peer=\"%V\"} %ui\n",
+                &sp[i].upstream, &sp[i].name, sp[i].stats.fails)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_sent_bytes_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_upstream_peer_sent_bytes_total"
+                "{upstream=\"%V\",peer=\"%V\"} %uL\n",
+                &sp[i].upstream, &sp[i].name, sp[i].stats.sent)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_upstream_peer_received_bytes_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->peers.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_upstream_peer_received_bytes_total"
+                "{upstream=\"%V\",peer=\"%V\"} %uL\n",
+                &sp[i].upstream, &sp[i].name, sp[i].stats.received)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_prometheus_times(ctx, 1) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return ngx_http_extended_status_prometheus_times(ctx, 0);
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_prometheus_times(ngx_http_extended_status_ctx_t *ctx,
+    ngx_uint_t upstream)
+{
+    char                                 *metric, *open, *close;
+    ngx_str_t                             peer;
+    ngx_uint_t                            i;
+    ngx_msec_t                            ms;
+    ngx_histogram_t                      *h;
+    ngx_http_extended_status_peer_t      *sp;
+    ngx_http_extended_status_time_t      *t;
+    ngx_http_extended_status_quantile_t  *q;
+    ngx_http_upstream_rr_peer_stats_t    *stats;
+
+    if (upstream) {
+        metric = "upstream";
+        open = "";
+        close = "";
+        ngx_str_null(&peer);
+
+    } else {
+        metric = "upstream_peer";
+        open = ",peer=\"";
+        close = "\"";
+    }
+
+    sp = ctx->peers.elts;
+
+    for (t = ngx_http_extended_status_times; t->name; t++) {
+
+        if (ngx_http_extended_status_printf(ctx,
+                "# TYPE nginx_%s_%s_time_seconds summary\n", metric, t->name)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        for (i = 0; i < ctx->peers.nelts; i++) {
+
+            if (upstream) {
+                if (i && sp[i].total == sp[i - 1].total) {
+                    continue;
+                }
+
+                stats = sp[i].total;
+
+            } else {
+                stats = &sp[i].stats;
+                peer = sp[i].name;
+            }
+
+            h = (ngx_histogram_t *) ((u_char *) stats + t->offset);
+
+            for (q = ngx_http_extended_status_quantiles; q->label; q++) {
+                ms = ngx_histogram_quantile(h, q->permille);
+
+                if (ngx_http_extended_status_printf(ctx,
+                        "nginx_%s_%s_time_seconds{upstream=\"%V\"%s%V%s,"
+                        "quantile=\"%s\"} %M.%03M\n",
+                        metric, t->name, &sp[i].upstream, open, &peer, close,
+                        q->label, ms / 1000, ms % 1000)
+                    != NGX_OK)
+                {
+                    return NGX_ERROR;
+                }
+            }
+
+            if (ngx_http_extended_status_printf(ctx,
+                    "nginx_%s_%s_time_seconds_sum{upstream=\"%V\"%s%V%s} "
+                    "%uA.%03uA\n"
+                    "nginx_%s_%s_time_seconds_count{upstream=\"%V\"%s%V%s} "
+                    "%uA\n",
+                    metric, t->name, &sp[i].upstream, open, &peer, close,
+                    h->sum / 1000, h->sum % 1000,
+                    metric, t->name, &sp[i].upstream, open, &peer, close,
+                    h->count)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+#if (NGX_HTTP_CACHE)
+
+static ngx_int_t
+ngx_http_extended_status_prometheus_caches(ngx_http_extended_status_ctx_t *ctx)
+{
+    ngx_str_t                               *names;
+    ngx_uint_t                               i, k;
+    ngx_http_file_cache_t                  **cache;
+    ngx_http_extended_status_cache_stats_t  *cs;
+
+    if (ctx->conf->caches.nelts == 0) {
+        return NGX_OK;
+    }
+
+    cache = ctx->conf->caches.elts;
+    cs = ngx_http_extended_status_caches(ctx->conf, ctx->block);
+
+    names = ngx_palloc(ctx->request->pool,
+                       ctx->conf->caches.nelts * sizeof(ngx_str_t));
+    if (names == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+        if (ngx_http_extended_status_escape(ctx->request->pool, &names[i],
+                                            cache[i]->shm_zone->shm.name.data,
+                                            cache[i]->shm_zone->shm.name.len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_cache_responses_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+        for (k = NGX_HTTP_CACHE_MISS; k < NGX_HTTP_EXTENDED_STATUS_CACHE; k++) {
+            if (ngx_http_extended_status_printf(ctx,
+                    "nginx_cache_responses_total"
+                    "{cache=\"%V\",status=\"%V\"} %ui\n",
+                    &names[i], &ngx_http_extended_status_cache_status[k],
+                    cs[i].responses[k])
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_cache_sent_bytes_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_cache_sent_bytes_total{cache=\"%V\"} %uL\n",
+                &names[i], cs[i].sent)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_cache_evicted_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_cache_evicted_total{cache=\"%V\"} %ui\n",
+                &names[i], cache[i]->sh->evicted)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_cache_evicted_bytes_total counter\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_cache_evicted_bytes_total{cache=\"%V\"} %O\n",
+                &names[i], cache[i]->sh->evicted_size)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_cache_eviction_backlog gauge\n")
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->caches.nelts; i++) {
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_cache_eviction_backlog{cache=\"%V\"} %ui\n",
+                &names[i], cache[i]->sh->backlog)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_extended_status_prometheus_zones(ngx_http_extended_status_ctx_t *ctx,
+    ngx_uint_t type)
+{
+    char                                   *metric;
+    ngx_str_t                              *names;
+    ngx_uint_t                              i, k, n, total;
+    ngx_msec_t                              le;
+    ngx_histogram_t                        *h;
+    ngx_http_extended_status_zone_t        *zone;
+    ngx_http_extended_status_zone_stats_t  *zs;
+
+    metric = (type == NGX_HTTP_EXTENDED_STATUS_SERVER) ? "server_zone"
+                                                       : "location_zone";
+
+    zone = ctx->conf->zones.elts;
+    zs = (ngx_http_extended_status_zone_stats_t *) ctx->block;
+
+    names = ngx_pcalloc(ctx->request->pool,
+                        ctx->conf->zones.nelts * sizeof(ngx_str_t));
+    if (names == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0, n = 0; i < ctx->conf->zones.nelts; i++) {
+
+        if (zone[i].type != type) {
+            continue;
+        }
+
+        if (ngx_http_extended_status_escape(ctx->request->pool, &names[i],
+                                            zone[i].name.data,
+                                            zone[i].name.len)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        n++;
+    }
+
+    if (n == 0) {
+        return NGX_OK;
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_%s_requests_total counter\n", metric)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->zones.nelts; i++) {
+        if (zone[i].type == type
+            && ngx_http_extended_status_printf(ctx,
+                   "nginx_%s_requests_total{zone=\"%V\"} %ui\n",
+                   metric, &names[i], zs[i].requests)
+               != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_%s_responses_total counter\n", metric)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->zones.nelts; i++) {
+
+        if (zone[i].type != type) {
+            continue;
+        }
+
+        for (k = 0; k < 5; k++) {
+            if (ngx_http_extended_status_printf(ctx,
+                    "nginx_%s_responses_total{zone=\"%V\",code=\"%uixx\"} "
+                    "%ui\n", metric, &names[i], k + 1, zs[i].responses[k])
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_%s_discarded_total counter\n", metric)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->zones.nelts; i++) {
+        if (zone[i].type == type
+            && ngx_http_extended_status_printf(ctx,
+                   "nginx_%s_discarded_total{zone=\"%V\"} %ui\n",
+                   metric, &names[i], zs[i].discarded)
+               != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_%s_received_bytes_total counter\n", metric)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->zones.nelts; i++) {
+        if (zone[i].type == type
+            && ngx_http_extended_status_printf(ctx,
+                   "nginx_%s_received_bytes_total{zone=\"%V\"} %uL\n",
+                   metric, &names[i], zs[i].received)
+               != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_%s_sent_bytes_total counter\n", metric)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->zones.nelts; i++) {
+        if (zone[i].type == type
+            && ngx_http_extended_status_printf(ctx,
+                   "nginx_%s_sent_bytes_total{zone=\"%V\"} %uL\n",
+                   metric, &names[i], zs[i].sent)
+               != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    if (ngx_http_extended_status_printf(ctx,
+            "# TYPE nginx_%s_request_duration_seconds histogram\n", metric)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->conf->zones.nelts; i++) {
+
+        if (zone[i].type != type) {
+            continue;
+        }
+
+        h = &zs[i].request_time;
+        total = 0;
+
+        /* buckets are reported at power of two millisecond boundaries */
+
+        for (k = 0; k < NGX_HISTOGRAM_BUCKETS; k++) {
+            total += h->bucket[k];
+
+            if (((k + 1) & ((1 << NGX_HISTOGRAM_SUB_BITS) - 1)) != 0
+                || k == NGX_HISTOGRAM_BUCKETS - 1)
+            {
+                continue;
+            }
+
+            le = ngx_histogram_bucket_max(k) + 1;
+
+            if (ngx_http_extended_status_printf(ctx,
+                    "nginx_%s_request_duration_seconds_bucket"
+                    "{zone=\"%V\",le=\"%M.%03M\"} %ui\n",
+                    metric, &names[i], le / 1000, le % 1000, total)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+
+        if (ngx_http_extended_status_printf(ctx,
+                "nginx_%s_request_duration_seconds_bucket"
+                "{zone=\"%V\",le=\"+Inf\"} %uA\n"
+                "nginx_%s_request_duration_seconds_sum{zone=\"%V\"} "
+                "%uA.%03uA\n"
+                "nginx_%s_request_duration_seconds_count{zone=\"%V\"} %uA\n",
+                metric, &names[i], h->count,
+                metric, &names[i], h->sum / 1000, h->sum % 1000,
+                metric, &names[i], h->count)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_printf(ngx_http_extended_status_ctx_t *ctx,
+    const char *fmt, ...)
+{
+    u_char       *p;
+    size_t        size;
+    va_list       args;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    b = ctx->buf;
+
+    for ( ;; ) {
+
+        if (b) {
+            va_start(args, fmt);
+            p = ngx_vslprintf(b->last, b->end, fmt, args);
+            va_end(args);
+
+            if (p < b->end) {
+                b->last = p;
+                return NGX_OK;
+            }
+
+            /*
+             * the output might have been truncated: it is written again
+             * to a new buffer, or to a larger one if the buffer was empty
+             */
+
+            if (b->last == b->start) {
+                size = 2 * (b->end - b->start);
+
+                p = ngx_palloc(ctx->request->pool, size);
+                if (p == NULL) {
+                    return NGX_ERROR;
+                }
+
+                b->start = p;
+                b->pos = p;
+                b->last = p;
+                b->end = p + size;
+
+                continue;
+            }
+        }
+
+        b = ngx_create_temp_buf(ctx->request->pool,
+                                NGX_HTTP_EXTENDED_STATUS_BUFSIZE);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl = ngx_alloc_chain_link(ctx->request->pool);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl->buf = b;
+        cl->next = NULL;
+
+        *ctx->last = cl;
+        ctx->last = &cl->next;
+        ctx->buf = b;
+    }
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_escape(ngx_pool_t *pool, ngx_str_t *dst, u_char *src,
+    size_t len)
+{
+    size_t  n;
+
+    n = ngx_escape_json(NULL, src, len);
+
+    if (n == 0) {
+        dst->len = len;
+        dst->data = ngx_pnalloc(pool, len);
+        if (dst->data == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(dst->data, src, len);
+
+        return NGX_OK;
+    }
+
+    dst->data = ngx_pnalloc(pool, len + n);
+    if (dst->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    dst->len = (u_char *) ngx_escape_json(dst->data, src, len) - dst->data;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_log_handler(ngx_http_request_t *r)
+{
+    ngx_uint_t                              status;
+    ngx_time_t                             *tp;
+    ngx_msec_int_t                          ms;
+    ngx_http_extended_status_zone_stats_t  *zs;
+    ngx_http_extended_status_srv_conf_t    *sscf;
+    ngx_http_extended_status_loc_conf_t    *slcf;
+    ngx_http_extended_status_main_conf_t   *smcf;
+#if (NGX_HTTP_CACHE)
+    ngx_uint_t                              i;
+    ngx_http_file_cache_t                 **cache;
+    ngx_http_extended_status_cache_stats_t *cs;
+#endif
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_extended_status_module);
+
+    if (smcf->block == NULL) {
+        return NGX_OK;
+    }
+
+    if (r->err_status) {
+        status = r->err_status;
+
+    } else {
+        status = r->headers_out.status;
+    }
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+    ms = ngx_max(ms, 0);
+
+    zs = (ngx_http_extended_status_zone_stats_t *) smcf->block;
+
+    sscf = ngx_http_get_module_srv_conf(r, ngx_http_extended_status_module);
+
+    if (sscf->zone != NGX_CONF_UNSET_UINT) {
+        ngx_http_extended_status_account(&zs[sscf->zone], r, status, ms);
+    }
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_extended_status_module);
+
+    if (slcf->zone != NGX_CONF_UNSET_UINT) {
+        ngx_http_extended_status_account(&zs[slcf->zone], r, status, ms);
+    }
+
+#if (NGX_HTTP_CACHE)
+
+    if (r->upstream == NULL || r->upstream->cache_status == 0
+        || r->cache == NULL)
+    {
+        return NGX_OK;
+    }
+
+    cache = smcf->caches.elts;
+
+    for (i = 0; i < smcf->caches.nelts; i++) {
+        if (cache[i] == r->cache->file_cache) {
+            break;
+        }
+    }
+
+    if (i == smcf->caches.nelts
+        || r->upstream->cache_status >= NGX_HTTP_EXTENDED_STATUS_CACHE)
+    {
+        return NGX_OK;
+    }
+
+    cs = ngx_http_extended_status_caches(smcf, smcf->block);
+
+    cs[i].responses[r->upstream->cache_status]++;
+    cs[i].sent += r->connection->sent;
+
+#endif
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_extended_status_account(ngx_http_extended_status_zone_stats_t *stats,
+    ngx_http_request_t *r, ngx_uint_t status, ngx_msec_t ms)
+{
+    /* the block is only updated by the current worker process */
+
+    stats->requests++;
+
+    if (status >= 100 && status < 600 && !r->connection->error) {
+        stats->responses[status / 100 - 1]++;
+
+    } else {
+        stats->discarded++;
+    }
+
+    stats->received += r->request_length;
+    stats->sent += r->connection->sent;
+
+    ngx_histogram_add(&stats->request_time, ms);
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_slab_pool_t                       *shpool;
+    ngx_http_extended_status_main_conf_t  *smcf;
+
+    smcf = shm_zone->data;
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    /* the configuration is complete now */
+
+    smcf->workers = smcf->ccf->master ? smcf->ccf->worker_processes : 1;
+
+    if (shm_zone->shm.exists) {
+        smcf->blocks = shpool->data;
+        return NGX_OK;
+    }
+
+    smcf->blocks = ngx_slab_calloc(shpool, smcf->workers * smcf->size);
+    if (smcf->blocks == NULL) {
+        ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                      "could not allocate statistics for %ui worker "
+                      "processes, \"worker_processes\" should be "
+                      "specified before the \"http\" block",
+                      smcf->workers);
+        return NGX_ERROR;
+    }
+
+    shpool->data = smcf->blocks;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_add_zone(ngx_conf_t *cf,
+    ngx_http_extended_status_main_conf_t *smcf, ngx_str_t *name,
+    ngx_uint_t type)
+{
+    ngx_uint_t                        i;
+    ngx_http_extended_status_zone_t  *zone;
+
+    zone = smcf->zones.elts;
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        if (zone[i].type == type
+            && zone[i].name.len == name->len
+            && ngx_strncmp(zone[i].name.data, name->data, name->len) == 0)
+        {
+            return i;
+        }
+    }
+
+    zone = ngx_array_push(&smcf->zones);
+    if (zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    zone->name = *name;
+    zone->type = type;
+
+    return i;
+}
+
+
+static void *
+ngx_http_extended_status_create_main_conf(ngx_conf_t *cf)
+{
+    ngx_http_extended_status_main_conf_t  *smcf;
+
+    smcf = ngx_pcalloc(cf->pool,
+                       sizeof(ngx_http_extended_status_main_conf_t));
+    if (smcf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     smcf->enabled = 0;
+     *     smcf->size = 0;
+     *     smcf->workers = 0;
+     *     smcf->blocks = NULL;
+     *     smcf->block = NULL;
+     *     smcf->shm_zone = NULL;
+     */
+
+    if (ngx_array_init(&smcf->zones, cf->pool, 4,
+                       sizeof(ngx_http_extended_status_zone_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    if (ngx_array_init(&smcf->caches, cf->pool, 4,
+                       sizeof(ngx_http_file_cache_t *))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    smcf->ccf = (ngx_core_conf_t *) ngx_get_conf(cf->cycle->conf_ctx,
+                                                 ngx_core_module);
+
+    return smcf;
+}
+
+
+static void *
+ngx_http_extended_status_create_srv_conf(ngx_conf_t *cf)
+{
+    ngx_http_extended_status_srv_conf_t  *sscf;
+
+    sscf = ngx_palloc(cf->pool, sizeof(ngx_http_extended_status_srv_conf_t));
+    if (sscf == NULL) {
+        return NULL;
+    }
+
+    sscf->zone = NGX_CONF_UNSET_UINT;
+
+    return sscf;
+}
+
+
+static void *
+ngx_http_extended_status_create_loc_conf(ngx_conf_t *cf)
+{
+    ngx_http_extended_status_loc_conf_t  *slcf;
+
+    slcf = ngx_palloc(cf->pool, sizeof(ngx_http_extended_status_loc_conf_t));
+    if (slcf == NULL) {
+        return NULL;
+    }
+
+    slcf->zone = NGX_CONF_UNSET_UINT;
+
+    return slcf;
+}
+
+
+static char *
+ngx_http_extended_status_merge_loc_conf(ngx_conf_t *cf, void *parent,
+    void *child)
+{
+    ngx_http_extended_status_loc_conf_t *prev = parent;
+    ngx_http_extended_status_loc_conf_t *conf = child;
+
+    ngx_conf_merge_uint_value(conf->zone, prev->zone, NGX_CONF_UNSET_UINT);
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_extended_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_core_loc_conf_t              *clcf;
+    ngx_http_extended_status_main_conf_t  *smcf;
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_extended_status_handler;
+
+    smcf = ngx_http_conf_get_module_main_conf(cf,
+                                              ngx_http_extended_status_module);
+    smcf->enabled = 1;
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_extended_status_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_extended_status_loc_conf_t *slcf = conf;
+
+    ngx_int_t                              zone;
+    ngx_str_t                             *value;
+    ngx_http_extended_status_srv_conf_t   *sscf;
+    ngx_http_extended_status_main_conf_t  *smcf;
+
+    value = cf->args->elts;
+
+    if (value[1].len == 0) {
+        return "invalid value";
+    }
+
+    smcf = ngx_http_conf_get_module_main_conf(cf,
+                                              ngx_http_extended_status_module);
+
+    if (cf->cmd_type == NGX_HTTP_SRV_CONF) {
+        sscf = ngx_http_conf_get_module_srv_conf(cf,
+                                              ngx_http_extended_status_module);
+
+        if (sscf->zone != NGX_CONF_UNSET_UINT) {
+            return "is duplicate";
+        }
+
+        zone = ngx_http_extended_status_add_zone(cf, smcf, &value[1],
+                                             NGX_HTTP_EXTENDED_STATUS_SERVER);
+        if (zone == NGX_ERROR) {
+            return NGX_CONF_ERROR;
+        }
+
+        sscf->zone = zone;
+
+        return NGX_CONF_OK;
+    }
+
+    if (slcf->zone != NGX_CONF_UNSET_UINT) {
+        return "is duplicate";
+    }
+
+    zone = ngx_http_extended_status_add_zone(cf, smcf, &value[1],
+                                             NGX_HTTP_EXTENDED_STATUS_LOCATION);
+    if (zone == NGX_ERROR) {
+        return NGX_CONF_ERROR;
+    }
+
+    slcf->zone = zone;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_init(ngx_conf_t *cf)
+{
+    size_t                                  size;
+    ngx_int_t                               zone;
+    ngx_str_t                               name;
+    ngx_uint_t                              i, workers;
+    ngx_http_handler_pt                    *h;
+    ngx_http_core_srv_conf_t              **cscfp;
+    ngx_http_core_main_conf_t              *cmcf;
+    ngx_http_extended_status_srv_conf_t    *sscf;
+    ngx_http_extended_status_main_conf_t   *smcf;
+#if (NGX_HTTP_CACHE)
+    ngx_list_part_t                        *part;
+    ngx_shm_zone_t                         *shm_zone;
+    ngx_http_file_cache_t                 **cache;
+#endif
+
+    smcf = ngx_http_conf_get_module_main_conf(cf,
+                                              ngx_http_extended_status_module);
+
+    if (!smcf->enabled) {
+        return NGX_OK;
+    }
+
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+    /* servers without the "status_zone" directive are named after the host */
+
+    cscfp = cmcf->servers.elts;
+
+    for (i = 0; i < cmcf->servers.nelts; i++) {
+        sscf = ngx_http_conf_get_module_srv_conf(cscfp[i],
+                                              ngx_http_extended_status_module);
+
+        if (sscf->zone != NGX_CONF_UNSET_UINT) {
+            continue;
+        }
+
+        name = cscfp[i]->server_name;
+
+        if (name.len == 0) {
+            ngx_str_set(&name, "_");
+        }
+
+        zone = ngx_http_extended_status_add_zone(cf, smcf, &name,
+                                             NGX_HTTP_EXTENDED_STATUS_SERVER);
+        if (zone == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        sscf->zone = zone;
+    }
+
+#if (NGX_HTTP_CACHE)
+
+    /* cache zones of all modules */
+
+    part = &cf->cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        if (shm_zone[i].init != ngx_http_file_cache_init) {
+            continue;
+        }
+
+        cache = ngx_array_push(&smcf->caches);
+        if (cache == NULL) {
+            return NGX_ERROR;
+        }
+
+        *cache = shm_zone[i].data;
+    }
+
+#endif
+
+    smcf->size = ngx_align(smcf->zones.nelts
+                           * sizeof(ngx_http_extended_status_zone_stats_t)
+                           + smcf->caches.nelts
+                           * sizeof(ngx_http_extended_status_cache_stats_t),
+                           NGX_CPU_CACHE_LINE);
+
+    /*
+     * the number of worker processes may not be known yet, the zone is
+     * sized for the greater of the configured value and the number of CPUs
+     */
+
+    workers = ngx_ncpu;
+
+    if (smcf->ccf->worker_processes != NGX_CONF_UNSET
+        && (ngx_uint_t) smcf->ccf->worker_processes > workers)
+    {
+        workers = smcf->ccf->worker_processes;
+    }
+
+    size = workers * smcf->size;
+    size += size / 64 + 8 * ngx_pagesize;
+
+    ngx_str_set(&name, "extended_status");
+
+    smcf->shm_zone = ngx_shared_memory_add(cf, &name, size,
+                                           &ngx_http_extended_status_module);
+    if (smcf->shm_zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    smcf->shm_zone->init = ngx_http_extended_status_init_zone;
+    smcf->shm_zone->data = smcf;
+    smcf->shm_zone->noreuse = 1;
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_LOG_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_extended_status_log_handler;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_extended_status_init_worker(ngx_cycle_t *cycle)
+{
+    ngx_http_extended_status_main_conf_t  *smcf;
+
+    if (ngx_process != NGX_PROCESS_SINGLE
+        && ngx_process != NGX_PROCESS_WORKER)
+    {
+        return NGX_OK;
+    }
+
+    smcf = ngx_http_cycle_get_module_main_conf(cycle,
+                                              ngx_http_extended_status_module);
+    if (smcf == NULL || smcf->blocks == NULL) {
+        return NGX_OK;
+    }
+
+    if (ngx_worker >= smcf->workers) {
+        return NGX_OK;
+    }
+
+    smcf->block = smcf->blocks + ngx_worker * smcf->size;
+
+    return NGX_OK;
+}
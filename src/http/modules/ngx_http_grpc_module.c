@@ -4220,6 +4220,13 @@ ngx_http_grpc_get_connection_data(ngx_http_request_t *r,
         ctx->connection->last_stream_id += 2;
         ctx->id = ctx->connection->last_stream_id;
 
+        if (ctx->id >= 0x7fffffff) {
+
+            /* stream identifiers exhausted, do not cache the connection */
+
+            ctx->goaway = 1;
+        }
+
         return NGX_OK;
     }
 
@@ -51,6 +51,8 @@ typedef struct {
     ngx_array_t                    *passwords;
     ngx_array_t                    *conf_commands;
 
+    ngx_thread_pool_t              *async_offload;
+
     ngx_shm_zone_t                 *shm_zone;
 
     ngx_flag_t                      session_tickets;
@@ -178,7 +178,12 @@ ngx_http_upstream_get_hash_peer(ngx_peer_connection_t *pc, void *data)
 
     ngx_http_upstream_rr_peers_rlock(hp->rrp.peers);
 
-    if (hp->tries > 20 || hp->rrp.peers->single || hp->key.len == 0) {
+    if (hp->tries > 20
+        || hp->rrp.peers->single
+        || hp->rrp.peers->number == 0
+        || hp->key.len == 0
+        || ngx_http_upstream_rr_peers_changed(&hp->rrp))
+    {
         ngx_http_upstream_rr_peers_unlock(hp->rrp.peers);
         return hp->get_rr_peer(pc, &hp->rrp);
     }
@@ -289,9 +294,8 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
     size_t                              host_len, port_len, size;
     uint32_t                            hash, base_hash;
     ngx_str_t                          *server;
-    ngx_uint_t                          npoints, i, j;
-    ngx_http_upstream_rr_peer_t        *peer;
-    ngx_http_upstream_rr_peers_t       *peers;
+    ngx_uint_t                          npoints, i, j, k;
+    ngx_http_upstream_server_t         *us_server;
     ngx_http_upstream_chash_points_t   *points;
     ngx_http_upstream_hash_srv_conf_t  *hcf;
     union {
@@ -305,8 +309,19 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
 
     us->peer.init = ngx_http_upstream_init_chash_peer;
 
-    peers = us->peer.data;
-    npoints = peers->total_weight * 160;
+    /*
+     * points are calculated from servers rather than from peers, so
+     * servers resolved at run time get their points in advance
+     */
+
+    us_server = us->servers->elts;
+    npoints = 0;
+
+    for (k = 0; k < us->servers->nelts; k++) {
+        if (us_server[k].naddrs || us_server[k].resolve) {
+            npoints += us_server[k].weight * 160;
+        }
+    }
 
     size = sizeof(ngx_http_upstream_chash_points_t)
            + sizeof(ngx_http_upstream_chash_point_t) * (npoints - 1);
@@ -318,8 +333,13 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
 
     points->number = 0;
 
-    for (peer = peers->peer; peer; peer = peer->next) {
-        server = &peer->server;
+    for (k = 0; k < us->servers->nelts; k++) {
+
+        if (us_server[k].naddrs == 0 && !us_server[k].resolve) {
+            continue;
+        }
+
+        server = &us_server[k].name;
 
         /*
          * Hash expression is compatible with Cache::Memcached::Fast:
@@ -365,7 +385,7 @@ ngx_http_upstream_init_chash(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
         ngx_crc32_update(&base_hash, port, port_len);
 
         prev_hash.value = 0;
-        npoints = peer->weight * 160;
+        npoints = us_server[k].weight * 160;
 
         for (j = 0; j < npoints; j++) {
             hash = base_hash;
@@ -509,7 +529,12 @@ ngx_http_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
 
     ngx_http_upstream_rr_peers_wlock(hp->rrp.peers);
 
-    if (hp->tries > 20 || hp->rrp.peers->single || hp->key.len == 0) {
+    if (hp->tries > 20
+        || hp->rrp.peers->single
+        || hp->rrp.peers->number == 0
+        || hp->key.len == 0
+        || ngx_http_upstream_rr_peers_changed(&hp->rrp))
+    {
         ngx_http_upstream_rr_peers_unlock(hp->rrp.peers);
         return hp->get_rr_peer(pc, &hp->rrp);
     }
@@ -0,0 +1,1038 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_UPSTREAM_HC_BUFFER_SIZE  1024
+
+
+typedef struct {
+    ngx_flag_t                         enable;
+    ngx_msec_t                         interval;
+    ngx_msec_t                         timeout;
+    ngx_uint_t                         fails;
+    ngx_uint_t                         passes;
+    in_port_t                          port;
+    ngx_str_t                          uri;
+    ngx_str_t                          request;
+#if (NGX_HTTP_SSL)
+    ngx_ssl_t                         *ssl;
+#endif
+} ngx_http_upstream_hc_srv_conf_t;
+
+
+typedef struct ngx_http_upstream_hc_peer_s  ngx_http_upstream_hc_peer_t;
+
+
+typedef struct {
+    ngx_http_upstream_srv_conf_t      *upstream;
+    ngx_http_upstream_hc_srv_conf_t   *conf;
+
+    ngx_event_t                        event;
+
+    /* probes of the current round, and those not yet finished */
+    ngx_http_upstream_hc_peer_t       *probes;
+    ngx_uint_t                         pending;
+} ngx_http_upstream_hc_t;
+
+
+struct ngx_http_upstream_hc_peer_s {
+    ngx_http_upstream_hc_t            *hc;
+    ngx_http_upstream_hc_peer_t       *next;
+
+    /* the peer is only compared, it may be freed during the check */
+    ngx_http_upstream_rr_peers_t      *peers;
+    ngx_http_upstream_rr_peer_t       *peer;
+
+    ngx_pool_t                        *pool;
+    ngx_log_t                          log;
+    ngx_peer_connection_t              pc;
+
+    ngx_buf_t                         *request;
+    ngx_buf_t                         *response;
+
+    ngx_str_t                          name;
+    socklen_t                          socklen;
+    ngx_sockaddr_t                     sockaddr;
+
+    ngx_uint_t                         passed;  /* unsigned  passed:1; */
+};
+
+
+static void ngx_http_upstream_hc_timer(ngx_event_t *ev);
+static ngx_http_upstream_hc_peer_t *ngx_http_upstream_hc_create_probe(
+    ngx_http_upstream_hc_t *hc, ngx_http_upstream_rr_peers_t *peers,
+    ngx_http_upstream_rr_peer_t *peer);
+static void ngx_http_upstream_hc_connect(ngx_http_upstream_hc_peer_t *hp);
+#if (NGX_HTTP_SSL)
+static void ngx_http_upstream_hc_ssl_init_connection(
+    ngx_http_upstream_hc_peer_t *hp, ngx_connection_t *c);
+static void ngx_http_upstream_hc_ssl_handshake(ngx_connection_t *c);
+#endif
+static void ngx_http_upstream_hc_send_handler(ngx_event_t *wev);
+static void ngx_http_upstream_hc_recv_handler(ngx_event_t *rev);
+static void ngx_http_upstream_hc_dummy_handler(ngx_event_t *ev);
+static ngx_int_t ngx_http_upstream_hc_parse_status(ngx_buf_t *b);
+static void ngx_http_upstream_hc_finalize(ngx_http_upstream_hc_peer_t *hp,
+    ngx_uint_t passed);
+static void ngx_http_upstream_hc_done(ngx_http_upstream_hc_t *hc);
+static void ngx_http_upstream_hc_update(ngx_http_upstream_hc_peer_t *hp,
+    ngx_uint_t passed, ngx_uint_t reset);
+static u_char *ngx_http_upstream_hc_log_error(ngx_log_t *log, u_char *buf,
+    size_t len);
+
+static void *ngx_http_upstream_hc_create_conf(ngx_conf_t *cf);
+static char *ngx_http_upstream_hc(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+#if (NGX_HTTP_SSL)
+static ngx_int_t ngx_http_upstream_hc_set_ssl(ngx_conf_t *cf,
+    ngx_http_upstream_hc_srv_conf_t *hcf);
+#endif
+static ngx_int_t ngx_http_upstream_hc_init(ngx_conf_t *cf);
+static ngx_int_t ngx_http_upstream_hc_init_worker(ngx_cycle_t *cycle);
+
+
+static ngx_command_t  ngx_http_upstream_hc_commands[] = {
+
+    { ngx_string("health_check"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_ANY,
+      ngx_http_upstream_hc,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_upstream_hc_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_upstream_hc_init,             /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_upstream_hc_create_conf,      /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_upstream_hc_module = {
+    NGX_MODULE_V1,
+    &ngx_http_upstream_hc_module_ctx,      /* module context */
+    ngx_http_upstream_hc_commands,         /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    ngx_http_upstream_hc_init_worker,      /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static void
+ngx_http_upstream_hc_timer(ngx_event_t *ev)
+{
+    ngx_uint_t                     n;
+    ngx_http_upstream_hc_t        *hc;
+    ngx_http_upstream_hc_peer_t   *hp, *probes;
+    ngx_http_upstream_rr_peer_t   *peer;
+    ngx_http_upstream_rr_peers_t  *peers;
+
+    hc = ev->data;
+
+    if (ngx_exiting) {
+        return;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "http upstream health check \"%V\"", &hc->upstream->host);
+
+    probes = NULL;
+    n = 0;
+
+    /* probes are created under the lock and started after it is released */
+
+    for (peers = hc->upstream->peer.data; peers; peers = peers->next) {
+
+        ngx_http_upstream_rr_peers_rlock(peers);
+
+        for (peer = peers->peer; peer; peer = peer->next) {
+
+            if (peer->down & ~NGX_HTTP_UPSTREAM_RR_CHECK_DOWN) {
+                continue;
+            }
+
+            hp = ngx_http_upstream_hc_create_probe(hc, peers, peer);
+            if (hp == NULL) {
+                break;
+            }
+
+            hp->next = probes;
+            probes = hp;
+            n++;
+        }
+
+        ngx_http_upstream_rr_peers_unlock(peers);
+    }
+
+    /* a probe may finish immediately, so the round is held until started */
+
+    hc->probes = probes;
+    hc->pending = n + 1;
+
+    for (hp = probes; hp; hp = hp->next) {
+        ngx_http_upstream_hc_connect(hp);
+    }
+
+    if (--hc->pending == 0) {
+        ngx_http_upstream_hc_done(hc);
+    }
+}
+
+
+static ngx_http_upstream_hc_peer_t *
+ngx_http_upstream_hc_create_probe(ngx_http_upstream_hc_t *hc,
+    ngx_http_upstream_rr_peers_t *peers, ngx_http_upstream_rr_peer_t *peer)
+{
+    ngx_pool_t                   *pool;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, hc->event.log);
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    hp = ngx_pcalloc(pool, sizeof(ngx_http_upstream_hc_peer_t));
+    if (hp == NULL) {
+        goto failed;
+    }
+
+    hp->hc = hc;
+    hp->peers = peers;
+    hp->peer = peer;
+    hp->pool = pool;
+
+    hp->log = *hc->event.log;
+    hp->log.handler = ngx_http_upstream_hc_log_error;
+    hp->log.data = hp;
+    hp->log.action = "checking health of upstream server";
+
+    hp->name.data = ngx_pstrdup(pool, &peer->name);
+    if (hp->name.data == NULL) {
+        goto failed;
+    }
+
+    hp->name.len = peer->name.len;
+
+    ngx_memcpy(&hp->sockaddr, peer->sockaddr, peer->socklen);
+    hp->socklen = peer->socklen;
+
+    if (hc->conf->port) {
+        ngx_inet_set_port(&hp->sockaddr.sockaddr, hc->conf->port);
+    }
+
+    hp->request = ngx_calloc_buf(pool);
+    if (hp->request == NULL) {
+        goto failed;
+    }
+
+    hp->request->pos = hc->conf->request.data;
+    hp->request->last = hc->conf->request.data + hc->conf->request.len;
+    hp->request->memory = 1;
+
+    hp->response = ngx_create_temp_buf(pool,
+                                       NGX_HTTP_UPSTREAM_HC_BUFFER_SIZE);
+    if (hp->response == NULL) {
+        goto failed;
+    }
+
+    return hp;
+
+failed:
+
+    ngx_destroy_pool(pool);
+
+    return NULL;
+}
+
+
+static void
+ngx_http_upstream_hc_connect(ngx_http_upstream_hc_peer_t *hp)
+{
+    ngx_int_t          rc;
+    ngx_connection_t  *c;
+
+    hp->pc.sockaddr = &hp->sockaddr.sockaddr;
+    hp->pc.socklen = hp->socklen;
+    hp->pc.name = &hp->name;
+    hp->pc.get = ngx_event_get_peer;
+    hp->pc.log = &hp->log;
+    hp->pc.log_error = NGX_ERROR_ERR;
+
+    rc = ngx_event_connect_peer(&hp->pc);
+
+    if (rc == NGX_ERROR || rc == NGX_BUSY || rc == NGX_DECLINED) {
+        ngx_http_upstream_hc_finalize(hp, 0);
+        return;
+    }
+
+    c = hp->pc.connection;
+
+    c->data = hp;
+    c->pool = hp->pool;
+
+    c->write->handler = ngx_http_upstream_hc_send_handler;
+    c->read->handler = ngx_http_upstream_hc_recv_handler;
+
+    /* a single timer covers both connecting and the whole exchange */
+
+    ngx_add_timer(c->read, hp->hc->conf->timeout);
+
+    if (rc == NGX_AGAIN) {
+        return;
+    }
+
+#if (NGX_HTTP_SSL)
+
+    if (hp->hc->conf->ssl) {
+        ngx_http_upstream_hc_ssl_init_connection(hp, c);
+        return;
+    }
+
+#endif
+
+    ngx_http_upstream_hc_send_handler(c->write);
+}
+
+
+#if (NGX_HTTP_SSL)
+
+static void
+ngx_http_upstream_hc_ssl_init_connection(ngx_http_upstream_hc_peer_t *hp,
+    ngx_connection_t *c)
+{
+    ngx_int_t  rc;
+
+    if (ngx_ssl_create_connection(hp->hc->conf->ssl, c, NGX_SSL_CLIENT)
+        != NGX_OK)
+    {
+        ngx_http_upstream_hc_finalize(hp, 0);
+        return;
+    }
+
+    c->log->action = "SSL handshaking to upstream server";
+
+    rc = ngx_ssl_handshake(c);
+
+    if (rc == NGX_AGAIN) {
+        c->ssl->handler = ngx_http_upstream_hc_ssl_handshake;
+        return;
+    }
+
+    ngx_http_upstream_hc_ssl_handshake(c);
+}
+
+
+static void
+ngx_http_upstream_hc_ssl_handshake(ngx_connection_t *c)
+{
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    hp = c->data;
+
+    if (!c->ssl->handshaked) {
+
+        if (c->read->timedout) {
+            ngx_log_error(NGX_LOG_ERR, c->log, NGX_ETIMEDOUT,
+                          "upstream server timed out");
+        }
+
+        ngx_http_upstream_hc_finalize(hp, 0);
+        return;
+    }
+
+    c->log->action = "checking health of upstream server";
+
+    c->write->handler = ngx_http_upstream_hc_send_handler;
+    c->read->handler = ngx_http_upstream_hc_recv_handler;
+
+    ngx_http_upstream_hc_send_handler(c->write);
+}
+
+#endif
+
+
+static void
+ngx_http_upstream_hc_send_handler(ngx_event_t *wev)
+{
+    ssize_t                       n;
+    ngx_buf_t                    *b;
+    ngx_connection_t             *c;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    c = wev->data;
+    hp = c->data;
+    b = hp->request;
+
+#if (NGX_HTTP_SSL)
+
+    if (hp->hc->conf->ssl && c->ssl == NULL) {
+        /* connected asynchronously */
+        ngx_http_upstream_hc_ssl_init_connection(hp, c);
+        return;
+    }
+
+#endif
+
+    while (b->pos < b->last) {
+
+        n = c->send(c, b->pos, b->last - b->pos);
+
+        if (n == NGX_ERROR) {
+            ngx_http_upstream_hc_finalize(hp, 0);
+            return;
+        }
+
+        if (n == NGX_AGAIN) {
+            if (ngx_handle_write_event(wev, 0) != NGX_OK) {
+                ngx_http_upstream_hc_finalize(hp, 0);
+            }
+
+            return;
+        }
+
+        b->pos += n;
+    }
+
+    wev->handler = ngx_http_upstream_hc_dummy_handler;
+
+    if (ngx_handle_write_event(wev, 0) != NGX_OK) {
+        ngx_http_upstream_hc_finalize(hp, 0);
+        return;
+    }
+
+    if (c->read->ready) {
+        ngx_http_upstream_hc_recv_handler(c->read);
+    }
+}
+
+
+static void
+ngx_http_upstream_hc_recv_handler(ngx_event_t *rev)
+{
+    ssize_t                       n;
+    ngx_int_t                     status;
+    ngx_buf_t                    *b;
+    ngx_connection_t             *c;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    c = rev->data;
+    hp = c->data;
+    b = hp->response;
+
+    if (rev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, c->log, NGX_ETIMEDOUT,
+                      "upstream server timed out");
+        ngx_http_upstream_hc_finalize(hp, 0);
+        return;
+    }
+
+    for ( ;; ) {
+
+        n = c->recv(c, b->last, b->end - b->last);
+
+        if (n == NGX_AGAIN) {
+            if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+                ngx_http_upstream_hc_finalize(hp, 0);
+            }
+
+            return;
+        }
+
+        if (n == NGX_ERROR) {
+            ngx_http_upstream_hc_finalize(hp, 0);
+            return;
+        }
+
+        if (n > 0) {
+            b->last += n;
+        }
+
+        status = ngx_http_upstream_hc_parse_status(b);
+
+        if (status == NGX_AGAIN && n > 0 && b->last < b->end) {
+            continue;
+        }
+
+        if (status == NGX_AGAIN || status == NGX_ERROR) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream server sent invalid status line");
+            ngx_http_upstream_hc_finalize(hp, 0);
+            return;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http upstream health check status %i", status);
+
+        if (status < 200 || status >= 400) {
+            ngx_log_error(NGX_LOG_ERR, c->log, 0,
+                          "upstream server returned status %i", status);
+            ngx_http_upstream_hc_finalize(hp, 0);
+            return;
+        }
+
+        ngx_http_upstream_hc_finalize(hp, 1);
+        return;
+    }
+}
+
+
+static void
+ngx_http_upstream_hc_dummy_handler(ngx_event_t *ev)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "http upstream health check dummy handler");
+}
+
+
+/* the status code of "HTTP/1.x NNN ...", or NGX_AGAIN if incomplete */
+
+static ngx_int_t
+ngx_http_upstream_hc_parse_status(ngx_buf_t *b)
+{
+    u_char  *p;
+
+    p = b->pos;
+
+    if (b->last - p < 12) {
+        return NGX_AGAIN;
+    }
+
+    if (ngx_strncmp(p, "HTTP/", 5) != 0) {
+        return NGX_ERROR;
+    }
+
+    for (p += 5; p < b->last - 3; p++) {
+        if (*p == ' ') {
+            return ngx_atoi(p + 1, 3);
+        }
+    }
+
+    return NGX_AGAIN;
+}
+
+
+static void
+ngx_http_upstream_hc_finalize(ngx_http_upstream_hc_peer_t *hp,
+    ngx_uint_t passed)
+{
+    ngx_connection_t        *c;
+    ngx_http_upstream_hc_t  *hc;
+
+    hc = hp->hc;
+    c = hp->pc.connection;
+
+    if (c) {
+
+#if (NGX_HTTP_SSL)
+        if (c->ssl) {
+            c->ssl->no_wait_shutdown = 1;
+            (void) ngx_ssl_shutdown(c);
+        }
+#endif
+
+        ngx_close_connection(c);
+        hp->pc.connection = NULL;
+    }
+
+    hp->passed = passed;
+
+    if (--hc->pending == 0) {
+        ngx_http_upstream_hc_done(hc);
+    }
+}
+
+
+/*
+ * results are applied once all probes of a round are finished: if every
+ * server failed, the failure is more likely caused by the check itself,
+ * for example, by plain HTTP probes sent to TLS servers, than by all
+ * servers failing at once, so no server is considered unhealthy
+ */
+
+static void
+ngx_http_upstream_hc_done(ngx_http_upstream_hc_t *hc)
+{
+    ngx_uint_t                    reset;
+    ngx_http_upstream_hc_peer_t  *hp, *next;
+
+    reset = (hc->probes != NULL);
+
+    for (hp = hc->probes; hp; hp = hp->next) {
+        if (hp->passed) {
+            reset = 0;
+            break;
+        }
+    }
+
+    if (reset) {
+        ngx_log_error(NGX_LOG_ERR, hc->event.log, 0,
+                      "upstream \"%V\": all servers failed health check, "
+                      "ignored", &hc->upstream->host);
+    }
+
+    for (hp = hc->probes; hp; hp = next) {
+        next = hp->next;
+
+        ngx_http_upstream_hc_update(hp, hp->passed, reset);
+        ngx_destroy_pool(hp->pool);
+    }
+
+    hc->probes = NULL;
+
+    ngx_add_timer(&hc->event, hc->conf->interval);
+}
+
+
+static void
+ngx_http_upstream_hc_update(ngx_http_upstream_hc_peer_t *hp,
+    ngx_uint_t passed, ngx_uint_t reset)
+{
+    ngx_http_upstream_rr_peer_t      *peer;
+    ngx_http_upstream_rr_peers_t     *peers;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+
+    hcf = hp->hc->conf;
+    peers = hp->peers;
+
+    ngx_http_upstream_rr_peers_rlock(peers);
+
+    for (peer = peers->peer; peer; peer = peer->next) {
+        if (peer == hp->peer
+            && ngx_memn2cmp(peer->name.data, hp->name.data,
+                            peer->name.len, hp->name.len) == 0)
+        {
+            break;
+        }
+    }
+
+    if (peer == NULL) {
+        /* removed while being checked */
+        ngx_http_upstream_rr_peers_unlock(peers);
+        return;
+    }
+
+    ngx_http_upstream_rr_peer_lock(peers, peer);
+
+    if (reset) {
+        peer->check_fails = 0;
+        peer->check_passes = 0;
+
+        if (peer->down & NGX_HTTP_UPSTREAM_RR_CHECK_DOWN) {
+            peer->down &= ~NGX_HTTP_UPSTREAM_RR_CHECK_DOWN;
+            peer->fails = 0;
+        }
+
+    } else if (passed) {
+        peer->check_fails = 0;
+        peer->check_passes++;
+
+        if ((peer->down & NGX_HTTP_UPSTREAM_RR_CHECK_DOWN)
+            && peer->check_passes >= hcf->passes)
+        {
+            peer->down &= ~NGX_HTTP_UPSTREAM_RR_CHECK_DOWN;
+            peer->fails = 0;
+
+            ngx_log_error(NGX_LOG_NOTICE, hp->hc->event.log, 0,
+                          "upstream \"%V\": server %V is healthy",
+                          &hp->hc->upstream->host, &peer->name);
+        }
+
+    } else {
+        peer->check_passes = 0;
+        peer->check_fails++;
+
+        if (!(peer->down & NGX_HTTP_UPSTREAM_RR_CHECK_DOWN)
+            && peer->check_fails >= hcf->fails)
+        {
+            peer->down |= NGX_HTTP_UPSTREAM_RR_CHECK_DOWN;
+
+            ngx_log_error(NGX_LOG_WARN, hp->hc->event.log, 0,
+                          "upstream \"%V\": server %V is unhealthy",
+                          &hp->hc->upstream->host, &peer->name);
+        }
+    }
+
+    ngx_http_upstream_rr_peer_unlock(peers, peer);
+    ngx_http_upstream_rr_peers_unlock(peers);
+}
+
+
+static u_char *
+ngx_http_upstream_hc_log_error(ngx_log_t *log, u_char *buf, size_t len)
+{
+    u_char                       *p;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    p = buf;
+
+    if (log->action) {
+        p = ngx_snprintf(buf, len, " while %s", log->action);
+        len -= p - buf;
+        buf = p;
+    }
+
+    hp = log->data;
+
+    return ngx_snprintf(buf, len, ", upstream: \"%V\", server: %V",
+                        &hp->hc->upstream->host, &hp->name);
+}
+
+
+static void *
+ngx_http_upstream_hc_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_upstream_hc_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_upstream_hc_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->enable = 0;
+     *     conf->port = 0;
+     *     conf->uri = { 0, NULL };
+     *     conf->request = { 0, NULL };
+     *     conf->ssl = NULL;
+     */
+
+    conf->interval = NGX_CONF_UNSET_MSEC;
+    conf->timeout = NGX_CONF_UNSET_MSEC;
+    conf->fails = NGX_CONF_UNSET_UINT;
+    conf->passes = NGX_CONF_UNSET_UINT;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_upstream_hc(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_upstream_hc_srv_conf_t  *hcf = conf;
+
+    ngx_int_t    n;
+    ngx_str_t   *value, s;
+    ngx_msec_t   ms;
+    ngx_uint_t   i;
+
+    if (hcf->enable) {
+        return "is duplicate";
+    }
+
+    hcf->enable = 1;
+
+    value = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "interval=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = &value[i].data[9];
+
+            ms = ngx_parse_time(&s, 0);
+
+            if (ms == (ngx_msec_t) NGX_ERROR || ms == 0) {
+                goto invalid;
+            }
+
+            hcf->interval = ms;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "timeout=", 8) == 0) {
+
+            s.len = value[i].len - 8;
+            s.data = &value[i].data[8];
+
+            ms = ngx_parse_time(&s, 0);
+
+            if (ms == (ngx_msec_t) NGX_ERROR || ms == 0) {
+                goto invalid;
+            }
+
+            hcf->timeout = ms;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "fails=", 6) == 0) {
+
+            n = ngx_atoi(&value[i].data[6], value[i].len - 6);
+
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            hcf->fails = n;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "passes=", 7) == 0) {
+
+            n = ngx_atoi(&value[i].data[7], value[i].len - 7);
+
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            hcf->passes = n;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "port=", 5) == 0) {
+
+            n = ngx_atoi(&value[i].data[5], value[i].len - 5);
+
+            if (n == NGX_ERROR || n == 0 || n > 65535) {
+                goto invalid;
+            }
+
+            hcf->port = (in_port_t) n;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "uri=", 4) == 0) {
+
+            hcf->uri.len = value[i].len - 4;
+            hcf->uri.data = &value[i].data[4];
+
+            if (hcf->uri.len == 0 || hcf->uri.data[0] != '/') {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "ssl") == 0) {
+#if (NGX_HTTP_SSL)
+            if (ngx_http_upstream_hc_set_ssl(cf, hcf) != NGX_OK) {
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "the \"ssl\" parameter requires "
+                               "ngx_http_ssl_module");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
+        goto invalid;
+    }
+
+    ngx_conf_init_msec_value(hcf->interval, 5000);
+    ngx_conf_init_msec_value(hcf->timeout, ngx_min(hcf->interval, 5000));
+    ngx_conf_init_uint_value(hcf->fails, 1);
+    ngx_conf_init_uint_value(hcf->passes, 1);
+
+    if (hcf->uri.len == 0) {
+        ngx_str_set(&hcf->uri, "/");
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+#if (NGX_HTTP_SSL)
+
+static ngx_int_t
+ngx_http_upstream_hc_set_ssl(ngx_conf_t *cf,
+    ngx_http_upstream_hc_srv_conf_t *hcf)
+{
+    ngx_str_t            ciphers;
+    ngx_pool_cleanup_t  *cln;
+
+    if (hcf->ssl) {
+        return NGX_OK;
+    }
+
+    hcf->ssl = ngx_pcalloc(cf->pool, sizeof(ngx_ssl_t));
+    if (hcf->ssl == NULL) {
+        return NGX_ERROR;
+    }
+
+    hcf->ssl->log = cf->log;
+
+    /* the defaults of proxy_ssl_protocols and proxy_ssl_ciphers */
+
+    if (ngx_ssl_create(hcf->ssl, NGX_SSL_TLSv1|NGX_SSL_TLSv1_1
+                                 |NGX_SSL_TLSv1_2|NGX_SSL_TLSv1_3, NULL)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) {
+        ngx_ssl_cleanup_ctx(hcf->ssl);
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_ssl_cleanup_ctx;
+    cln->data = hcf->ssl;
+
+    ngx_str_set(&ciphers, "DEFAULT");
+
+    if (ngx_ssl_ciphers(cf, hcf->ssl, &ciphers, 0) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_upstream_hc_init(ngx_conf_t *cf)
+{
+    u_char                           *p;
+    size_t                            len;
+    ngx_uint_t                        i;
+    ngx_http_upstream_srv_conf_t     *uscf, **uscfp;
+    ngx_http_upstream_main_conf_t    *umcf;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+
+    umcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_upstream_module);
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->srv_conf == NULL) {
+            continue;
+        }
+
+        hcf = ngx_http_conf_upstream_srv_conf(uscf,
+                                              ngx_http_upstream_hc_module);
+
+        if (!hcf->enable) {
+            continue;
+        }
+
+        if (uscf->shm_zone == NULL) {
+            ngx_log_error(NGX_LOG_EMERG, cf->log, 0,
+                          "health check requires \"zone\" in upstream \"%V\" "
+                          "in %s:%ui", &uscf->host, uscf->file_name,
+                          uscf->line);
+            return NGX_ERROR;
+        }
+
+        len = sizeof("GET  HTTP/1.0" CRLF "Host: " CRLF
+                     "Connection: close" CRLF CRLF) - 1
+              + hcf->uri.len + uscf->host.len;
+
+        p = ngx_pnalloc(cf->pool, len);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        hcf->request.data = p;
+        hcf->request.len = ngx_sprintf(p, "GET %V HTTP/1.0" CRLF
+                                          "Host: %V" CRLF
+                                          "Connection: close" CRLF CRLF,
+                                       &hcf->uri, &uscf->host)
+                           - p;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_hc_init_worker(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                        i;
+    ngx_http_upstream_hc_t           *hc;
+    ngx_http_upstream_srv_conf_t     *uscf, **uscfp;
+    ngx_http_upstream_main_conf_t    *umcf;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+
+    /* checks are run by a single worker process */
+
+    if (ngx_process != NGX_PROCESS_SINGLE
+        && (ngx_process != NGX_PROCESS_WORKER || ngx_worker != 0))
+    {
+        return NGX_OK;
+    }
+
+    umcf = ngx_http_cycle_get_module_main_conf(cycle,
+                                               ngx_http_upstream_module);
+    if (umcf == NULL) {
+        return NGX_OK;
+    }
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->srv_conf == NULL || uscf->shm_zone == NULL) {
+            continue;
+        }
+
+        hcf = ngx_http_conf_upstream_srv_conf(uscf,
+                                              ngx_http_upstream_hc_module);
+
+        if (!hcf->enable) {
+            continue;
+        }
+
+        hc = ngx_pcalloc(cycle->pool, sizeof(ngx_http_upstream_hc_t));
+        if (hc == NULL) {
+            return NGX_ERROR;
+        }
+
+        hc->upstream = uscf;
+        hc->conf = hcf;
+
+        hc->event.handler = ngx_http_upstream_hc_timer;
+        hc->event.data = hc;
+        hc->event.log = cycle->log;
+        hc->event.cancelable = 1;
+
+        ngx_add_timer(&hc->event, 1);
+    }
+
+    return NGX_OK;
+}
@@ -111,7 +111,7 @@ ngx_http_upstream_get_least_conn_peer(ngx_peer_connection_t *pc, void *data)
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pc->log, 0,
                    "get least conn peer, try: %ui", pc->tries);
 
-    if (rrp->peers->single) {
+    if (rrp->peers->single || ngx_http_upstream_rr_peers_changed(rrp)) {
         return ngx_http_upstream_get_round_robin_peer(pc, rrp);
     }
 
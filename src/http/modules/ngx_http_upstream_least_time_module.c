@@ -0,0 +1,526 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_UPSTREAM_LEAST_TIME_HEADER     0
+#define NGX_HTTP_UPSTREAM_LEAST_TIME_LAST_BYTE  1
+
+
+/*
+ * the moving average of a server not used decays with this time constant,
+ * so that a server which was slow once is eventually tried again
+ */
+
+#define NGX_HTTP_UPSTREAM_LEAST_TIME_DECAY      10000
+
+
+typedef struct {
+    ngx_http_upstream_rr_peer_t  *peer;
+    ngx_uint_t                    range;
+} ngx_http_upstream_least_time_range_t;
+
+
+typedef struct {
+    ngx_uint_t                             mode;
+    ngx_http_upstream_least_time_range_t  *ranges;
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    ngx_uint_t                              config;
+#endif
+} ngx_http_upstream_least_time_srv_conf_t;
+
+
+typedef struct {
+    /* the round robin data must be first */
+    ngx_http_upstream_rr_peer_data_t          rrp;
+
+    ngx_http_upstream_least_time_srv_conf_t  *conf;
+    u_char                                    tries;
+} ngx_http_upstream_least_time_peer_data_t;
+
+
+static ngx_int_t ngx_http_upstream_init_least_time(ngx_conf_t *cf,
+    ngx_http_upstream_srv_conf_t *us);
+static ngx_int_t ngx_http_upstream_update_least_time(ngx_pool_t *pool,
+    ngx_http_upstream_srv_conf_t *us);
+
+static ngx_int_t ngx_http_upstream_init_least_time_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us);
+static ngx_int_t ngx_http_upstream_get_least_time_peer(
+    ngx_peer_connection_t *pc, void *data);
+static void ngx_http_upstream_free_least_time_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state);
+static ngx_uint_t ngx_http_upstream_peek_least_time_peer(
+    ngx_http_upstream_rr_peers_t *peers,
+    ngx_http_upstream_least_time_peer_data_t *ltp);
+static uint64_t ngx_http_upstream_least_time_ewma(
+    ngx_http_upstream_rr_peer_t *peer, ngx_msec_t now);
+static void *ngx_http_upstream_least_time_create_conf(ngx_conf_t *cf);
+static char *ngx_http_upstream_least_time(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
+static ngx_command_t  ngx_http_upstream_least_time_commands[] = {
+
+    { ngx_string("least_time"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_http_upstream_least_time,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_upstream_least_time_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    NULL,                                  /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_upstream_least_time_create_conf, /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_upstream_least_time_module = {
+    NGX_MODULE_V1,
+    &ngx_http_upstream_least_time_module_ctx, /* module context */
+    ngx_http_upstream_least_time_commands, /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_http_upstream_init_least_time(ngx_conf_t *cf,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cf->log, 0, "init least time");
+
+    if (ngx_http_upstream_init_round_robin(cf, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    us->peer.init = ngx_http_upstream_init_least_time_peer;
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (us->shm_zone) {
+        return NGX_OK;
+    }
+#endif
+
+    return ngx_http_upstream_update_least_time(cf->pool, us);
+}
+
+
+static ngx_int_t
+ngx_http_upstream_update_least_time(ngx_pool_t *pool,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    size_t                                    size;
+    ngx_uint_t                                i, total_weight;
+    ngx_http_upstream_rr_peer_t              *peer;
+    ngx_http_upstream_rr_peers_t             *peers;
+    ngx_http_upstream_least_time_range_t     *ranges;
+    ngx_http_upstream_least_time_srv_conf_t  *ltcf;
+
+    ltcf = ngx_http_conf_upstream_srv_conf(us,
+                                           ngx_http_upstream_least_time_module);
+
+    peers = us->peer.data;
+
+    size = peers->number * sizeof(ngx_http_upstream_least_time_range_t);
+
+    ranges = pool ? ngx_palloc(pool, size) : ngx_alloc(size, ngx_cycle->log);
+    if (ranges == NULL) {
+        return NGX_ERROR;
+    }
+
+    total_weight = 0;
+
+    for (peer = peers->peer, i = 0; peer; peer = peer->next, i++) {
+        ranges[i].peer = peer;
+        ranges[i].range = total_weight;
+        total_weight += peer->weight;
+    }
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (ltcf->ranges && pool == NULL) {
+        ngx_free(ltcf->ranges);
+    }
+
+    ltcf->config = peers->config ? *peers->config : 0;
+#endif
+
+    ltcf->ranges = ranges;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_init_least_time_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_http_upstream_least_time_srv_conf_t   *ltcf;
+    ngx_http_upstream_least_time_peer_data_t  *ltp;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "init least time peer");
+
+    ltcf = ngx_http_conf_upstream_srv_conf(us,
+                                           ngx_http_upstream_least_time_module);
+
+    ltp = ngx_palloc(r->pool, sizeof(ngx_http_upstream_least_time_peer_data_t));
+    if (ltp == NULL) {
+        return NGX_ERROR;
+    }
+
+    r->upstream->peer.data = &ltp->rrp;
+
+    if (ngx_http_upstream_init_round_robin_peer(r, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    r->upstream->peer.get = ngx_http_upstream_get_least_time_peer;
+    r->upstream->peer.free = ngx_http_upstream_free_least_time_peer;
+
+    ltp->conf = ltcf;
+    ltp->tries = 0;
+
+    ngx_http_upstream_rr_peers_rlock(ltp->rrp.peers);
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (ltp->rrp.peers->shpool
+        && (ltcf->ranges == NULL
+            || (ltp->rrp.peers->config
+                && ltcf->config != *ltp->rrp.peers->config)))
+    {
+        if (ngx_http_upstream_update_least_time(NULL, us) != NGX_OK) {
+            ngx_http_upstream_rr_peers_unlock(ltp->rrp.peers);
+            return NGX_ERROR;
+        }
+    }
+#endif
+
+    ngx_http_upstream_rr_peers_unlock(ltp->rrp.peers);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_get_least_time_peer(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_http_upstream_least_time_peer_data_t  *ltp = data;
+
+    time_t                             now;
+    uint64_t                           cost, prev_cost;
+    uintptr_t                          m;
+    ngx_uint_t                         i, n, p;
+    ngx_msec_t                         msec;
+    ngx_http_upstream_rr_peer_t       *peer, *prev;
+    ngx_http_upstream_rr_peers_t      *peers;
+    ngx_http_upstream_rr_peer_data_t  *rrp;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "get least time peer, try: %ui", pc->tries);
+
+    rrp = &ltp->rrp;
+    peers = rrp->peers;
+
+    ngx_http_upstream_rr_peers_wlock(peers);
+
+    if (ltp->tries > 20
+        || peers->single
+        || peers->number == 0
+        || ngx_http_upstream_rr_peers_changed(rrp))
+    {
+        ngx_http_upstream_rr_peers_unlock(peers);
+        return ngx_http_upstream_get_round_robin_peer(pc, rrp);
+    }
+
+    pc->cached = 0;
+    pc->connection = NULL;
+
+    now = ngx_time();
+    msec = ngx_current_msec;
+
+    prev = NULL;
+
+#if (NGX_SUPPRESS_WARN)
+    p = 0;
+    prev_cost = 0;
+#endif
+
+    /* the better of two servers chosen at random */
+
+    for ( ;; ) {
+
+        i = ngx_http_upstream_peek_least_time_peer(peers, ltp);
+
+        peer = ltp->conf->ranges[i].peer;
+
+        if (peer == prev) {
+            goto next;
+        }
+
+        n = i / (8 * sizeof(uintptr_t));
+        m = (uintptr_t) 1 << i % (8 * sizeof(uintptr_t));
+
+        if (rrp->tried[n] & m) {
+            goto next;
+        }
+
+        if (peer->down) {
+            goto next;
+        }
+
+        if (peer->max_fails
+            && peer->fails >= peer->max_fails
+            && now - peer->checked <= peer->fail_timeout)
+        {
+            goto next;
+        }
+
+        if (peer->max_conns && peer->conns >= peer->max_conns) {
+            goto next;
+        }
+
+        /* the expected time, with in-flight requests queued */
+
+        cost = (ngx_http_upstream_least_time_ewma(peer, msec) + 1)
+               * (peer->conns + 1);
+
+        if (prev) {
+            if (cost * prev->weight > prev_cost * peer->weight) {
+                peer = prev;
+                n = p / (8 * sizeof(uintptr_t));
+                m = (uintptr_t) 1 << p % (8 * sizeof(uintptr_t));
+            }
+
+            break;
+        }
+
+        prev = peer;
+        prev_cost = cost;
+        p = i;
+
+    next:
+
+        if (++ltp->tries > 20) {
+            ngx_http_upstream_rr_peers_unlock(peers);
+            return ngx_http_upstream_get_round_robin_peer(pc, rrp);
+        }
+    }
+
+    rrp->current = peer;
+
+    if (now - peer->checked > peer->fail_timeout) {
+        peer->checked = now;
+    }
+
+    pc->sockaddr = peer->sockaddr;
+    pc->socklen = peer->socklen;
+    pc->name = &peer->name;
+
+    peer->conns++;
+
+    ngx_http_upstream_rr_peers_unlock(peers);
+
+    rrp->tried[n] |= m;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_free_least_time_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state)
+{
+    ngx_http_upstream_least_time_peer_data_t  *ltp = data;
+
+    uint64_t                           cost, rtt;
+    ngx_msec_t                         time;
+    ngx_http_upstream_t               *u;
+    ngx_http_upstream_rr_peer_t       *peer;
+    ngx_http_upstream_rr_peer_data_t  *rrp;
+
+    rrp = &ltp->rrp;
+    peer = rrp->current;
+    u = rrp->upstream;
+
+    if (peer == NULL || pc->sockaddr == NULL || u == NULL || u->state == NULL) {
+        goto done;
+    }
+
+    if (ltp->conf->mode == NGX_HTTP_UPSTREAM_LEAST_TIME_HEADER) {
+        time = u->state->header_time;
+
+    } else {
+        time = u->state->response_time;
+    }
+
+    if (time == (ngx_msec_t) -1) {
+        time = ngx_current_msec - u->start_time;
+    }
+
+    rtt = (uint64_t) time * 1000;
+
+    ngx_http_upstream_rr_peers_rlock(rrp->peers);
+    ngx_http_upstream_rr_peer_lock(rrp->peers, peer);
+
+    cost = ngx_http_upstream_least_time_ewma(peer, ngx_current_msec);
+
+    /*
+     * peaks are taken immediately, while lower times are averaged in;
+     * a failed attempt may only raise the average
+     */
+
+    if (rtt > cost) {
+        peer->ewma = rtt;
+
+    } else if (!(state & NGX_PEER_FAILED)) {
+        peer->ewma = cost - (cost - rtt) / 8;
+
+    } else {
+        peer->ewma = cost;
+    }
+
+    peer->ewma_time = ngx_current_msec;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "free least time peer %V, time: %M, ewma: %ui",
+                   &peer->name, time, peer->ewma);
+
+    ngx_http_upstream_rr_peer_unlock(rrp->peers, peer);
+    ngx_http_upstream_rr_peers_unlock(rrp->peers);
+
+done:
+
+    ngx_http_upstream_free_round_robin_peer(pc, rrp, state);
+}
+
+
+static ngx_uint_t
+ngx_http_upstream_peek_least_time_peer(ngx_http_upstream_rr_peers_t *peers,
+    ngx_http_upstream_least_time_peer_data_t *ltp)
+{
+    ngx_uint_t  i, j, k, x;
+
+    x = ngx_random() % peers->total_weight;
+
+    i = 0;
+    j = peers->number;
+
+    while (j - i > 1) {
+        k = (i + j) / 2;
+
+        if (x < ltp->conf->ranges[k].range) {
+            j = k;
+
+        } else {
+            i = k;
+        }
+    }
+
+    return i;
+}
+
+
+static uint64_t
+ngx_http_upstream_least_time_ewma(ngx_http_upstream_rr_peer_t *peer,
+    ngx_msec_t now)
+{
+    if (peer->ewma == 0) {
+        return 0;
+    }
+
+    return (uint64_t) peer->ewma * NGX_HTTP_UPSTREAM_LEAST_TIME_DECAY
+           / (NGX_HTTP_UPSTREAM_LEAST_TIME_DECAY
+              + (ngx_msec_t) (now - peer->ewma_time));
+}
+
+
+static void *
+ngx_http_upstream_least_time_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_upstream_least_time_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool,
+                       sizeof(ngx_http_upstream_least_time_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->mode = NGX_HTTP_UPSTREAM_LEAST_TIME_HEADER;
+     *     conf->ranges = NULL;
+     */
+
+    return conf;
+}
+
+
+static char *
+ngx_http_upstream_least_time(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_upstream_least_time_srv_conf_t  *ltcf = conf;
+
+    ngx_str_t                     *value;
+    ngx_http_upstream_srv_conf_t  *uscf;
+
+    uscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_upstream_module);
+
+    if (uscf->peer.init_upstream) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "load balancing method redefined");
+    }
+
+    uscf->peer.init_upstream = ngx_http_upstream_init_least_time;
+
+    uscf->flags = NGX_HTTP_UPSTREAM_CREATE
+                  |NGX_HTTP_UPSTREAM_WEIGHT
+                  |NGX_HTTP_UPSTREAM_MAX_CONNS
+                  |NGX_HTTP_UPSTREAM_MAX_FAILS
+                  |NGX_HTTP_UPSTREAM_FAIL_TIMEOUT
+                  |NGX_HTTP_UPSTREAM_DOWN
+                  |NGX_HTTP_UPSTREAM_BACKUP;
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "header") == 0) {
+        ltcf->mode = NGX_HTTP_UPSTREAM_LEAST_TIME_HEADER;
+
+    } else if (ngx_strcmp(value[1].data, "last_byte") == 0) {
+        ltcf->mode = NGX_HTTP_UPSTREAM_LEAST_TIME_LAST_BYTE;
+
+    } else {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
@@ -10,6 +10,13 @@
 #include <ngx_http.h>
 
 
+typedef struct {
+    ngx_http_upstream_srv_conf_t   *uscf;
+    ngx_http_upstream_server_t     *server;
+    ngx_event_t                     event;
+} ngx_http_upstream_zone_host_t;
+
+
 static char *ngx_http_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static ngx_int_t ngx_http_upstream_init_zone(ngx_shm_zone_t *shm_zone,
@@ -18,6 +25,23 @@ static ngx_http_upstream_rr_peers_t *ngx_http_upstream_zone_copy_peers(
     ngx_slab_pool_t *shpool, ngx_http_upstream_srv_conf_t *uscf);
 static ngx_http_upstream_rr_peer_t *ngx_http_upstream_zone_copy_peer(
     ngx_http_upstream_rr_peers_t *peers, ngx_http_upstream_rr_peer_t *src);
+static ngx_int_t ngx_http_upstream_zone_init_stats(
+    ngx_http_upstream_rr_peers_t *peers, ngx_uint_t workers);
+static void ngx_http_upstream_zone_free_peer(
+    ngx_http_upstream_rr_peers_t *peers, ngx_http_upstream_rr_peer_t *peer);
+static char *ngx_http_upstream_zone_resolver(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+static char *ngx_http_upstream_zone_resolver_timeout(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+static ngx_int_t ngx_http_upstream_zone_time_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_upstream_zone_add_variables(ngx_conf_t *cf);
+static ngx_int_t ngx_http_upstream_zone_init(ngx_conf_t *cf);
+static ngx_int_t ngx_http_upstream_zone_init_worker(ngx_cycle_t *cycle);
+static void ngx_http_upstream_zone_resolve_timer(ngx_event_t *event);
+static void ngx_http_upstream_zone_resolve_handler(ngx_resolver_ctx_t *ctx);
+static ngx_int_t ngx_http_upstream_zone_update_peers(
+    ngx_http_upstream_zone_host_t *host, ngx_resolver_ctx_t *ctx);
 
 
 static ngx_command_t  ngx_http_upstream_zone_commands[] = {
@@ -29,13 +53,27 @@ static ngx_command_t  ngx_http_upstream_zone_commands[] = {
       0,
       NULL },
 
+    { ngx_string("resolver"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_1MORE,
+      ngx_http_upstream_zone_resolver,
+      0,
+      0,
+      NULL },
+
+    { ngx_string("resolver_timeout"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_http_upstream_zone_resolver_timeout,
+      0,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
 
 static ngx_http_module_t  ngx_http_upstream_zone_module_ctx = {
-    NULL,                                  /* preconfiguration */
-    NULL,                                  /* postconfiguration */
+    ngx_http_upstream_zone_add_variables,  /* preconfiguration */
+    ngx_http_upstream_zone_init,           /* postconfiguration */
 
     NULL,                                  /* create main configuration */
     NULL,                                  /* init main configuration */
@@ -55,7 +93,7 @@ ngx_module_t  ngx_http_upstream_zone_module = {
     NGX_HTTP_MODULE,                       /* module type */
     NULL,                                  /* init master */
     NULL,                                  /* init module */
-    NULL,                                  /* init process */
+    ngx_http_upstream_zone_init_worker,    /* init process */
     NULL,                                  /* init thread */
     NULL,                                  /* exit thread */
     NULL,                                  /* exit process */
@@ -64,6 +102,63 @@ ngx_module_t  ngx_http_upstream_zone_module = {
 };
 
 
+/* the quantile is in thousandths */
+
+#define ngx_http_upstream_zone_time(field, q)                                 \
+    (offsetof(ngx_http_upstream_rr_peer_stats_t, field) * 1000 + q)
+
+
+static ngx_http_variable_t  ngx_http_upstream_zone_vars[] = {
+
+    { ngx_string("upstream_connect_time_p50"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(connect_time, 500),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_connect_time_p99"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(connect_time, 990),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_connect_time_p999"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(connect_time, 999),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_header_time_p50"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(header_time, 500),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_header_time_p99"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(header_time, 990),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_header_time_p999"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(header_time, 999),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_response_time_p50"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(response_time, 500),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_response_time_p99"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(response_time, 990),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("upstream_response_time_p999"), NULL,
+      ngx_http_upstream_zone_time_variable,
+      ngx_http_upstream_zone_time(response_time, 999),
+      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+      ngx_http_null_variable
+};
+
+
 static char *
 ngx_http_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -215,6 +310,11 @@ ngx_http_upstream_zone_copy_peers(ngx_slab_pool_t *shpool,
 
     peers->shpool = shpool;
 
+    peers->config = ngx_slab_calloc(shpool, sizeof(ngx_uint_t));
+    if (peers->config == NULL) {
+        return NULL;
+    }
+
     for (peerp = &peers->peer; *peerp; peerp = &peer->next) {
         /* pool is unlocked */
         peer = ngx_http_upstream_zone_copy_peer(peers, *peerp);
@@ -239,6 +339,7 @@ ngx_http_upstream_zone_copy_peers(ngx_slab_pool_t *shpool,
     backup->name = name;
 
     backup->shpool = shpool;
+    backup->config = peers->config;
 
     for (peerp = &backup->peer; *peerp; peerp = &peer->next) {
         /* pool is unlocked */
@@ -279,6 +380,7 @@ ngx_http_upstream_zone_copy_peer(ngx_http_upstream_rr_peers_t *peers,
         dst->sockaddr = NULL;
         dst->name.data = NULL;
         dst->server.data = NULL;
+        dst->stats = NULL;
     }
 
     dst->sockaddr = ngx_slab_calloc_locked(pool, sizeof(ngx_sockaddr_t));
@@ -291,6 +393,14 @@ ngx_http_upstream_zone_copy_peer(ngx_http_upstream_rr_peers_t *peers,
         goto failed;
     }
 
+    if (peers->workers) {
+        dst->stats = ngx_slab_calloc_locked(pool,
+                               ngx_http_upstream_rr_stats_size(peers->workers));
+        if (dst->stats == NULL) {
+            goto failed;
+        }
+    }
+
     if (src) {
         ngx_memcpy(dst->sockaddr, src->sockaddr, src->socklen);
         ngx_memcpy(dst->name.data, src->name.data, src->name.len);
@@ -307,6 +417,10 @@ ngx_http_upstream_zone_copy_peer(ngx_http_upstream_rr_peers_t *peers,
 
 failed:
 
+    if (dst->stats) {
+        ngx_slab_free_locked(pool, dst->stats);
+    }
+
     if (dst->server.data) {
         ngx_slab_free_locked(pool, dst->server.data);
     }
@@ -323,3 +437,632 @@ failed:
 
     return NULL;
 }
+
+
+static ngx_int_t
+ngx_http_upstream_zone_init_stats(ngx_http_upstream_rr_peers_t *peers,
+    ngx_uint_t workers)
+{
+    size_t                         size;
+    ngx_http_upstream_rr_peer_t   *peer;
+    ngx_http_upstream_rr_peers_t  *backup;
+
+    if (peers->workers || peers->stats) {
+        return NGX_OK;
+    }
+
+    size = ngx_http_upstream_rr_stats_size(workers);
+
+    peers->stats = ngx_slab_calloc_locked(peers->shpool, size);
+    if (peers->stats == NULL) {
+        return NGX_ERROR;
+    }
+
+    backup = peers->next;
+
+    if (backup) {
+        backup->stats = peers->stats;
+    }
+
+    for ( /* void */ ; peers; peers = peers->next) {
+
+        for (peer = peers->peer; peer; peer = peer->next) {
+            peer->stats = ngx_slab_calloc_locked(peers->shpool, size);
+            if (peer->stats == NULL) {
+                return NGX_ERROR;
+            }
+        }
+
+        peers->workers = workers;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_zone_free_peer(ngx_http_upstream_rr_peers_t *peers,
+    ngx_http_upstream_rr_peer_t *peer)
+{
+    ngx_slab_pool_t  *pool;
+
+    pool = peers->shpool;
+
+    if (peer->stats) {
+        ngx_slab_free_locked(pool, peer->stats);
+    }
+
+#if (NGX_HTTP_SSL)
+    if (peer->ssl_session) {
+        ngx_slab_free_locked(pool, peer->ssl_session);
+    }
+#endif
+
+    if (peer->server.data) {
+        ngx_slab_free_locked(pool, peer->server.data);
+    }
+
+    ngx_slab_free_locked(pool, peer->name.data);
+    ngx_slab_free_locked(pool, peer->sockaddr);
+    ngx_slab_free_locked(pool, peer);
+}
+
+
+static char *
+ngx_http_upstream_zone_resolver(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_str_t                     *value;
+    ngx_http_upstream_srv_conf_t  *uscf;
+
+    uscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_upstream_module);
+
+    if (uscf->resolver) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    uscf->resolver = ngx_resolver_create(cf, &value[1], cf->args->nelts - 1);
+    if (uscf->resolver == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_upstream_zone_resolver_timeout(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf)
+{
+    ngx_msec_t                     timeout;
+    ngx_str_t                     *value;
+    ngx_http_upstream_srv_conf_t  *uscf;
+
+    uscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_upstream_module);
+
+    if (uscf->resolver_timeout) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    timeout = ngx_parse_time(&value[1], 0);
+
+    if (timeout == (ngx_msec_t) NGX_ERROR || timeout == 0) {
+        return "invalid value";
+    }
+
+    uscf->resolver_timeout = timeout;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_zone_time_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char                             *p;
+    ngx_msec_t                          ms;
+    ngx_histogram_t                    *h;
+    ngx_http_upstream_srv_conf_t       *uscf;
+    ngx_http_upstream_rr_peers_t       *peers;
+    ngx_http_upstream_rr_peer_stats_t  *stats;
+
+    if (r->upstream == NULL || r->upstream->upstream == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    uscf = r->upstream->upstream;
+
+    if (uscf->shm_zone == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    peers = uscf->peer.data;
+
+    if (peers->stats == NULL) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    /* histograms of the whole upstream are shared by worker processes */
+
+    stats = peers->stats;
+
+    h = (ngx_histogram_t *) ((u_char *) stats + data / 1000);
+
+    ms = ngx_histogram_quantile(h, data % 1000);
+
+    p = ngx_pnalloc(r->pool, NGX_TIME_T_LEN + 4);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    v->len = ngx_sprintf(p, "%T.%03M", (time_t) ms / 1000, ms % 1000) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_zone_add_variables(ngx_conf_t *cf)
+{
+    ngx_http_variable_t  *var, *v;
+
+    for (v = ngx_http_upstream_zone_vars; v->name.len; v++) {
+        var = ngx_http_add_variable(cf, &v->name, v->flags);
+        if (var == NULL) {
+            return NGX_ERROR;
+        }
+
+        var->get_handler = v->get_handler;
+        var->data = v->data;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_zone_init(ngx_conf_t *cf)
+{
+    ngx_uint_t                      i, j;
+    ngx_http_core_loc_conf_t       *clcf;
+    ngx_http_upstream_server_t     *server;
+    ngx_http_upstream_srv_conf_t   *uscf, **uscfp;
+    ngx_http_upstream_main_conf_t  *umcf;
+
+    umcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_upstream_module);
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->shm_zone == NULL || uscf->servers == NULL) {
+            continue;
+        }
+
+        server = uscf->servers->elts;
+
+        for (j = 0; j < uscf->servers->nelts; j++) {
+            if (server[j].resolve) {
+                break;
+            }
+        }
+
+        if (j == uscf->servers->nelts) {
+            continue;
+        }
+
+        if (uscf->resolver == NULL) {
+            uscf->resolver = clcf->resolver;
+        }
+
+        if (uscf->resolver == NULL
+            || uscf->resolver->connections.nelts == 0)
+        {
+            ngx_log_error(NGX_LOG_EMERG, cf->log, 0,
+                          "no resolver defined to resolve names at run time "
+                          "in upstream \"%V\" in %s:%ui",
+                          &uscf->host, uscf->file_name, uscf->line);
+            return NGX_ERROR;
+        }
+
+        if (uscf->resolver_timeout == 0) {
+            uscf->resolver_timeout =
+                            (clcf->resolver_timeout != NGX_CONF_UNSET_MSEC)
+                            ? clcf->resolver_timeout : 30000;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_zone_init_worker(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                      i, j, workers;
+    ngx_event_t                    *event;
+    ngx_core_conf_t                *ccf;
+    ngx_slab_pool_t                *shpool;
+    ngx_http_upstream_server_t     *server;
+    ngx_http_upstream_zone_host_t  *host;
+    ngx_http_upstream_rr_peers_t   *peers;
+    ngx_http_upstream_srv_conf_t   *uscf, **uscfp;
+    ngx_http_upstream_main_conf_t  *umcf;
+
+    if (ngx_process != NGX_PROCESS_SINGLE
+        && ngx_process != NGX_PROCESS_WORKER)
+    {
+        return NGX_OK;
+    }
+
+    umcf = ngx_http_cycle_get_module_main_conf(cycle,
+                                               ngx_http_upstream_module);
+    if (umcf == NULL) {
+        return NGX_OK;
+    }
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    workers = (ngx_process == NGX_PROCESS_SINGLE) ? 1
+                                                  : ccf->worker_processes;
+
+    uscfp = umcf->upstreams.elts;
+
+    /*
+     * the number of worker processes is not known when the zone
+     * is initialized, so statistics are allocated by the first worker
+     */
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->shm_zone == NULL) {
+            continue;
+        }
+
+        peers = uscf->peer.data;
+        shpool = peers->shpool;
+
+        ngx_shmtx_lock(&shpool->mutex);
+
+        if (ngx_http_upstream_zone_init_stats(peers, workers) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ERR, cycle->log, 0,
+                          "could not allocate statistics of "
+                          "upstream \"%V\"%s, zone size should be increased",
+                          &uscf->host, shpool->log_ctx);
+        }
+
+        ngx_shmtx_unlock(&shpool->mutex);
+    }
+
+    /* names are resolved by a single worker process */
+
+    if (ngx_process == NGX_PROCESS_WORKER && ngx_worker != 0) {
+        return NGX_OK;
+    }
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->shm_zone == NULL || uscf->servers == NULL) {
+            continue;
+        }
+
+        server = uscf->servers->elts;
+
+        for (j = 0; j < uscf->servers->nelts; j++) {
+
+            if (!server[j].resolve) {
+                continue;
+            }
+
+            host = ngx_pcalloc(cycle->pool,
+                               sizeof(ngx_http_upstream_zone_host_t));
+            if (host == NULL) {
+                return NGX_ERROR;
+            }
+
+            host->uscf = uscf;
+            host->server = &server[j];
+
+            event = &host->event;
+
+            event->handler = ngx_http_upstream_zone_resolve_timer;
+            event->data = host;
+            event->log = cycle->log;
+            event->cancelable = 1;
+
+            ngx_add_timer(event, 1);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_zone_resolve_timer(ngx_event_t *event)
+{
+    ngx_resolver_ctx_t             *ctx;
+    ngx_http_upstream_zone_host_t  *host;
+
+    host = event->data;
+
+    ctx = ngx_resolve_start(host->uscf->resolver, NULL);
+    if (ctx == NULL) {
+        goto retry;
+    }
+
+    if (ctx == NGX_NO_RESOLVER) {
+        ngx_log_error(NGX_LOG_ERR, event->log, 0,
+                      "no resolver defined to resolve %V",
+                      &host->server->host);
+        return;
+    }
+
+    ctx->name = host->server->host;
+    ctx->handler = ngx_http_upstream_zone_resolve_handler;
+    ctx->data = host;
+    ctx->timeout = host->uscf->resolver_timeout;
+    ctx->cancelable = 1;
+
+    if (ngx_resolve_name(ctx) == NGX_OK) {
+        return;
+    }
+
+retry:
+
+    ngx_add_timer(event, 1000);
+}
+
+
+static void
+ngx_http_upstream_zone_resolve_handler(ngx_resolver_ctx_t *ctx)
+{
+    time_t                          valid;
+    ngx_msec_t                      timer;
+    ngx_event_t                    *event;
+    ngx_http_upstream_zone_host_t  *host;
+
+    host = ctx->data;
+    event = &host->event;
+    valid = ctx->valid;
+
+    if (ctx->state) {
+        ngx_log_error(NGX_LOG_ERR, event->log, 0,
+                      "%V could not be resolved (%i: %s) in upstream \"%V\"",
+                      &ctx->name, ctx->state,
+                      ngx_resolver_strerror(ctx->state),
+                      &host->uscf->host);
+
+    } else if (ngx_http_upstream_zone_update_peers(host, ctx) != NGX_OK) {
+        /* the list of peers is incomplete, retry soon */
+        valid = 0;
+    }
+
+    ngx_resolve_name_done(ctx);
+
+    /* re-resolve when the answer expires, but not more often than 1s */
+
+    if (valid > ngx_time()) {
+        timer = (ngx_msec_t) (valid - ngx_time()) * 1000;
+
+    } else {
+        timer = 1000;
+    }
+
+    ngx_add_timer(event, timer);
+}
+
+
+static ngx_int_t
+ngx_http_upstream_zone_update_peers(ngx_http_upstream_zone_host_t *host,
+    ngx_resolver_ctx_t *ctx)
+{
+    ngx_int_t                      rc;
+    ngx_uint_t                     i, n, w, t, changed;
+    ngx_sockaddr_t                 sockaddr;
+    ngx_slab_pool_t               *shpool;
+    ngx_resolver_addr_t           *addr;
+    ngx_http_upstream_server_t    *server;
+    ngx_http_upstream_rr_peer_t   *peer, **peerp;
+    ngx_http_upstream_rr_peers_t  *primary, *peers;
+
+    server = host->server;
+
+    primary = host->uscf->peer.data;
+    peers = server->backup ? primary->next : primary;
+
+    shpool = peers->shpool;
+    changed = 0;
+    rc = NGX_OK;
+
+    /* changes of backup peers are also serialized by the primary lock */
+
+    ngx_http_upstream_rr_peers_wlock(primary);
+
+    if (peers != primary) {
+        ngx_http_upstream_rr_peers_wlock(peers);
+    }
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    /* free removed peers no longer in use */
+
+    for (peerp = &peers->zombies; *peerp; /* void */ ) {
+        peer = *peerp;
+
+        if (peer->conns) {
+            peerp = &peer->next;
+            continue;
+        }
+
+        *peerp = peer->next;
+
+        ngx_http_upstream_zone_free_peer(peers, peer);
+    }
+
+    /* remove peers with addresses which are no longer resolved */
+
+    for (peerp = &peers->peer; *peerp; /* void */ ) {
+        peer = *peerp;
+
+        if (peer->host != server) {
+            peerp = &peer->next;
+            continue;
+        }
+
+        for (i = 0; i < ctx->naddrs; i++) {
+            addr = &ctx->addrs[i];
+
+            ngx_memcpy(&sockaddr, addr->sockaddr, addr->socklen);
+            ngx_inet_set_port(&sockaddr.sockaddr, server->port);
+
+            if (ngx_cmp_sockaddr(peer->sockaddr, peer->socklen,
+                                 &sockaddr.sockaddr, addr->socklen, 1)
+                == NGX_OK)
+            {
+                break;
+            }
+        }
+
+        if (i < ctx->naddrs) {
+            peerp = &peer->next;
+            continue;
+        }
+
+        ngx_log_error(NGX_LOG_NOTICE, host->event.log, 0,
+                      "upstream \"%V\": server %V removed, "
+                      "%V no longer resolves to it",
+                      &host->uscf->host, &peer->name, &ctx->name);
+
+        *peerp = peer->next;
+        changed = 1;
+
+        if (peer->conns) {
+            /* in use by requests, freed later */
+            peer->next = peers->zombies;
+            peers->zombies = peer;
+            continue;
+        }
+
+        ngx_http_upstream_zone_free_peer(peers, peer);
+    }
+
+    /* add peers for new addresses */
+
+    for (i = 0; i < ctx->naddrs; i++) {
+        addr = &ctx->addrs[i];
+
+        ngx_memcpy(&sockaddr, addr->sockaddr, addr->socklen);
+        ngx_inet_set_port(&sockaddr.sockaddr, server->port);
+
+        for (peerp = &peers->peer; *peerp; peerp = &peer->next) {
+            peer = *peerp;
+
+            if (peer->host == server
+                && ngx_cmp_sockaddr(peer->sockaddr, peer->socklen,
+                                    &sockaddr.sockaddr, addr->socklen, 1)
+                   == NGX_OK)
+            {
+                break;
+            }
+        }
+
+        if (*peerp) {
+            continue;
+        }
+
+        peer = ngx_http_upstream_zone_copy_peer(peers, NULL);
+        if (peer == NULL) {
+            rc = NGX_ERROR;
+            break;
+        }
+
+        peer->server.data = ngx_slab_alloc_locked(shpool, server->name.len);
+        if (peer->server.data == NULL) {
+            ngx_http_upstream_zone_free_peer(peers, peer);
+            rc = NGX_ERROR;
+            break;
+        }
+
+        ngx_memcpy(peer->server.data, server->name.data, server->name.len);
+        peer->server.len = server->name.len;
+
+        ngx_memcpy(peer->sockaddr, &sockaddr, addr->socklen);
+        peer->socklen = addr->socklen;
+
+        peer->name.len = ngx_sock_ntop(peer->sockaddr, peer->socklen,
+                                       peer->name.data, NGX_SOCKADDR_STRLEN,
+                                       1);
+
+        peer->weight = server->weight;
+        peer->effective_weight = server->weight;
+        peer->max_conns = server->max_conns;
+        peer->max_fails = server->max_fails;
+        peer->fail_timeout = server->fail_timeout;
+        peer->down = server->down;
+        peer->host = server;
+
+        *peerp = peer;
+        changed = 1;
+
+        ngx_log_error(NGX_LOG_NOTICE, host->event.log, 0,
+                      "upstream \"%V\": server %V added, resolved from %V",
+                      &host->uscf->host, &peer->name, &ctx->name);
+    }
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    if (rc != NGX_OK) {
+        ngx_log_error(NGX_LOG_ERR, host->event.log, 0,
+                      "upstream \"%V\": could not add servers "
+                      "resolved from %V, no memory in upstream zone",
+                      &host->uscf->host, &ctx->name);
+    }
+
+    if (changed) {
+        n = 0;
+        w = 0;
+        t = 0;
+
+        for (peer = peers->peer; peer; peer = peer->next) {
+            n++;
+            w += peer->weight;
+
+            if (!peer->down) {
+                t++;
+            }
+        }
+
+        peers->number = n;
+        peers->total_weight = w;
+        peers->weighted = (w != n);
+        peers->tries = t;
+        peers->single = (n == 1 && peers == primary && primary->next == NULL);
+
+        (*peers->config)++;
+    }
+
+    if (peers != primary) {
+        ngx_http_upstream_rr_peers_unlock(peers);
+    }
+
+    ngx_http_upstream_rr_peers_unlock(primary);
+
+    return rc;
+}
@@ -24,11 +24,27 @@
 #define NGX_HTTP_CACHE_SCARCE        8
 
 #define NGX_HTTP_CACHE_KEY_LEN       16
+
 #define NGX_HTTP_CACHE_ETAG_LEN      128
 #define NGX_HTTP_CACHE_VARY_LEN      128
 
+#define NGX_HTTP_CACHE_WAIT_MIN      5
+#define NGX_HTTP_CACHE_WAIT_MAX      100
+
+#define NGX_HTTP_CACHE_SNAPSHOT_NODES  4096
+
+#define NGX_HTTP_CACHE_SKETCH_ROWS   4
+#define NGX_HTTP_CACHE_SKETCH_MAX    15
+#define NGX_HTTP_CACHE_SKETCH_SLICE  64
+
 #define NGX_HTTP_CACHE_VERSION       5
 
+#define NGX_HTTP_CACHE_MD5           0
+#define NGX_HTTP_CACHE_MURMUR3       1
+
+/* the key hash is kept in the high bits of the cache file version */
+#define NGX_HTTP_CACHE_VERSION_HASH  0x100
+
 
 typedef struct {
     ngx_uint_t                       status;
@@ -51,7 +67,8 @@ typedef struct {
     unsigned                         updating:1;
     unsigned                         deleting:1;
     unsigned                         purged:1;
-                                     /* 10 unused bits */
+    unsigned                         hot:1;
+                                     /* 9 unused bits */
 
     ngx_file_uniq_t                  uniq;
     time_t                           expire;
@@ -62,6 +79,19 @@ typedef struct {
 } ngx_http_file_cache_node_t;
 
 
+typedef struct {
+    ngx_rbtree_node_t                node;
+    ngx_queue_t                      queue;
+
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN
+                                         - sizeof(ngx_rbtree_key_t)];
+
+    ngx_file_uniq_t                  uniq;
+    size_t                           len;
+    u_char                           data[1];
+} ngx_http_file_cache_memory_node_t;
+
+
 struct ngx_http_cache_s {
     ngx_file_t                       file;
     ngx_array_t                      keys;
@@ -106,6 +136,7 @@ struct ngx_http_cache_s {
     ngx_msec_t                       wait_time;
 
     ngx_event_t                      wait_event;
+    ngx_queue_t                      wait_queue;
 
     unsigned                         lock:1;
     unsigned                         waiting:1;
@@ -122,6 +153,8 @@ struct ngx_http_cache_s {
 
     unsigned                         stale_updating:1;
     unsigned                         stale_error:1;
+
+    unsigned                         memory:1;
 };
 
 
@@ -153,9 +186,44 @@ typedef struct {
     off_t                            size;
     ngx_uint_t                       count;
     ngx_uint_t                       watermark;
+    time_t                           snapshot_time;
+    ngx_uint_t                       hot;
+    u_char                          *sketch;
+    ngx_uint_t                       sketch_mask;
+    ngx_uint_t                       sketch_adds;
+    ngx_uint_t                       sketch_age;
+    ngx_uint_t                       evicted;
+    off_t                            evicted_size;
+    ngx_uint_t                       backlog;
 } ngx_http_file_cache_sh_t;
 
 
+typedef struct {
+    ngx_rbtree_t                     rbtree;
+    ngx_rbtree_node_t                sentinel;
+    ngx_queue_t                      queue;
+    size_t                           size;
+    ngx_uint_t                       count;
+} ngx_http_file_cache_memory_sh_t;
+
+
+typedef struct {
+    ngx_uint_t                       version;
+    size_t                           node_size;
+    time_t                           time;
+    ngx_uint_t                       count;
+    u_char                           level[NGX_MAX_PATH_LEVEL];
+} ngx_http_file_cache_snapshot_header_t;
+
+
+typedef struct {
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN];
+    ngx_file_uniq_t                  uniq;
+    off_t                            fs_size;
+    size_t                           body_start;
+} ngx_http_file_cache_snapshot_node_t;
+
+
 struct ngx_http_file_cache_s {
     ngx_http_file_cache_sh_t        *sh;
     ngx_slab_pool_t                 *shpool;
@@ -180,13 +248,42 @@ struct ngx_http_file_cache_s {
     ngx_msec_t                       manager_sleep;
     ngx_msec_t                       manager_threshold;
 
+    ngx_uint_t                       manager_rate;
+    off_t                            manager_bandwidth;
+    ngx_int_t                        budget_files;
+    off_t                            budget_size;
+    ngx_msec_t                       budget_time;
+
+#if (NGX_THREADS)
+    ngx_thread_pool_t               *thread_pool;
+    ngx_uint_t                       backlog;
+#endif
+
+    time_t                           snapshot;
+    time_t                           snapshot_last;
+    ngx_str_t                        snapshot_name;
+
     ngx_shm_zone_t                  *shm_zone;
 
+    ngx_http_file_cache_memory_sh_t *memory;
+    ngx_slab_pool_t                 *memory_shpool;
+    size_t                           memory_max_size;
+
+    ngx_queue_t                      waiters;
+
+    ngx_uint_t                       tinylfu;
+
+    ngx_uint_t                       key_hash;
+    uint32_t                         key_seed;
+    ngx_str_t                        key_seed_name;
+    ngx_uint_t                       version;
+
     ngx_uint_t                       use_temp_path;
                                      /* unsigned use_temp_path:1 */
 };
 
 
+ngx_int_t ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data);
 ngx_int_t ngx_http_file_cache_new(ngx_http_request_t *r);
 ngx_int_t ngx_http_file_cache_create(ngx_http_request_t *r);
 void ngx_http_file_cache_create_key(ngx_http_request_t *r);
@@ -11,11 +11,43 @@
 #include <ngx_md5.h>
 
 
+typedef struct {
+    ngx_uint_t                       type;
+    union {
+        ngx_md5_t                    md5;
+        ngx_murmur_hash3_128_t       murmur3;
+    } u;
+} ngx_http_file_cache_hash_t;
+
+
+#if (NGX_THREADS)
+
+typedef struct {
+    ngx_http_file_cache_t           *cache;
+    u_char                          *name;
+    ngx_err_t                        err;
+} ngx_http_file_cache_unlink_ctx_t;
+
+#endif
+
+
+static ngx_int_t ngx_http_file_cache_key_seed(ngx_http_file_cache_t *cache,
+    ngx_log_t *log);
+static void ngx_http_file_cache_hash_init(ngx_http_file_cache_hash_t *hash,
+    ngx_http_file_cache_t *cache);
+static void ngx_http_file_cache_hash_update(ngx_http_file_cache_hash_t *hash,
+    u_char *data, size_t len);
+static void ngx_http_file_cache_hash_final(u_char *result,
+    ngx_http_file_cache_hash_t *hash);
 static ngx_int_t ngx_http_file_cache_lock(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static void ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev);
 static void ngx_http_file_cache_lock_wait(ngx_http_request_t *r,
     ngx_http_cache_t *c);
+static ngx_msec_t ngx_http_file_cache_lock_interval(ngx_http_cache_t *c,
+    ngx_msec_t timer);
+static void ngx_http_file_cache_lock_wakeup(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_node_t *fcn);
 static ngx_int_t ngx_http_file_cache_read(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static ssize_t ngx_http_file_cache_aio_read(ngx_http_request_t *r,
@@ -34,12 +66,36 @@ static ngx_int_t ngx_http_file_cache_name(ngx_http_request_t *r,
     ngx_path_t *path);
 static ngx_http_file_cache_node_t *
     ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key);
+static ngx_http_file_cache_node_t *
+    ngx_http_file_cache_lookup_next(ngx_http_file_cache_t *cache,
+    u_char *key);
 static void ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+static void ngx_http_file_cache_sketch_init(ngx_http_file_cache_t *cache,
+    size_t size);
+static void ngx_http_file_cache_sketch_add(ngx_http_file_cache_t *cache,
+    u_char *key);
+static ngx_uint_t ngx_http_file_cache_sketch_estimate(
+    ngx_http_file_cache_t *cache, u_char *key);
+static ngx_int_t ngx_http_file_cache_admit(ngx_http_file_cache_t *cache,
+    u_char *key);
+static ngx_int_t ngx_http_file_cache_memory_init(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_int_t ngx_http_file_cache_memory_read(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static void ngx_http_file_cache_memory_store(ngx_http_file_cache_t *cache,
+    ngx_http_cache_t *c);
+static void ngx_http_file_cache_memory_delete(ngx_http_file_cache_t *cache,
+    u_char *key);
+static ngx_http_file_cache_memory_node_t *
+    ngx_http_file_cache_memory_lookup(ngx_http_file_cache_t *cache,
+    u_char *key);
+static void ngx_http_file_cache_memory_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 static void ngx_http_file_cache_vary(ngx_http_request_t *r, u_char *vary,
     size_t len, u_char *hash);
 static void ngx_http_file_cache_vary_header(ngx_http_request_t *r,
-    ngx_md5_t *md5, ngx_str_t *name);
+    ngx_http_file_cache_hash_t *hash, ngx_str_t *name);
 static ngx_int_t ngx_http_file_cache_reopen(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_update_variant(ngx_http_request_t *r,
@@ -49,6 +105,16 @@ static time_t ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache);
 static time_t ngx_http_file_cache_expire(ngx_http_file_cache_t *cache);
 static void ngx_http_file_cache_delete(ngx_http_file_cache_t *cache,
     ngx_queue_t *q, u_char *name);
+static void ngx_http_file_cache_unlink(ngx_http_file_cache_t *cache,
+    u_char *name);
+#if (NGX_THREADS)
+static void ngx_http_file_cache_unlink_thread(void *data, ngx_log_t *log);
+static void ngx_http_file_cache_unlink_handler(ngx_event_t *ev);
+#endif
+static ngx_int_t ngx_http_file_cache_manager_budget(
+    ngx_http_file_cache_t *cache);
+static void ngx_http_file_cache_snapshot(ngx_http_file_cache_t *cache);
+static void ngx_http_file_cache_snapshot_load(ngx_http_file_cache_t *cache);
 static void ngx_http_file_cache_loader_sleep(ngx_http_file_cache_t *cache);
 static ngx_int_t ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
@@ -79,7 +145,7 @@ ngx_str_t  ngx_http_cache_status[] = {
 static u_char  ngx_http_file_cache_key[] = { LF, 'K', 'E', 'Y', ':', ' ' };
 
 
-static ngx_int_t
+ngx_int_t
 ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
     ngx_http_file_cache_t  *ocache = data;
@@ -90,6 +156,12 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache = shm_zone->data;
 
+    if (cache->key_hash == NGX_HTTP_CACHE_MURMUR3
+        && ngx_http_file_cache_key_seed(cache, shm_zone->shm.log) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
     if (ocache) {
         if (ngx_strcmp(cache->path->name.data, ocache->path->name.data) != 0) {
             ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
@@ -121,6 +193,10 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
             cache->path->loader = NULL;
         }
 
+        if (cache->tinylfu && cache->sh->sketch == NULL) {
+            ngx_http_file_cache_sketch_init(cache, shm_zone->shm.size);
+        }
+
         return NGX_OK;
     }
 
@@ -151,6 +227,15 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
     cache->sh->size = 0;
     cache->sh->count = 0;
     cache->sh->watermark = (ngx_uint_t) -1;
+    cache->sh->snapshot_time = 0;
+    cache->sh->hot = 0;
+    cache->sh->sketch = NULL;
+    cache->sh->sketch_mask = 0;
+    cache->sh->sketch_adds = 0;
+    cache->sh->sketch_age = 0;
+    cache->sh->evicted = 0;
+    cache->sh->evicted_size = 0;
+    cache->sh->backlog = 0;
 
     cache->bsize = ngx_fs_bsize(cache->path->name.data);
 
@@ -168,6 +253,322 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache->shpool->log_nomem = 0;
 
+    if (cache->tinylfu) {
+        ngx_http_file_cache_sketch_init(cache, shm_zone->shm.size);
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * MurmurHash3 is not a cryptographic hash, so with a known seed one could
+ * construct many cache keys with the same hash; hence the seed is random,
+ * and it is kept in the cache directory, as the file names depend on it
+ */
+
+static ngx_int_t
+ngx_http_file_cache_key_seed(ngx_http_file_cache_t *cache, ngx_log_t *log)
+{
+    u_char     *name;
+    ssize_t     n;
+    ngx_fd_t    fd;
+    ngx_int_t   hi, lo;
+    u_char      buf[8];
+
+    name = cache->key_seed_name.data;
+
+    fd = ngx_open_file(name, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd != NGX_INVALID_FILE) {
+        n = ngx_read_fd(fd, buf, 8);
+
+        if (n == -1) {
+            ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                          ngx_read_fd_n " \"%s\" failed", name);
+        }
+
+        if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          ngx_close_file_n " \"%s\" failed", name);
+        }
+
+        if (n == -1) {
+            return NGX_ERROR;
+        }
+
+        hi = (n == 8) ? ngx_hextoi(buf, 4) : NGX_ERROR;
+        lo = (n == 8) ? ngx_hextoi(buf + 4, 4) : NGX_ERROR;
+
+        if (hi != NGX_ERROR && lo != NGX_ERROR) {
+            cache->key_seed = (uint32_t) hi << 16 | (uint32_t) lo;
+            return NGX_OK;
+        }
+
+        ngx_log_error(NGX_LOG_WARN, log, 0,
+                      "cache key seed \"%s\" is invalid, recreated", name);
+
+    } else if (ngx_errno != NGX_ENOENT) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", name);
+        return NGX_ERROR;
+    }
+
+    cache->key_seed = (uint32_t) (ngx_random() ^ (ngx_random() << 16));
+
+    (void) ngx_sprintf(buf, "%08xD", cache->key_seed);
+
+    fd = ngx_open_file(name, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                       NGX_FILE_DEFAULT_ACCESS);
+
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", name);
+        return NGX_ERROR;
+    }
+
+    n = ngx_write_fd(fd, buf, 8);
+
+    if (n != 8) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_write_fd_n " \"%s\" failed", name);
+    }
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", name);
+    }
+
+    return (n == 8) ? NGX_OK : NGX_ERROR;
+}
+
+
+/*
+ * the frequency sketch is a count-min sketch with 4 rows of byte-sized
+ * counters saturating at 15, one counter per node that fits into the keys
+ * zone in each row; the counters are halved after 10 increments per counter
+ * on average, so the estimates reflect recent popularity; the halving is
+ * done in slices by subsequent additions to keep the keys zone lock hold
+ * time short
+ */
+
+static void
+ngx_http_file_cache_sketch_init(ngx_http_file_cache_t *cache, size_t size)
+{
+    ngx_uint_t  n, width;
+
+    n = size / sizeof(ngx_http_file_cache_node_t);
+
+    for (width = 64; width < n; width <<= 1) { /* void */ }
+
+    cache->sh->sketch = ngx_slab_calloc(cache->shpool,
+                                        NGX_HTTP_CACHE_SKETCH_ROWS * width);
+    if (cache->sh->sketch == NULL) {
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "could not allocate frequency sketch%s, "
+                      "cache admission is disabled", cache->shpool->log_ctx);
+        return;
+    }
+
+    cache->sh->sketch_mask = width - 1;
+    cache->sh->sketch_adds = 0;
+    cache->sh->sketch_age = 0;
+}
+
+
+static void
+ngx_http_file_cache_sketch_add(ngx_http_file_cache_t *cache, u_char *key)
+{
+    u_char                    *p;
+    uint32_t                   hash[NGX_HTTP_CACHE_SKETCH_ROWS];
+    ngx_uint_t                 i, n, width;
+    ngx_http_file_cache_sh_t  *sh;
+
+    sh = cache->sh;
+
+    if (sh->sketch == NULL) {
+        return;
+    }
+
+    /*
+     * the key is an MD5 or MurmurHash3 128-bit hash,
+     * so its words are used as independent hashes
+     */
+
+    ngx_memcpy(hash, key, sizeof(hash));
+
+    width = sh->sketch_mask + 1;
+
+    for (i = 0; i < NGX_HTTP_CACHE_SKETCH_ROWS; i++) {
+        p = sh->sketch + i * width + (hash[i] & sh->sketch_mask);
+
+        if (*p < NGX_HTTP_CACHE_SKETCH_MAX) {
+            (*p)++;
+        }
+    }
+
+    if (sh->sketch_age) {
+        n = ngx_min(sh->sketch_age, NGX_HTTP_CACHE_SKETCH_SLICE);
+        sh->sketch_age -= n;
+
+        p = sh->sketch + sh->sketch_age;
+
+        for (i = 0; i < n; i++) {
+            p[i] >>= 1;
+        }
+    }
+
+    if (++sh->sketch_adds < 10 * width) {
+        return;
+    }
+
+    sh->sketch_adds /= 2;
+    sh->sketch_age = NGX_HTTP_CACHE_SKETCH_ROWS * width;
+}
+
+
+static ngx_uint_t
+ngx_http_file_cache_sketch_estimate(ngx_http_file_cache_t *cache, u_char *key)
+{
+    u_char                     c;
+    uint32_t                   hash[NGX_HTTP_CACHE_SKETCH_ROWS];
+    ngx_uint_t                 i, width, min;
+    ngx_http_file_cache_sh_t  *sh;
+
+    sh = cache->sh;
+
+    ngx_memcpy(hash, key, sizeof(hash));
+
+    width = sh->sketch_mask + 1;
+    min = NGX_HTTP_CACHE_SKETCH_MAX;
+
+    for (i = 0; i < NGX_HTTP_CACHE_SKETCH_ROWS; i++) {
+        c = sh->sketch[i * width + (hash[i] & sh->sketch_mask)];
+
+        if (c < min) {
+            min = c;
+        }
+    }
+
+    return min;
+}
+
+
+/*
+ * once the cache is nearly full, a new entry is only written if it was
+ * requested more often than the entry it would evict, that is, the least
+ * recently used entry outside of the protected segment
+ */
+
+static ngx_int_t
+ngx_http_file_cache_admit(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_uint_t                   n;
+    ngx_queue_t                 *q;
+    ngx_http_file_cache_sh_t    *sh;
+    ngx_http_file_cache_node_t  *fcn, *victim;
+    u_char                       vkey[NGX_HTTP_CACHE_KEY_LEN];
+
+    sh = cache->sh;
+
+    if (sh->sketch == NULL || sh->cold) {
+        return NGX_OK;
+    }
+
+    if (sh->size < cache->max_size / 8 * 7 && sh->count < sh->watermark) {
+        return NGX_OK;
+    }
+
+    if (ngx_queue_empty(&sh->queue)) {
+        return NGX_OK;
+    }
+
+    victim = NULL;
+    q = ngx_queue_last(&sh->queue);
+
+    for (n = 0; n < 8 && q != ngx_queue_sentinel(&sh->queue); n++) {
+        fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+        if (!fcn->hot) {
+            victim = fcn;
+            break;
+        }
+
+        q = ngx_queue_prev(q);
+    }
+
+    if (victim == NULL) {
+        victim = ngx_queue_data(ngx_queue_last(&sh->queue),
+                                ngx_http_file_cache_node_t, queue);
+    }
+
+    ngx_memcpy(vkey, &victim->node.key, sizeof(ngx_rbtree_key_t));
+    ngx_memcpy(&vkey[sizeof(ngx_rbtree_key_t)], victim->key,
+               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+    if (ngx_http_file_cache_sketch_estimate(cache, key)
+        > ngx_http_file_cache_sketch_estimate(cache, vkey))
+    {
+        return NGX_OK;
+    }
+
+    return NGX_DECLINED;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_memory_init(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_file_cache_t  *ocache = data;
+
+    size_t                  len;
+    ngx_http_file_cache_t  *cache;
+
+    cache = shm_zone->data;
+
+    if (ocache && ocache->memory) {
+        cache->memory = ocache->memory;
+        cache->memory_shpool = ocache->memory_shpool;
+
+        return NGX_OK;
+    }
+
+    cache->memory_shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        cache->memory = cache->memory_shpool->data;
+
+        return NGX_OK;
+    }
+
+    cache->memory = ngx_slab_alloc(cache->memory_shpool,
+                                   sizeof(ngx_http_file_cache_memory_sh_t));
+    if (cache->memory == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->memory_shpool->data = cache->memory;
+
+    ngx_rbtree_init(&cache->memory->rbtree, &cache->memory->sentinel,
+                    ngx_http_file_cache_memory_insert_value);
+
+    ngx_queue_init(&cache->memory->queue);
+
+    cache->memory->size = 0;
+    cache->memory->count = 0;
+
+    len = sizeof(" in cache memory zone \"\"") + shm_zone->shm.name.len;
+
+    cache->memory_shpool->log_ctx = ngx_slab_alloc(cache->memory_shpool, len);
+    if (cache->memory_shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(cache->memory_shpool->log_ctx,
+                " in cache memory zone \"%V\"%Z", &shm_zone->shm.name);
+
+    cache->memory_shpool->log_nomem = 0;
+
     return NGX_OK;
 }
 
@@ -227,18 +628,18 @@ ngx_http_file_cache_create(ngx_http_request_t *r)
 void
 ngx_http_file_cache_create_key(ngx_http_request_t *r)
 {
-    size_t             len;
-    ngx_str_t         *key;
-    ngx_uint_t         i;
-    ngx_md5_t          md5;
-    ngx_http_cache_t  *c;
+    size_t                      len;
+    ngx_str_t                  *key;
+    ngx_uint_t                  i;
+    ngx_http_cache_t           *c;
+    ngx_http_file_cache_hash_t  hash;
 
     c = r->cache;
 
     len = 0;
 
     ngx_crc32_init(c->crc32);
-    ngx_md5_init(&md5);
+    ngx_http_file_cache_hash_init(&hash, c->file_cache);
 
     key = c->keys.elts;
     for (i = 0; i < c->keys.nelts; i++) {
@@ -248,19 +649,60 @@ ngx_http_file_cache_create_key(ngx_http_request_t *r)
         len += key[i].len;
 
         ngx_crc32_update(&c->crc32, key[i].data, key[i].len);
-        ngx_md5_update(&md5, key[i].data, key[i].len);
+        ngx_http_file_cache_hash_update(&hash, key[i].data, key[i].len);
     }
 
     c->header_start = sizeof(ngx_http_file_cache_header_t)
                       + sizeof(ngx_http_file_cache_key) + len + 1;
 
     ngx_crc32_final(c->crc32);
-    ngx_md5_final(c->key, &md5);
+    ngx_http_file_cache_hash_final(c->key, &hash);
 
     ngx_memcpy(c->main, c->key, NGX_HTTP_CACHE_KEY_LEN);
 }
 
 
+static void
+ngx_http_file_cache_hash_init(ngx_http_file_cache_hash_t *hash,
+    ngx_http_file_cache_t *cache)
+{
+    hash->type = cache ? cache->key_hash : NGX_HTTP_CACHE_MD5;
+
+    if (hash->type == NGX_HTTP_CACHE_MURMUR3) {
+        ngx_murmur_hash3_128_init(&hash->u.murmur3, cache->key_seed);
+
+    } else {
+        ngx_md5_init(&hash->u.md5);
+    }
+}
+
+
+static void
+ngx_http_file_cache_hash_update(ngx_http_file_cache_hash_t *hash,
+    u_char *data, size_t len)
+{
+    if (hash->type == NGX_HTTP_CACHE_MURMUR3) {
+        ngx_murmur_hash3_128_update(&hash->u.murmur3, data, len);
+
+    } else {
+        ngx_md5_update(&hash->u.md5, data, len);
+    }
+}
+
+
+static void
+ngx_http_file_cache_hash_final(u_char *result,
+    ngx_http_file_cache_hash_t *hash)
+{
+    if (hash->type == NGX_HTTP_CACHE_MURMUR3) {
+        ngx_murmur_hash3_128_final(result, &hash->u.murmur3);
+
+    } else {
+        ngx_md5_final(result, &hash->u.md5);
+    }
+}
+
+
 ngx_int_t
 ngx_http_file_cache_open(ngx_http_request_t *r)
 {
@@ -345,6 +787,18 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
         goto done;
     }
 
+    if (cache->memory && c->exists) {
+        rc = ngx_http_file_cache_memory_read(r, c);
+
+        if (rc == NGX_OK) {
+            return ngx_http_file_cache_read(r, c);
+        }
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+    }
+
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
@@ -384,7 +838,14 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
     c->length = of.size;
     c->fs_size = (of.fs_size + cache->bsize - 1) / cache->bsize;
 
-    c->buf = ngx_create_temp_buf(r->pool, c->body_start);
+    /* small responses are read as a whole to be kept in the memory tier */
+
+    if (cache->memory && of.size <= (off_t) cache->memory_max_size) {
+        c->memory = 1;
+    }
+
+    c->buf = ngx_create_temp_buf(r->pool,
+                                 c->memory ? (size_t) of.size : c->body_start);
     if (c->buf == NULL) {
         return NGX_ERROR;
     }
@@ -450,9 +911,11 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
         c->wait_event.log = r->connection->log;
     }
 
+    ngx_queue_insert_tail(&cache->waiters, &c->wait_queue);
+
     timer = c->wait_time - now;
 
-    ngx_add_timer(&c->wait_event, (timer > 500) ? 500 : timer);
+    ngx_add_timer(&c->wait_event, ngx_http_file_cache_lock_interval(c, timer));
 
     r->main->blocked++;
 
@@ -491,6 +954,8 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     timer = c->wait_time - now;
 
+    ngx_queue_remove(&c->wait_queue);
+
     if ((ngx_msec_int_t) timer <= 0) {
         ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
                       "cache lock timeout");
@@ -512,10 +977,16 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
     ngx_shmtx_unlock(&cache->shpool->mutex);
 
     if (wait) {
-        ngx_add_timer(&c->wait_event, (timer > 500) ? 500 : timer);
+        ngx_queue_insert_tail(&cache->waiters, &c->wait_queue);
+        ngx_add_timer(&c->wait_event,
+                      ngx_http_file_cache_lock_interval(c, timer));
         return;
     }
 
+    /* wake up other requests in this worker waiting for the same node */
+
+    ngx_http_file_cache_lock_wakeup(cache, c->node);
+
 wakeup:
 
     c->waiting = 0;
@@ -524,6 +995,59 @@ wakeup:
 }
 
 
+static ngx_msec_t
+ngx_http_file_cache_lock_interval(ngx_http_cache_t *c, ngx_msec_t timer)
+{
+    ngx_msec_t  interval;
+
+    /*
+     * a lock held by the same worker process is released through
+     * ngx_http_file_cache_lock_wakeup(), a lock held by another worker
+     * is polled with an interval growing with the time already spent
+     */
+
+    interval = (ngx_current_msec - (c->wait_time - c->lock_timeout)) / 2;
+
+    if (interval < NGX_HTTP_CACHE_WAIT_MIN) {
+        interval = NGX_HTTP_CACHE_WAIT_MIN;
+
+    } else if (interval > NGX_HTTP_CACHE_WAIT_MAX) {
+        interval = NGX_HTTP_CACHE_WAIT_MAX;
+    }
+
+    return (timer > interval) ? interval : timer;
+}
+
+
+static void
+ngx_http_file_cache_lock_wakeup(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_node_t *fcn)
+{
+    ngx_queue_t       *q;
+    ngx_http_cache_t  *c;
+
+    for (q = ngx_queue_head(&cache->waiters);
+         q != ngx_queue_sentinel(&cache->waiters);
+         q = ngx_queue_next(q))
+    {
+        c = ngx_queue_data(q, ngx_http_cache_t, wait_queue);
+
+        if (c->node != fcn || c->wait_event.posted) {
+            continue;
+        }
+
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->wait_event.log, 0,
+                       "http file cache lock wakeup");
+
+        if (c->wait_event.timer_set) {
+            ngx_del_timer(&c->wait_event);
+        }
+
+        ngx_post_event(&c->wait_event, &ngx_posted_events);
+    }
+}
+
+
 static ngx_int_t
 ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
@@ -536,10 +1060,15 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
     ngx_http_file_cache_t         *cache;
     ngx_http_file_cache_header_t  *h;
 
-    n = ngx_http_file_cache_aio_read(r, c);
+    if (c->memory && c->file.fd == NGX_INVALID_FILE) {
+        n = c->length;
 
-    if (n < 0) {
-        return n;
+    } else {
+        n = ngx_http_file_cache_aio_read(r, c);
+
+        if (n < 0) {
+            return n;
+        }
     }
 
     if ((size_t) n < c->header_start) {
@@ -550,7 +1079,7 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     h = (ngx_http_file_cache_header_t *) c->buf->pos;
 
-    if (h->version != NGX_HTTP_CACHE_VERSION) {
+    if (h->version != c->file_cache->version) {
         ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
                       "cache file \"%s\" version mismatch", c->file.name.data);
         return NGX_DECLINED;
@@ -558,7 +1087,7 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     if (h->crc32 != c->crc32 || (size_t) h->header_start != c->header_start) {
         ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                      "cache file \"%s\" has md5 collision", c->file.name.data);
+                      "cache file \"%s\" has key collision", c->file.name.data);
         return NGX_DECLINED;
     }
 
@@ -569,7 +1098,7 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
     for (i = 0; i < c->keys.nelts; i++) {
         if (ngx_memcmp(p, key[i].data, key[i].len) != 0) {
             ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
-                          "cache file \"%s\" has md5 collision",
+                          "cache file \"%s\" has key collision",
                           c->file.name.data);
             return NGX_DECLINED;
         }
@@ -603,6 +1132,17 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     c->buf->last += n;
 
+    cache = c->file_cache;
+
+    if (c->memory) {
+        if ((off_t) n != c->length) {
+            c->memory = 0;
+
+        } else if (c->file.fd != NGX_INVALID_FILE) {
+            ngx_http_file_cache_memory_store(cache, c);
+        }
+    }
+
     c->valid_sec = h->valid_sec;
     c->updating_sec = h->updating_sec;
     c->error_sec = h->error_sec;
@@ -615,8 +1155,6 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     r->cached = 1;
 
-    cache = c->file_cache;
-
     if (cache->sh->cold) {
 
         ngx_shmtx_lock(&cache->shpool->mutex);
@@ -678,7 +1216,8 @@ ngx_http_file_cache_aio_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 #if (NGX_HAVE_FILE_AIO)
 
     if (clcf->aio == NGX_HTTP_AIO_ON && ngx_file_aio) {
-        n = ngx_file_aio_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+        n = ngx_file_aio_read(&c->file, c->buf->pos,
+                              c->buf->end - c->buf->pos, 0, r->pool);
 
         if (n != NGX_AGAIN) {
             c->reading = 0;
@@ -705,7 +1244,8 @@ ngx_http_file_cache_aio_read(ngx_http_request_t *r, ngx_http_cache_t *c)
         c->file.thread_handler = ngx_http_cache_thread_handler;
         c->file.thread_ctx = r;
 
-        n = ngx_thread_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+        n = ngx_thread_read(&c->file, c->buf->pos,
+                            c->buf->end - c->buf->pos, 0, r->pool);
 
         c->thread_task = c->file.thread_task;
         c->reading = (n == NGX_AGAIN);
@@ -715,7 +1255,7 @@ ngx_http_file_cache_aio_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 
 #endif
 
-    return ngx_read_file(&c->file, c->buf->pos, c->body_start, 0);
+    return ngx_read_file(&c->file, c->buf->pos, c->buf->end - c->buf->pos, 0);
 }
 
 
@@ -829,6 +1369,10 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
     fcn = c->node;
 
     if (fcn == NULL) {
+        if (cache->tinylfu) {
+            ngx_http_file_cache_sketch_add(cache, c->key);
+        }
+
         fcn = ngx_http_file_cache_lookup(cache, c->key);
     }
 
@@ -853,6 +1397,22 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
 
         if (fcn->exists || fcn->uses >= c->min_uses) {
 
+            if (cache->tinylfu && c->node == NULL) {
+
+                if (!fcn->exists) {
+                    if (ngx_http_file_cache_admit(cache, c->key) != NGX_OK) {
+                        rc = NGX_AGAIN;
+                        goto done;
+                    }
+
+                } else if (!fcn->hot
+                           && cache->sh->hot < cache->sh->count / 5 * 4)
+                {
+                    fcn->hot = 1;
+                    cache->sh->hot++;
+                }
+            }
+
             c->exists = fcn->exists;
             if (fcn->body_start && !c->update_variant) {
                 c->body_start = fcn->body_start;
@@ -901,10 +1461,23 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
     fcn->uses = 1;
     fcn->count = 1;
 
+    if (cache->tinylfu
+        && c->min_uses == 1
+        && ngx_http_file_cache_admit(cache, c->key) != NGX_OK)
+    {
+        rc = NGX_AGAIN;
+        goto done;
+    }
+
 renew:
 
     rc = NGX_DECLINED;
 
+    if (fcn->hot) {
+        fcn->hot = 0;
+        cache->sh->hot--;
+    }
+
     fcn->valid_msec = 0;
     fcn->error = 0;
     fcn->exists = 0;
@@ -1011,6 +1584,48 @@ ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
 }
 
 
+static ngx_http_file_cache_node_t *
+ngx_http_file_cache_lookup_next(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_int_t                    rc;
+    ngx_rbtree_key_t             node_key;
+    ngx_rbtree_node_t           *node, *sentinel;
+    ngx_http_file_cache_node_t  *fcn, *next;
+
+    /* the first node with a key greater than the given one */
+
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+
+    node = cache->sh->rbtree.root;
+    sentinel = cache->sh->rbtree.sentinel;
+
+    next = NULL;
+
+    while (node != sentinel) {
+
+        fcn = (ngx_http_file_cache_node_t *) node;
+
+        if (node_key != node->key) {
+            rc = (node_key < node->key) ? -1 : 1;
+
+        } else {
+            rc = ngx_memcmp(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+        }
+
+        if (rc < 0) {
+            next = fcn;
+            node = node->left;
+
+        } else {
+            node = node->right;
+        }
+    }
+
+    return next;
+}
+
+
 static void
 ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
@@ -1054,20 +1669,246 @@ ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
 }
 
 
+static ngx_int_t
+ngx_http_file_cache_memory_read(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    ngx_http_file_cache_t              *cache;
+    ngx_http_file_cache_memory_node_t  *mn;
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->memory_shpool->mutex);
+
+    mn = ngx_http_file_cache_memory_lookup(cache, c->key);
+
+    if (mn == NULL || mn->uniq != c->uniq) {
+        ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+        return NGX_DECLINED;
+    }
+
+    c->buf = ngx_create_temp_buf(r->pool, mn->len);
+    if (c->buf == NULL) {
+        ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(c->buf->pos, mn->data, mn->len);
+
+    c->length = mn->len;
+
+    ngx_queue_remove(&mn->queue);
+    ngx_queue_insert_head(&cache->memory->queue, &mn->queue);
+
+    ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache memory hit: %O", c->length);
+
+    c->memory = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_file_cache_memory_store(ngx_http_file_cache_t *cache,
+    ngx_http_cache_t *c)
+{
+    size_t                              len, size;
+    ngx_queue_t                        *q;
+    ngx_http_file_cache_memory_node_t  *mn;
+
+    len = (size_t) c->length;
+    size = offsetof(ngx_http_file_cache_memory_node_t, data) + len;
+
+    ngx_shmtx_lock(&cache->memory_shpool->mutex);
+
+    mn = ngx_http_file_cache_memory_lookup(cache, c->key);
+
+    if (mn) {
+        if (mn->uniq == c->uniq) {
+            ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+            return;
+        }
+
+        ngx_queue_remove(&mn->queue);
+        ngx_rbtree_delete(&cache->memory->rbtree, &mn->node);
+
+        cache->memory->size -= mn->len;
+        cache->memory->count--;
+
+        ngx_slab_free_locked(cache->memory_shpool, mn);
+    }
+
+    for ( ;; ) {
+        mn = ngx_slab_alloc_locked(cache->memory_shpool, size);
+        if (mn) {
+            break;
+        }
+
+        if (ngx_queue_empty(&cache->memory->queue)) {
+            ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+            return;
+        }
+
+        /* evict the least recently used response */
+
+        q = ngx_queue_last(&cache->memory->queue);
+        ngx_queue_remove(q);
+
+        mn = ngx_queue_data(q, ngx_http_file_cache_memory_node_t, queue);
+        ngx_rbtree_delete(&cache->memory->rbtree, &mn->node);
+
+        cache->memory->size -= mn->len;
+        cache->memory->count--;
+
+        ngx_slab_free_locked(cache->memory_shpool, mn);
+    }
+
+    ngx_memcpy((u_char *) &mn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+    ngx_memcpy(mn->key, &c->key[sizeof(ngx_rbtree_key_t)],
+               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+    mn->uniq = c->uniq;
+    mn->len = len;
+    ngx_memcpy(mn->data, c->buf->pos, len);
+
+    ngx_rbtree_insert(&cache->memory->rbtree, &mn->node);
+    ngx_queue_insert_head(&cache->memory->queue, &mn->queue);
+
+    cache->memory->size += len;
+    cache->memory->count++;
+
+    ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+}
+
+
+static void
+ngx_http_file_cache_memory_delete(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_http_file_cache_memory_node_t  *mn;
+
+    ngx_shmtx_lock(&cache->memory_shpool->mutex);
+
+    mn = ngx_http_file_cache_memory_lookup(cache, key);
+
+    if (mn) {
+        ngx_queue_remove(&mn->queue);
+        ngx_rbtree_delete(&cache->memory->rbtree, &mn->node);
+
+        cache->memory->size -= mn->len;
+        cache->memory->count--;
+
+        ngx_slab_free_locked(cache->memory_shpool, mn);
+    }
+
+    ngx_shmtx_unlock(&cache->memory_shpool->mutex);
+}
+
+
+static ngx_http_file_cache_memory_node_t *
+ngx_http_file_cache_memory_lookup(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_int_t                           rc;
+    ngx_rbtree_key_t                    node_key;
+    ngx_rbtree_node_t                  *node, *sentinel;
+    ngx_http_file_cache_memory_node_t  *mn;
+
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+
+    node = cache->memory->rbtree.root;
+    sentinel = cache->memory->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (node_key < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (node_key > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* node_key == node->key */
+
+        mn = (ngx_http_file_cache_memory_node_t *) node;
+
+        rc = ngx_memcmp(&key[sizeof(ngx_rbtree_key_t)], mn->key,
+                        NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+        if (rc == 0) {
+            return mn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    /* not found */
+
+    return NULL;
+}
+
+
+static void
+ngx_http_file_cache_memory_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t                  **p;
+    ngx_http_file_cache_memory_node_t   *mn, *mnt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            mn = (ngx_http_file_cache_memory_node_t *) node;
+            mnt = (ngx_http_file_cache_memory_node_t *) temp;
+
+            p = (ngx_memcmp(mn->key, mnt->key,
+                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t))
+                 < 0)
+                    ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
 static void
 ngx_http_file_cache_vary(ngx_http_request_t *r, u_char *vary, size_t len,
     u_char *hash)
 {
-    u_char     *p, *last;
-    ngx_str_t   name;
-    ngx_md5_t   md5;
-    u_char      buf[NGX_HTTP_CACHE_VARY_LEN];
+    u_char                      *p, *last;
+    ngx_str_t                    name;
+    ngx_http_file_cache_hash_t   h;
+    u_char                       buf[NGX_HTTP_CACHE_VARY_LEN];
 
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http file cache vary: \"%*s\"", len, vary);
 
-    ngx_md5_init(&md5);
-    ngx_md5_update(&md5, r->cache->main, NGX_HTTP_CACHE_KEY_LEN);
+    ngx_http_file_cache_hash_init(&h, r->cache->file_cache);
+    ngx_http_file_cache_hash_update(&h, r->cache->main,
+                                    NGX_HTTP_CACHE_KEY_LEN);
 
     ngx_strlow(buf, vary, len);
 
@@ -1091,21 +1932,22 @@ ngx_http_file_cache_vary(ngx_http_request_t *r, u_char *vary, size_t len,
         ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                        "http file cache vary: %V", &name);
 
-        ngx_md5_update(&md5, name.data, name.len);
-        ngx_md5_update(&md5, (u_char *) ":", sizeof(":") - 1);
+        ngx_http_file_cache_hash_update(&h, name.data, name.len);
+        ngx_http_file_cache_hash_update(&h, (u_char *) ":", sizeof(":") - 1);
 
-        ngx_http_file_cache_vary_header(r, &md5, &name);
+        ngx_http_file_cache_vary_header(r, &h, &name);
 
-        ngx_md5_update(&md5, (u_char *) CRLF, sizeof(CRLF) - 1);
+        ngx_http_file_cache_hash_update(&h, (u_char *) CRLF,
+                                        sizeof(CRLF) - 1);
     }
 
-    ngx_md5_final(hash, &md5);
+    ngx_http_file_cache_hash_final(hash, &h);
 }
 
 
 static void
-ngx_http_file_cache_vary_header(ngx_http_request_t *r, ngx_md5_t *md5,
-    ngx_str_t *name)
+ngx_http_file_cache_vary_header(ngx_http_request_t *r,
+    ngx_http_file_cache_hash_t *hash, ngx_str_t *name)
 {
     size_t            len;
     u_char           *p, *start, *last;
@@ -1165,10 +2007,12 @@ ngx_http_file_cache_vary_header(ngx_http_request_t *r, ngx_md5_t *md5,
         if (!normalize) {
 
             if (multiple) {
-                ngx_md5_update(md5, (u_char *) ",", sizeof(",") - 1);
+                ngx_http_file_cache_hash_update(hash, (u_char *) ",",
+                                                sizeof(",") - 1);
             }
 
-            ngx_md5_update(md5, header[i].value.data, header[i].value.len);
+            ngx_http_file_cache_hash_update(hash, header[i].value.data,
+                                            header[i].value.len);
 
             multiple = 1;
 
@@ -1195,10 +2039,11 @@ ngx_http_file_cache_vary_header(ngx_http_request_t *r, ngx_md5_t *md5,
             }
 
             if (multiple) {
-                ngx_md5_update(md5, (u_char *) ",", sizeof(",") - 1);
+                ngx_http_file_cache_hash_update(hash, (u_char *) ",",
+                                                sizeof(",") - 1);
             }
 
-            ngx_md5_update(md5, start, len);
+            ngx_http_file_cache_hash_update(hash, start, len);
 
             multiple = 1;
         }
@@ -1231,6 +2076,7 @@ ngx_http_file_cache_reopen(ngx_http_request_t *r, ngx_http_cache_t *c)
     ngx_shmtx_unlock(&cache->shpool->mutex);
 
     c->secondary = 1;
+    c->memory = 0;
     c->file.name.len = 0;
     c->body_start = c->buffer_size;
 
@@ -1257,7 +2103,7 @@ ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf)
 
     ngx_memzero(h, sizeof(ngx_http_file_cache_header_t));
 
-    h->version = NGX_HTTP_CACHE_VERSION;
+    h->version = c->file_cache->version;
     h->valid_sec = c->valid_sec;
     h->updating_sec = c->updating_sec;
     h->error_sec = c->error_sec;
@@ -1308,7 +2154,8 @@ ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf)
 static ngx_int_t
 ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    ngx_http_file_cache_t  *cache;
+    ngx_http_file_cache_t       *cache;
+    ngx_http_file_cache_node_t  *fcn;
 
     if (!c->secondary) {
         return NGX_OK;
@@ -1330,14 +2177,18 @@ ngx_http_file_cache_update_variant(ngx_http_request_t *r, ngx_http_cache_t *c)
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http file cache main key");
 
+    fcn = c->node;
+
     ngx_shmtx_lock(&cache->shpool->mutex);
 
-    c->node->count--;
-    c->node->updating = 0;
+    fcn->count--;
+    fcn->updating = 0;
     c->node = NULL;
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
 
+    ngx_http_file_cache_lock_wakeup(cache, fcn);
+
     c->file.name.len = 0;
     c->update_variant = 1;
 
@@ -1427,6 +2278,12 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
     c->node->updating = 0;
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    if (cache->memory) {
+        ngx_http_file_cache_memory_delete(cache, c->key);
+    }
+
+    ngx_http_file_cache_lock_wakeup(cache, c->node);
 }
 
 
@@ -1502,7 +2359,7 @@ ngx_http_file_cache_update_header(ngx_http_request_t *r)
         goto done;
     }
 
-    if (h.version != NGX_HTTP_CACHE_VERSION
+    if (h.version != c->file_cache->version
         || h.last_modified != c->last_modified
         || h.crc32 != c->crc32
         || (size_t) h.header_start != c->header_start
@@ -1521,7 +2378,7 @@ ngx_http_file_cache_update_header(ngx_http_request_t *r)
 
     ngx_memzero(&h, sizeof(ngx_http_file_cache_header_t));
 
-    h.version = NGX_HTTP_CACHE_VERSION;
+    h.version = c->file_cache->version;
     h.valid_sec = c->valid_sec;
     h.updating_sec = c->updating_sec;
     h.error_sec = c->error_sec;
@@ -1553,6 +2410,10 @@ ngx_http_file_cache_update_header(ngx_http_request_t *r)
     (void) ngx_write_file(&file, (u_char *) &h,
                           sizeof(ngx_http_file_cache_header_t), 0);
 
+    if (c->file_cache->memory) {
+        ngx_http_file_cache_memory_delete(c->file_cache, c->key);
+    }
+
 done:
 
     if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
@@ -1586,9 +2447,11 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
-    if (b->file == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if (!c->memory) {
+        b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
+        if (b->file == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
     }
 
     rc = ngx_http_send_header(r);
@@ -1597,17 +2460,26 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return rc;
     }
 
-    b->file_pos = c->body_start;
-    b->file_last = c->length;
+    if (c->memory) {
+        b->pos = c->buf->pos + c->body_start;
+        b->last = c->buf->pos + c->length;
+
+        b->memory = (c->length - c->body_start) ? 1: 0;
+
+    } else {
+        b->file_pos = c->body_start;
+        b->file_last = c->length;
+
+        b->in_file = (c->length - c->body_start) ? 1: 0;
+
+        b->file->fd = c->file.fd;
+        b->file->name = c->file.name;
+        b->file->log = r->connection->log;
+    }
 
-    b->in_file = (c->length - c->body_start) ? 1: 0;
     b->last_buf = (r == r->main) ? 1: 0;
     b->last_in_chain = 1;
 
-    b->file->fd = c->file.fd;
-    b->file->name = c->file.name;
-    b->file->log = r->connection->log;
-
     out.buf = b;
     out.next = NULL;
 
@@ -1618,9 +2490,19 @@ ngx_http_cache_send(ngx_http_request_t *r)
 void
 ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 {
+    ngx_uint_t                   wakeup;
     ngx_http_file_cache_t       *cache;
     ngx_http_file_cache_node_t  *fcn;
 
+    if (c->waiting) {
+        c->waiting = 0;
+        ngx_queue_remove(&c->wait_queue);
+
+        if (c->wait_event.posted) {
+            ngx_delete_posted_event(&c->wait_event);
+        }
+    }
+
     if (c->updated || c->node == NULL) {
         return;
     }
@@ -1635,8 +2517,11 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
     fcn = c->node;
     fcn->count--;
 
+    wakeup = 0;
+
     if (c->updating && fcn->lock_time == c->lock_time) {
         fcn->updating = 0;
+        wakeup = 1;
     }
 
     if (c->error) {
@@ -1657,6 +2542,10 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
 
+    if (wakeup) {
+        ngx_http_file_cache_lock_wakeup(cache, fcn);
+    }
+
     c->updated = 1;
     c->updating = 0;
 
@@ -1707,9 +2596,9 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
     u_char                      *name, *p;
     size_t                       len;
     time_t                       wait;
-    ngx_uint_t                   tries;
+    ngx_uint_t                   tries, demote;
     ngx_path_t                  *path;
-    ngx_queue_t                 *q, *sentinel;
+    ngx_queue_t                 *q, *prev, *sentinel;
     ngx_http_file_cache_node_t  *fcn;
     u_char                       key[2 * NGX_HTTP_CACHE_KEY_LEN];
 
@@ -1728,20 +2617,19 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
 
     wait = 10;
     tries = 20;
+    demote = 100;
     sentinel = NULL;
 
     ngx_shmtx_lock(&cache->shpool->mutex);
 
+    q = ngx_queue_last(&cache->sh->queue);
+
     for ( ;; ) {
-        if (ngx_queue_empty(&cache->sh->queue)) {
+        if (q == ngx_queue_sentinel(&cache->sh->queue) || q == sentinel) {
             break;
         }
 
-        q = ngx_queue_last(&cache->sh->queue);
-
-        if (q == sentinel) {
-            break;
-        }
+        prev = ngx_queue_prev(q);
 
         fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
 
@@ -1750,6 +2638,27 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
                   fcn->count, fcn->exists,
                   fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
 
+        /*
+         * entries in the protected segment are given a second chance:
+         * they are demoted in place, so the queue stays ordered by
+         * the expiration time; if the queue head is reached, all entries
+         * walked were demoted, and the walk restarts from the tail
+         */
+
+        if (fcn->hot && demote) {
+            fcn->hot = 0;
+            cache->sh->hot--;
+            demote--;
+
+            if (prev == ngx_queue_sentinel(&cache->sh->queue)) {
+                q = ngx_queue_last(&cache->sh->queue);
+                continue;
+            }
+
+            q = prev;
+            continue;
+        }
+
         if (fcn->count == 0) {
             ngx_http_file_cache_delete(cache, q, name);
             wait = 0;
@@ -1780,6 +2689,7 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
         }
 
         if (--tries) {
+            q = prev;
             continue;
         }
 
@@ -1853,6 +2763,12 @@ ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
                        fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
 
         if (fcn->count == 0) {
+
+            if (ngx_http_file_cache_manager_budget(cache) != NGX_OK) {
+                wait = 0;
+                break;
+            }
+
             ngx_http_file_cache_delete(cache, q, name);
             goto next;
         }
@@ -1911,15 +2827,19 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
     u_char *name)
 {
     u_char                      *p;
+    off_t                        size;
     size_t                       len;
     ngx_path_t                  *path;
     ngx_http_file_cache_node_t  *fcn;
+    u_char                       key[NGX_HTTP_CACHE_KEY_LEN];
 
     fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
 
     if (fcn->exists) {
         cache->sh->size -= fcn->fs_size;
 
+        size = fcn->fs_size * cache->bsize;
+
         path = cache->path;
         p = name + path->name.len + 1 + path->len;
         p = ngx_hex_dump(p, (u_char *) &fcn->node.key,
@@ -1932,23 +2852,40 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
         fcn->deleting = 1;
         ngx_shmtx_unlock(&cache->shpool->mutex);
 
+        if (cache->memory) {
+            ngx_memcpy(key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+            ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                       NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+            ngx_http_file_cache_memory_delete(cache, key);
+        }
+
         len = path->name.len + 1 + path->len + 2 * NGX_HTTP_CACHE_KEY_LEN;
         ngx_create_hashed_filename(path, name, len);
 
         ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                        "http file cache expire: \"%s\"", name);
 
-        if (ngx_delete_file(name) == NGX_FILE_ERROR) {
-            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
-                          ngx_delete_file_n " \"%s\" failed", name);
+        ngx_http_file_cache_unlink(cache, name);
+
+        if (ngx_process == NGX_PROCESS_HELPER) {
+            cache->budget_files -= 1000;
+            cache->budget_size -= size;
         }
 
         ngx_shmtx_lock(&cache->shpool->mutex);
         fcn->count--;
         fcn->deleting = 0;
+
+        cache->sh->evicted++;
+        cache->sh->evicted_size += size;
     }
 
     if (fcn->count == 0) {
+        if (fcn->hot) {
+            cache->sh->hot--;
+        }
+
         ngx_queue_remove(q);
         ngx_rbtree_delete(&cache->sh->rbtree, &fcn->node);
         ngx_slab_free_locked(cache->shpool, fcn);
@@ -1957,6 +2894,181 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
 }
 
 
+/*
+ * in the cache manager process, the file is renamed and then removed
+ * in a thread pool, as unlinking of large files may block for a long time
+ * on some file systems; renamed files left by an exited cache manager
+ * are removed by the cache loader
+ */
+
+static void
+ngx_http_file_cache_unlink(ngx_http_file_cache_t *cache, u_char *name)
+{
+#if (NGX_THREADS)
+    size_t                             len;
+    ngx_err_t                          err;
+    ngx_thread_task_t                 *task;
+    ngx_http_file_cache_unlink_ctx_t  *ctx;
+
+    if (cache->thread_pool == NULL || ngx_process != NGX_PROCESS_HELPER) {
+        goto unlink;
+    }
+
+    len = sizeof(ngx_thread_task_t) + sizeof(ngx_http_file_cache_unlink_ctx_t)
+          + ngx_strlen(name) + sizeof(".del");
+
+    task = ngx_alloc(len, ngx_cycle->log);
+    if (task == NULL) {
+        goto unlink;
+    }
+
+    ngx_memzero(task, sizeof(ngx_thread_task_t)
+                      + sizeof(ngx_http_file_cache_unlink_ctx_t));
+
+    ctx = (ngx_http_file_cache_unlink_ctx_t *) (task + 1);
+
+    ctx->cache = cache;
+    ctx->name = (u_char *) (ctx + 1);
+
+    ngx_sprintf(ctx->name, "%s.del%Z", name);
+
+    if (ngx_rename_file(name, ctx->name) == NGX_FILE_ERROR) {
+        err = ngx_errno;
+
+        if (err != NGX_ENOENT) {
+            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, err,
+                          ngx_rename_file_n " \"%s\" to \"%s\" failed",
+                          name, ctx->name);
+        }
+
+        ngx_free(task);
+        return;
+    }
+
+    task->ctx = ctx;
+    task->handler = ngx_http_file_cache_unlink_thread;
+    task->event.handler = ngx_http_file_cache_unlink_handler;
+    task->event.data = task;
+    task->event.log = ngx_cycle->log;
+
+    if (ngx_thread_task_post(cache->thread_pool, task) == NGX_OK) {
+        cache->sh->backlog = ++cache->backlog;
+        return;
+    }
+
+    if (ngx_delete_file(ctx->name) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed", ctx->name);
+    }
+
+    ngx_free(task);
+    return;
+
+unlink:
+
+#endif
+
+    if (ngx_delete_file(name) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed", name);
+    }
+}
+
+
+#if (NGX_THREADS)
+
+static void
+ngx_http_file_cache_unlink_thread(void *data, ngx_log_t *log)
+{
+    ngx_http_file_cache_unlink_ctx_t *ctx = data;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "http file cache unlink thread: \"%s\"", ctx->name);
+
+    if (ngx_delete_file(ctx->name) == NGX_FILE_ERROR) {
+        ctx->err = ngx_errno;
+    }
+}
+
+
+static void
+ngx_http_file_cache_unlink_handler(ngx_event_t *ev)
+{
+    ngx_thread_task_t                 *task;
+    ngx_http_file_cache_t             *cache;
+    ngx_http_file_cache_unlink_ctx_t  *ctx;
+
+    task = ev->data;
+    ctx = task->ctx;
+    cache = ctx->cache;
+
+    if (ctx->err && ctx->err != NGX_ENOENT) {
+        ngx_log_error(NGX_LOG_CRIT, ev->log, ctx->err,
+                      ngx_delete_file_n " \"%s\" failed", ctx->name);
+    }
+
+    cache->sh->backlog = --cache->backlog;
+
+    ngx_free(task);
+}
+
+#endif
+
+
+/*
+ * the manager_rate and manager_bandwidth parameters limit the number
+ * and the total size of files deleted by the cache manager per second;
+ * the budget accumulates for up to a second
+ */
+
+static ngx_int_t
+ngx_http_file_cache_manager_budget(ngx_http_file_cache_t *cache)
+{
+    ngx_msec_t  elapsed;
+
+    if (ngx_process != NGX_PROCESS_HELPER
+        || (cache->manager_rate == 0 && cache->manager_bandwidth == 0))
+    {
+        return NGX_OK;
+    }
+
+    ngx_time_update();
+
+    elapsed = ngx_current_msec - cache->budget_time;
+    cache->budget_time = ngx_current_msec;
+
+    if (elapsed > 1000) {
+        elapsed = 1000;
+    }
+
+    if (cache->manager_rate) {
+        cache->budget_files += cache->manager_rate * elapsed;
+
+        if (cache->budget_files > (ngx_int_t) cache->manager_rate * 1000) {
+            cache->budget_files = cache->manager_rate * 1000;
+        }
+
+        if (cache->budget_files < 1000) {
+            return NGX_DECLINED;
+        }
+    }
+
+    if (cache->manager_bandwidth) {
+        cache->budget_size += cache->manager_bandwidth * (off_t) elapsed / 1000;
+
+        if (cache->budget_size > cache->manager_bandwidth) {
+            cache->budget_size = cache->manager_bandwidth;
+        }
+
+        if (cache->budget_size <= 0) {
+            return NGX_DECLINED;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
 static ngx_msec_t
 ngx_http_file_cache_manager(void *data)
 {
@@ -2006,6 +3118,11 @@ ngx_http_file_cache_manager(void *data)
             }
         }
 
+        if (ngx_http_file_cache_manager_budget(cache) != NGX_OK) {
+            next = cache->manager_sleep;
+            break;
+        }
+
         wait = ngx_http_file_cache_forced_expire(cache);
 
         if (wait > 0) {
@@ -2017,30 +3134,232 @@ ngx_http_file_cache_manager(void *data)
             break;
         }
 
-        if (++cache->files >= cache->manager_files) {
-            next = cache->manager_sleep;
-            break;
-        }
+        if (++cache->files >= cache->manager_files) {
+            next = cache->manager_sleep;
+            break;
+        }
+
+        ngx_time_update();
+
+        elapsed = ngx_abs((ngx_msec_int_t) (ngx_current_msec - cache->last));
+
+        if (elapsed >= cache->manager_threshold) {
+            next = cache->manager_sleep;
+            break;
+        }
+    }
+
+done:
+
+    if (cache->snapshot) {
+
+        if (cache->sh->cold) {
+
+            /*
+             * the cache loader process starts with a delay,
+             * load the snapshot as soon as possible
+             */
+
+            if (cache->sh->snapshot_time == 0
+                && ngx_atomic_cmp_set(&cache->sh->loading, 0, ngx_pid))
+            {
+                ngx_http_file_cache_snapshot_load(cache);
+                cache->sh->loading = 0;
+            }
+
+            next = ngx_min(next, 1000);
+
+        } else {
+            wait = cache->snapshot_last + cache->snapshot - ngx_time();
+
+            if (wait <= 0) {
+                cache->snapshot_last = ngx_time();
+                ngx_http_file_cache_snapshot(cache);
+
+                wait = cache->snapshot;
+            }
+
+            next = ngx_min(next, (ngx_msec_t) wait * 1000);
+        }
+    }
+
+    elapsed = ngx_abs((ngx_msec_int_t) (ngx_current_msec - cache->last));
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "http file cache manager: %ui e:%M n:%M",
+                   cache->files, elapsed, next);
+
+    return next;
+}
+
+
+static void
+ngx_http_file_cache_snapshot(ngx_http_file_cache_t *cache)
+{
+    off_t                                   offset;
+    size_t                                  size;
+    ngx_uint_t                              i, n, count, started;
+    ngx_file_t                              file;
+    ngx_rbtree_node_t                      *node, *sentinel;
+    ngx_http_file_cache_node_t             *fcn;
+    ngx_http_file_cache_snapshot_node_t    *sn, *nodes;
+    ngx_http_file_cache_snapshot_header_t   h;
+    u_char                                  key[NGX_HTTP_CACHE_KEY_LEN];
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+
+    file.name.len = cache->snapshot_name.len + sizeof(".tmp") - 1;
+    file.log = ngx_cycle->log;
+
+    file.name.data = ngx_alloc(file.name.len + 1, ngx_cycle->log);
+    if (file.name.data == NULL) {
+        return;
+    }
+
+    ngx_sprintf(file.name.data, "%V.tmp%Z", &cache->snapshot_name);
+
+    size = NGX_HTTP_CACHE_SNAPSHOT_NODES
+           * sizeof(ngx_http_file_cache_snapshot_node_t);
+
+    nodes = ngx_alloc(size, ngx_cycle->log);
+    if (nodes == NULL) {
+        ngx_free(file.name.data);
+        return;
+    }
+
+    file.fd = ngx_open_file(file.name.data, NGX_FILE_WRONLY,
+                            NGX_FILE_TRUNCATE, NGX_FILE_DEFAULT_ACCESS);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", file.name.data);
+        goto failed;
+    }
+
+    ngx_memzero(&h, sizeof(ngx_http_file_cache_snapshot_header_t));
+
+    /*
+     * files added after this time are found by the cache loader
+     * in the directories modified after the snapshot
+     */
+
+    h.version = cache->version;
+    h.node_size = sizeof(ngx_http_file_cache_snapshot_node_t);
+    h.time = ngx_time();
+
+    for (i = 0; i < NGX_MAX_PATH_LEVEL; i++) {
+        h.level[i] = (u_char) cache->path->level[i];
+    }
+
+    offset = sizeof(ngx_http_file_cache_snapshot_header_t);
+    count = 0;
+    started = 0;
+
+    do {
+        n = 0;
+
+        ngx_shmtx_lock(&cache->shpool->mutex);
+
+        sentinel = cache->sh->rbtree.sentinel;
+
+        if (started) {
+            fcn = ngx_http_file_cache_lookup_next(cache, key);
+            node = fcn ? &fcn->node : NULL;
+
+        } else {
+            node = cache->sh->rbtree.root;
+            node = (node == sentinel) ? NULL : ngx_rbtree_min(node, sentinel);
+            started = 1;
+        }
+
+        while (node && n < NGX_HTTP_CACHE_SNAPSHOT_NODES) {
+            fcn = (ngx_http_file_cache_node_t *) node;
+
+            ngx_memcpy(key, (u_char *) &node->key, sizeof(ngx_rbtree_key_t));
+            ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                       NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+            if (fcn->exists && !fcn->deleting) {
+                sn = &nodes[n++];
+
+                ngx_memcpy(sn->key, key, NGX_HTTP_CACHE_KEY_LEN);
+                sn->uniq = fcn->uniq;
+                sn->fs_size = fcn->fs_size;
+                sn->body_start = fcn->body_start;
+            }
+
+            node = ngx_rbtree_next(&cache->sh->rbtree, node);
+        }
+
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        if (n == 0) {
+            continue;
+        }
+
+        size = n * sizeof(ngx_http_file_cache_snapshot_node_t);
+
+        if (ngx_write_file(&file, (u_char *) nodes, size, offset)
+            == NGX_ERROR)
+        {
+            goto failed;
+        }
+
+        offset += size;
+        count += n;
+
+    } while (node);
+
+    h.count = count;
+
+    if (ngx_write_file(&file, (u_char *) &h,
+                       sizeof(ngx_http_file_cache_snapshot_header_t), 0)
+        == NGX_ERROR)
+    {
+        goto failed;
+    }
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", file.name.data);
+    }
+
+    file.fd = NGX_INVALID_FILE;
+
+    if (ngx_rename_file(file.name.data, cache->snapshot_name.data)
+        == NGX_FILE_ERROR)
+    {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_rename_file_n " \"%s\" to \"%s\" failed",
+                      file.name.data, cache->snapshot_name.data);
+        goto failed;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "http file cache snapshot: \"%V\" %ui",
+                   &cache->snapshot_name, count);
 
-        ngx_time_update();
+    ngx_free(nodes);
+    ngx_free(file.name.data);
 
-        elapsed = ngx_abs((ngx_msec_int_t) (ngx_current_msec - cache->last));
+    return;
 
-        if (elapsed >= cache->manager_threshold) {
-            next = cache->manager_sleep;
-            break;
+failed:
+
+    if (file.fd != NGX_INVALID_FILE) {
+        if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                          ngx_close_file_n " \"%s\" failed", file.name.data);
         }
     }
 
-done:
-
-    elapsed = ngx_abs((ngx_msec_int_t) (ngx_current_msec - cache->last));
-
-    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
-                   "http file cache manager: %ui e:%M n:%M",
-                   cache->files, elapsed, next);
+    if (ngx_delete_file(file.name.data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed", file.name.data);
+    }
 
-    return next;
+    ngx_free(nodes);
+    ngx_free(file.name.data);
 }
 
 
@@ -2051,12 +3370,24 @@ ngx_http_file_cache_loader(void *data)
 
     ngx_tree_ctx_t  tree;
 
-    if (!cache->sh->cold || cache->sh->loading) {
-        return;
-    }
+    for ( ;; ) {
+        if (!cache->sh->cold) {
+            return;
+        }
 
-    if (!ngx_atomic_cmp_set(&cache->sh->loading, 0, ngx_pid)) {
-        return;
+        if (!cache->sh->loading
+            && ngx_atomic_cmp_set(&cache->sh->loading, 0, ngx_pid))
+        {
+            break;
+        }
+
+        /* the snapshot may be being loaded by the cache manager */
+
+        if (!cache->snapshot || ngx_quit || ngx_terminate) {
+            return;
+        }
+
+        ngx_msleep(100);
     }
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
@@ -2074,6 +3405,10 @@ ngx_http_file_cache_loader(void *data)
     cache->last = ngx_current_msec;
     cache->files = 0;
 
+    if (cache->snapshot && cache->sh->snapshot_time == 0) {
+        ngx_http_file_cache_snapshot_load(cache);
+    }
+
     if (ngx_walk_tree(&tree, &cache->path->name) == NGX_ABORT) {
         cache->sh->loading = 0;
         return;
@@ -2090,6 +3425,175 @@ ngx_http_file_cache_loader(void *data)
 }
 
 
+static void
+ngx_http_file_cache_snapshot_load(ngx_http_file_cache_t *cache)
+{
+    off_t                                   offset;
+    size_t                                  size;
+    ssize_t                                 n;
+    ngx_uint_t                              i, k, count, loaded;
+    ngx_file_t                              file;
+    ngx_file_info_t                         fi;
+    ngx_http_file_cache_node_t             *fcn;
+    ngx_http_file_cache_snapshot_node_t    *sn, *nodes;
+    ngx_http_file_cache_snapshot_header_t   h;
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+
+    file.name = cache->snapshot_name;
+    file.log = ngx_cycle->log;
+
+    /* the snapshot is loaded once, even if it fails */
+
+    cache->sh->snapshot_time = -1;
+
+    file.fd = ngx_open_file(file.name.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        if (ngx_errno != NGX_ENOENT) {
+            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                          ngx_open_file_n " \"%s\" failed", file.name.data);
+        }
+
+        return;
+    }
+
+    nodes = NULL;
+    loaded = 0;
+
+    if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", file.name.data);
+        goto failed;
+    }
+
+    n = ngx_read_file(&file, (u_char *) &h,
+                      sizeof(ngx_http_file_cache_snapshot_header_t), 0);
+
+    if (n != sizeof(ngx_http_file_cache_snapshot_header_t)
+        || h.version != cache->version
+        || h.node_size != sizeof(ngx_http_file_cache_snapshot_node_t)
+        || ngx_file_size(&fi) != (off_t) (n + h.count * h.node_size))
+    {
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "cache snapshot \"%s\" is invalid, ignored",
+                      file.name.data);
+        goto failed;
+    }
+
+    for (i = 0; i < NGX_MAX_PATH_LEVEL; i++) {
+        if (h.level[i] != cache->path->level[i]) {
+            ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                          "cache snapshot \"%s\" has different levels, "
+                          "ignored", file.name.data);
+            goto failed;
+        }
+    }
+
+    size = NGX_HTTP_CACHE_SNAPSHOT_NODES
+           * sizeof(ngx_http_file_cache_snapshot_node_t);
+
+    nodes = ngx_alloc(size, ngx_cycle->log);
+    if (nodes == NULL) {
+        goto failed;
+    }
+
+    offset = sizeof(ngx_http_file_cache_snapshot_header_t);
+
+    for (count = 0; count < h.count; count += k) {
+
+        k = ngx_min(h.count - count, NGX_HTTP_CACHE_SNAPSHOT_NODES);
+        size = k * sizeof(ngx_http_file_cache_snapshot_node_t);
+
+        n = ngx_read_file(&file, (u_char *) nodes, size, offset);
+
+        if (n != (ssize_t) size) {
+            goto failed;
+        }
+
+        offset += size;
+
+        ngx_shmtx_lock(&cache->shpool->mutex);
+
+        for (i = 0; i < k; i++) {
+            sn = &nodes[i];
+
+            if (ngx_http_file_cache_lookup(cache, sn->key)) {
+                continue;
+            }
+
+            fcn = ngx_slab_calloc_locked(cache->shpool,
+                                         sizeof(ngx_http_file_cache_node_t));
+            if (fcn == NULL) {
+                ngx_http_file_cache_set_watermark(cache);
+                ngx_shmtx_unlock(&cache->shpool->mutex);
+
+                ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                           "could not allocate node%s", cache->shpool->log_ctx);
+                goto failed;
+            }
+
+            cache->sh->count++;
+
+            ngx_memcpy((u_char *) &fcn->node.key, sn->key,
+                       sizeof(ngx_rbtree_key_t));
+
+            ngx_memcpy(fcn->key, &sn->key[sizeof(ngx_rbtree_key_t)],
+                       NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+            ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+
+            fcn->uses = 1;
+            fcn->exists = 1;
+            fcn->uniq = sn->uniq;
+            fcn->fs_size = sn->fs_size;
+            fcn->body_start = sn->body_start;
+            fcn->expire = ngx_time() + cache->inactive;
+
+            ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+
+            cache->sh->size += sn->fs_size;
+
+            loaded++;
+        }
+
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        if (ngx_quit || ngx_terminate) {
+            goto failed;
+        }
+    }
+
+    ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
+                  "http file cache: %V %ui entries loaded from snapshot",
+                  &cache->path->name, loaded);
+
+    ngx_free(nodes);
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", file.name.data);
+    }
+
+    cache->sh->snapshot_time = h.time;
+
+    return;
+
+failed:
+
+    /* entries already loaded are kept, the whole tree is walked */
+
+    if (nodes) {
+        ngx_free(nodes);
+    }
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", file.name.data);
+    }
+}
+
+
 static ngx_int_t
 ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 {
@@ -2105,6 +3609,18 @@ ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 
     cache = ctx->data;
 
+    if (path->len == cache->snapshot_name.len
+        && ngx_strncmp(path->data, cache->snapshot_name.data, path->len) == 0)
+    {
+        return NGX_OK;
+    }
+
+    if (path->len == cache->key_seed_name.len
+        && ngx_strncmp(path->data, cache->key_seed_name.data, path->len) == 0)
+    {
+        return NGX_OK;
+    }
+
     if (ngx_http_file_cache_add_file(ctx, path) != NGX_OK) {
         (void) ngx_http_file_cache_delete_file(ctx, path);
     }
@@ -2132,12 +3648,28 @@ ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 static ngx_int_t
 ngx_http_file_cache_manage_directory(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 {
+    ngx_http_file_cache_t  *cache;
+
     if (path->len >= 5
         && ngx_strncmp(path->data + path->len - 5, "/temp", 5) == 0)
     {
         return NGX_DECLINED;
     }
 
+    cache = ctx->data;
+
+    /*
+     * files in the last level directories not modified since
+     * the snapshot was written are already loaded from the snapshot
+     */
+
+    if (cache->sh->snapshot_time > 0
+        && path->len == cache->path->name.len + cache->path->len
+        && ctx->mtime < cache->sh->snapshot_time)
+    {
+        return NGX_DECLINED;
+    }
+
     return NGX_OK;
 }
 
@@ -2319,15 +3851,17 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     char  *confp = conf;
 
-    off_t                   max_size, min_free;
+    off_t                   max_size, min_free, manager_bandwidth;
     u_char                 *last, *p;
     time_t                  inactive;
-    ssize_t                 size;
+    ssize_t                 size, memory_size, memory_max_size;
     ngx_str_t               s, name, *value;
-    ngx_int_t               loader_files, manager_files;
+    ngx_shm_zone_t         *shm_zone;
+    ngx_int_t               loader_files, manager_files, manager_rate;
+    time_t                  snapshot;
     ngx_msec_t              loader_sleep, manager_sleep, loader_threshold,
                             manager_threshold;
-    ngx_uint_t              i, n, use_temp_path;
+    ngx_uint_t              i, n, use_temp_path, tinylfu, key_hash;
     ngx_array_t            *caches;
     ngx_http_file_cache_t  *cache, **ce;
 
@@ -2336,12 +3870,16 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    ngx_queue_init(&cache->waiters);
+
     cache->path = ngx_pcalloc(cf->pool, sizeof(ngx_path_t));
     if (cache->path == NULL) {
         return NGX_CONF_ERROR;
     }
 
     use_temp_path = 1;
+    tinylfu = 0;
+    key_hash = NGX_HTTP_CACHE_MD5;
 
     inactive = 600;
 
@@ -2352,12 +3890,19 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     manager_files = 100;
     manager_sleep = 50;
     manager_threshold = 200;
+    manager_rate = 0;
+    manager_bandwidth = 0;
+
+    snapshot = 0;
 
     name.len = 0;
     size = 0;
     max_size = NGX_MAX_OFF_T_VALUE;
     min_free = 0;
 
+    memory_size = 0;
+    memory_max_size = 64 * 1024;
+
     value = cf->args->elts;
 
     cache->path->name = value[1];
@@ -2428,6 +3973,44 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "policy=", 7) == 0) {
+
+            if (ngx_strcmp(&value[i].data[7], "lru") == 0) {
+                tinylfu = 0;
+
+            } else if (ngx_strcmp(&value[i].data[7], "tinylfu") == 0) {
+                tinylfu = 1;
+
+            } else {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid policy value \"%V\", "
+                                   "it must be \"lru\" or \"tinylfu\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "key_hash=", 9) == 0) {
+
+            if (ngx_strcmp(&value[i].data[9], "md5") == 0) {
+                key_hash = NGX_HTTP_CACHE_MD5;
+
+            } else if (ngx_strcmp(&value[i].data[9], "murmur3") == 0) {
+                key_hash = NGX_HTTP_CACHE_MURMUR3;
+
+            } else {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid key_hash value \"%V\", "
+                                   "it must be \"md5\" or \"murmur3\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "keys_zone=", 10) == 0) {
 
             name.data = value[i].data + 10;
@@ -2515,6 +4098,47 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "memory_tier=", 12) == 0) {
+
+            s.len = value[i].len - 12;
+            s.data = value[i].data + 12;
+
+            memory_size = ngx_parse_size(&s);
+
+            if (memory_size == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid memory_tier value \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            if (memory_size < (ssize_t) (8 * ngx_pagesize)) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "memory tier \"%V\" is too small",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "memory_tier_max=", 16) == 0) {
+
+            s.len = value[i].len - 16;
+            s.data = value[i].data + 16;
+
+            memory_max_size = ngx_parse_size(&s);
+
+            if (memory_max_size == NGX_ERROR || memory_max_size == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid memory_tier_max value \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "loader_files=", 13) == 0) {
 
             loader_files = ngx_atoi(value[i].data + 13, value[i].len - 13);
@@ -2599,6 +4223,67 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "manager_rate=", 13) == 0) {
+
+            manager_rate = ngx_atoi(value[i].data + 13, value[i].len - 13);
+            if (manager_rate == NGX_ERROR || manager_rate == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid manager_rate value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "manager_bandwidth=", 18) == 0) {
+
+            s.len = value[i].len - 18;
+            s.data = value[i].data + 18;
+
+            manager_bandwidth = ngx_parse_offset(&s);
+            if (manager_bandwidth == NGX_ERROR || manager_bandwidth == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid manager_bandwidth value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "manager_threads=", 16) == 0) {
+#if (NGX_THREADS)
+            s.len = value[i].len - 16;
+            s.data = value[i].data + 16;
+
+            cache->thread_pool = ngx_thread_pool_add_helper(cf, &s);
+            if (cache->thread_pool == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "\"manager_threads\" is unsupported "
+                               "on this platform");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
+        if (ngx_strncmp(value[i].data, "snapshot=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            snapshot = ngx_parse_time(&s, 1);
+            if (snapshot == (time_t) NGX_ERROR || snapshot == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid snapshot value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -2622,6 +4307,19 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     cache->manager_files = manager_files;
     cache->manager_sleep = manager_sleep;
     cache->manager_threshold = manager_threshold;
+    cache->manager_rate = manager_rate;
+    cache->manager_bandwidth = manager_bandwidth;
+    cache->snapshot = snapshot;
+
+    cache->snapshot_name.len = cache->path->name.len + sizeof("/snapshot") - 1;
+    cache->snapshot_name.data = ngx_pnalloc(cf->pool,
+                                            cache->snapshot_name.len + 1);
+    if (cache->snapshot_name.data == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_sprintf(cache->snapshot_name.data, "%V/snapshot%Z",
+                &cache->path->name);
 
     if (ngx_add_path(cf, &cache->path) != NGX_OK) {
         return NGX_CONF_ERROR;
@@ -2642,7 +4340,45 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     cache->shm_zone->init = ngx_http_file_cache_init;
     cache->shm_zone->data = cache;
 
+    if (memory_size) {
+        s.len = name.len + sizeof(":memory") - 1;
+        s.data = ngx_pnalloc(cf->pool, s.len);
+        if (s.data == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_sprintf(s.data, "%V:memory", &name);
+
+        shm_zone = ngx_shared_memory_add(cf, &s, memory_size, cmd->post);
+        if (shm_zone == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        shm_zone->init = ngx_http_file_cache_memory_init;
+        shm_zone->data = cache;
+
+        cache->memory_max_size = memory_max_size;
+    }
+
     cache->use_temp_path = use_temp_path;
+    cache->tinylfu = tinylfu;
+
+    cache->key_hash = key_hash;
+    cache->version = NGX_HTTP_CACHE_VERSION
+                     + key_hash * NGX_HTTP_CACHE_VERSION_HASH;
+
+    if (key_hash == NGX_HTTP_CACHE_MURMUR3) {
+        cache->key_seed_name.len = cache->path->name.len
+                                   + sizeof("/key_seed") - 1;
+        cache->key_seed_name.data = ngx_pnalloc(cf->pool,
+                                                cache->key_seed_name.len + 1);
+        if (cache->key_seed_name.data == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_sprintf(cache->key_seed_name.data, "%V/key_seed%Z",
+                    &cache->path->name);
+    }
 
     cache->inactive = inactive;
     cache->max_size = max_size;
@@ -18,8 +18,13 @@ typedef struct {
 } ngx_http_huff_decode_code_t;
 
 
+#define NGX_HTTP_HUFF_DECODE_FAST_BITS  11
+
+
 static ngx_inline ngx_int_t ngx_http_huff_decode_bits(u_char *state,
     u_char *ending, ngx_uint_t bits, u_char **dst);
+static u_char *ngx_http_huff_decode_fast(u_char *src, u_char *end,
+    u_char **dst);
 
 
 static ngx_http_huff_decode_code_t  ngx_http_huff_decode_codes[256][16] =
@@ -2639,6 +2644,273 @@ static ngx_http_huff_decode_code_t  ngx_http_huff_decode_codes[256][16] =
 };
 
 
+/*
+ * codes up to NGX_HTTP_HUFF_DECODE_FAST_BITS long indexed by the next
+ * 11 bits of input: code length in the high byte and symbol in the low one,
+ * zero for prefixes of longer codes
+ */
+
+static uint16_t  ngx_http_huff_decode_fast_codes[2048] =
+{
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530, 0x0530,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531, 0x0531,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532, 0x0532,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561, 0x0561,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563, 0x0563,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565, 0x0565,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569, 0x0569,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f, 0x056f,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573, 0x0573,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574, 0x0574,
+    0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620,
+    0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620,
+    0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620,
+    0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620, 0x0620,
+    0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625,
+    0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625,
+    0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625,
+    0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625, 0x0625,
+    0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d,
+    0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d,
+    0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d,
+    0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d, 0x062d,
+    0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e,
+    0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e,
+    0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e,
+    0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e, 0x062e,
+    0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f,
+    0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f,
+    0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f,
+    0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f, 0x062f,
+    0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633,
+    0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633,
+    0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633,
+    0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633, 0x0633,
+    0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634,
+    0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634,
+    0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634,
+    0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634, 0x0634,
+    0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635,
+    0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635,
+    0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635,
+    0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635, 0x0635,
+    0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636,
+    0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636,
+    0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636,
+    0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636, 0x0636,
+    0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637,
+    0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637,
+    0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637,
+    0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637, 0x0637,
+    0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638,
+    0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638,
+    0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638,
+    0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638, 0x0638,
+    0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639,
+    0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639,
+    0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639,
+    0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639, 0x0639,
+    0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d,
+    0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d,
+    0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d,
+    0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d, 0x063d,
+    0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641,
+    0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641,
+    0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641,
+    0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641, 0x0641,
+    0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f,
+    0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f,
+    0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f,
+    0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f, 0x065f,
+    0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662,
+    0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662,
+    0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662,
+    0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662, 0x0662,
+    0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664,
+    0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664,
+    0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664,
+    0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664, 0x0664,
+    0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666,
+    0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666,
+    0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666,
+    0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666, 0x0666,
+    0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667,
+    0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667,
+    0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667,
+    0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667, 0x0667,
+    0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668,
+    0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668,
+    0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668,
+    0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668, 0x0668,
+    0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c,
+    0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c,
+    0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c,
+    0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c, 0x066c,
+    0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d,
+    0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d,
+    0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d,
+    0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d, 0x066d,
+    0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e,
+    0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e,
+    0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e,
+    0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e, 0x066e,
+    0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670,
+    0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670,
+    0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670,
+    0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670, 0x0670,
+    0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672,
+    0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672,
+    0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672,
+    0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672, 0x0672,
+    0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675,
+    0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675,
+    0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675,
+    0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675, 0x0675,
+    0x073a, 0x073a, 0x073a, 0x073a, 0x073a, 0x073a, 0x073a, 0x073a,
+    0x073a, 0x073a, 0x073a, 0x073a, 0x073a, 0x073a, 0x073a, 0x073a,
+    0x0742, 0x0742, 0x0742, 0x0742, 0x0742, 0x0742, 0x0742, 0x0742,
+    0x0742, 0x0742, 0x0742, 0x0742, 0x0742, 0x0742, 0x0742, 0x0742,
+    0x0743, 0x0743, 0x0743, 0x0743, 0x0743, 0x0743, 0x0743, 0x0743,
+    0x0743, 0x0743, 0x0743, 0x0743, 0x0743, 0x0743, 0x0743, 0x0743,
+    0x0744, 0x0744, 0x0744, 0x0744, 0x0744, 0x0744, 0x0744, 0x0744,
+    0x0744, 0x0744, 0x0744, 0x0744, 0x0744, 0x0744, 0x0744, 0x0744,
+    0x0745, 0x0745, 0x0745, 0x0745, 0x0745, 0x0745, 0x0745, 0x0745,
+    0x0745, 0x0745, 0x0745, 0x0745, 0x0745, 0x0745, 0x0745, 0x0745,
+    0x0746, 0x0746, 0x0746, 0x0746, 0x0746, 0x0746, 0x0746, 0x0746,
+    0x0746, 0x0746, 0x0746, 0x0746, 0x0746, 0x0746, 0x0746, 0x0746,
+    0x0747, 0x0747, 0x0747, 0x0747, 0x0747, 0x0747, 0x0747, 0x0747,
+    0x0747, 0x0747, 0x0747, 0x0747, 0x0747, 0x0747, 0x0747, 0x0747,
+    0x0748, 0x0748, 0x0748, 0x0748, 0x0748, 0x0748, 0x0748, 0x0748,
+    0x0748, 0x0748, 0x0748, 0x0748, 0x0748, 0x0748, 0x0748, 0x0748,
+    0x0749, 0x0749, 0x0749, 0x0749, 0x0749, 0x0749, 0x0749, 0x0749,
+    0x0749, 0x0749, 0x0749, 0x0749, 0x0749, 0x0749, 0x0749, 0x0749,
+    0x074a, 0x074a, 0x074a, 0x074a, 0x074a, 0x074a, 0x074a, 0x074a,
+    0x074a, 0x074a, 0x074a, 0x074a, 0x074a, 0x074a, 0x074a, 0x074a,
+    0x074b, 0x074b, 0x074b, 0x074b, 0x074b, 0x074b, 0x074b, 0x074b,
+    0x074b, 0x074b, 0x074b, 0x074b, 0x074b, 0x074b, 0x074b, 0x074b,
+    0x074c, 0x074c, 0x074c, 0x074c, 0x074c, 0x074c, 0x074c, 0x074c,
+    0x074c, 0x074c, 0x074c, 0x074c, 0x074c, 0x074c, 0x074c, 0x074c,
+    0x074d, 0x074d, 0x074d, 0x074d, 0x074d, 0x074d, 0x074d, 0x074d,
+    0x074d, 0x074d, 0x074d, 0x074d, 0x074d, 0x074d, 0x074d, 0x074d,
+    0x074e, 0x074e, 0x074e, 0x074e, 0x074e, 0x074e, 0x074e, 0x074e,
+    0x074e, 0x074e, 0x074e, 0x074e, 0x074e, 0x074e, 0x074e, 0x074e,
+    0x074f, 0x074f, 0x074f, 0x074f, 0x074f, 0x074f, 0x074f, 0x074f,
+    0x074f, 0x074f, 0x074f, 0x074f, 0x074f, 0x074f, 0x074f, 0x074f,
+    0x0750, 0x0750, 0x0750, 0x0750, 0x0750, 0x0750, 0x0750, 0x0750,
+    0x0750, 0x0750, 0x0750, 0x0750, 0x0750, 0x0750, 0x0750, 0x0750,
+    0x0751, 0x0751, 0x0751, 0x0751, 0x0751, 0x0751, 0x0751, 0x0751,
+    0x0751, 0x0751, 0x0751, 0x0751, 0x0751, 0x0751, 0x0751, 0x0751,
+    0x0752, 0x0752, 0x0752, 0x0752, 0x0752, 0x0752, 0x0752, 0x0752,
+    0x0752, 0x0752, 0x0752, 0x0752, 0x0752, 0x0752, 0x0752, 0x0752,
+    0x0753, 0x0753, 0x0753, 0x0753, 0x0753, 0x0753, 0x0753, 0x0753,
+    0x0753, 0x0753, 0x0753, 0x0753, 0x0753, 0x0753, 0x0753, 0x0753,
+    0x0754, 0x0754, 0x0754, 0x0754, 0x0754, 0x0754, 0x0754, 0x0754,
+    0x0754, 0x0754, 0x0754, 0x0754, 0x0754, 0x0754, 0x0754, 0x0754,
+    0x0755, 0x0755, 0x0755, 0x0755, 0x0755, 0x0755, 0x0755, 0x0755,
+    0x0755, 0x0755, 0x0755, 0x0755, 0x0755, 0x0755, 0x0755, 0x0755,
+    0x0756, 0x0756, 0x0756, 0x0756, 0x0756, 0x0756, 0x0756, 0x0756,
+    0x0756, 0x0756, 0x0756, 0x0756, 0x0756, 0x0756, 0x0756, 0x0756,
+    0x0757, 0x0757, 0x0757, 0x0757, 0x0757, 0x0757, 0x0757, 0x0757,
+    0x0757, 0x0757, 0x0757, 0x0757, 0x0757, 0x0757, 0x0757, 0x0757,
+    0x0759, 0x0759, 0x0759, 0x0759, 0x0759, 0x0759, 0x0759, 0x0759,
+    0x0759, 0x0759, 0x0759, 0x0759, 0x0759, 0x0759, 0x0759, 0x0759,
+    0x076a, 0x076a, 0x076a, 0x076a, 0x076a, 0x076a, 0x076a, 0x076a,
+    0x076a, 0x076a, 0x076a, 0x076a, 0x076a, 0x076a, 0x076a, 0x076a,
+    0x076b, 0x076b, 0x076b, 0x076b, 0x076b, 0x076b, 0x076b, 0x076b,
+    0x076b, 0x076b, 0x076b, 0x076b, 0x076b, 0x076b, 0x076b, 0x076b,
+    0x0771, 0x0771, 0x0771, 0x0771, 0x0771, 0x0771, 0x0771, 0x0771,
+    0x0771, 0x0771, 0x0771, 0x0771, 0x0771, 0x0771, 0x0771, 0x0771,
+    0x0776, 0x0776, 0x0776, 0x0776, 0x0776, 0x0776, 0x0776, 0x0776,
+    0x0776, 0x0776, 0x0776, 0x0776, 0x0776, 0x0776, 0x0776, 0x0776,
+    0x0777, 0x0777, 0x0777, 0x0777, 0x0777, 0x0777, 0x0777, 0x0777,
+    0x0777, 0x0777, 0x0777, 0x0777, 0x0777, 0x0777, 0x0777, 0x0777,
+    0x0778, 0x0778, 0x0778, 0x0778, 0x0778, 0x0778, 0x0778, 0x0778,
+    0x0778, 0x0778, 0x0778, 0x0778, 0x0778, 0x0778, 0x0778, 0x0778,
+    0x0779, 0x0779, 0x0779, 0x0779, 0x0779, 0x0779, 0x0779, 0x0779,
+    0x0779, 0x0779, 0x0779, 0x0779, 0x0779, 0x0779, 0x0779, 0x0779,
+    0x077a, 0x077a, 0x077a, 0x077a, 0x077a, 0x077a, 0x077a, 0x077a,
+    0x077a, 0x077a, 0x077a, 0x077a, 0x077a, 0x077a, 0x077a, 0x077a,
+    0x0826, 0x0826, 0x0826, 0x0826, 0x0826, 0x0826, 0x0826, 0x0826,
+    0x082a, 0x082a, 0x082a, 0x082a, 0x082a, 0x082a, 0x082a, 0x082a,
+    0x082c, 0x082c, 0x082c, 0x082c, 0x082c, 0x082c, 0x082c, 0x082c,
+    0x083b, 0x083b, 0x083b, 0x083b, 0x083b, 0x083b, 0x083b, 0x083b,
+    0x0858, 0x0858, 0x0858, 0x0858, 0x0858, 0x0858, 0x0858, 0x0858,
+    0x085a, 0x085a, 0x085a, 0x085a, 0x085a, 0x085a, 0x085a, 0x085a,
+    0x0a21, 0x0a21, 0x0a22, 0x0a22, 0x0a28, 0x0a28, 0x0a29, 0x0a29,
+    0x0a3f, 0x0a3f, 0x0b27, 0x0b2b, 0x0b7c, 0x0000, 0x0000, 0x0000
+};
+
+
 ngx_int_t
 ngx_http_huff_decode(u_char *state, u_char *src, size_t len, u_char **dst,
     ngx_uint_t last, ngx_log_t *log)
@@ -2651,6 +2923,15 @@ ngx_http_huff_decode(u_char *state, u_char *src, size_t len, u_char **dst,
     end = src + len;
 
     while (src != end) {
+
+        if (*state == 0 && end - src > 1) {
+            src = ngx_http_huff_decode_fast(src, end, dst);
+
+            if (src == end) {
+                break;
+            }
+        }
+
         ch = *src++;
 
         if (ngx_http_huff_decode_bits(state, &ending, ch >> 4, dst)
@@ -2712,3 +2993,64 @@ ngx_http_huff_decode_bits(u_char *state, u_char *ending, ngx_uint_t bits,
 
     return NGX_OK;
 }
+
+
+/*
+ * Decodes whole codes of up to NGX_HTTP_HUFF_DECODE_FAST_BITS bits with
+ * a single table lookup each.  Stops at the first longer code or when the
+ * input is nearly exhausted, and returns the input position right after the
+ * last code ending on a byte boundary, so the state machine can continue
+ * from the initial state there.
+ */
+
+static u_char *
+ngx_http_huff_decode_fast(u_char *src, u_char *end, u_char **dst)
+{
+    u_char      *d, *pos, *last;
+    uint64_t     buf;
+    ngx_uint_t   n, bits, code, len;
+
+    d = *dst;
+    last = d;
+    pos = src;
+
+    buf = 0;
+    bits = 0;
+
+    for ( ;; ) {
+
+        if (bits < NGX_HTTP_HUFF_DECODE_FAST_BITS * 2) {
+            while (bits <= 56 && src != end) {
+                buf |= (uint64_t) *src++ << (56 - bits);
+                bits += 8;
+            }
+        }
+
+        if (bits < NGX_HTTP_HUFF_DECODE_FAST_BITS) {
+            break;
+        }
+
+        n = buf >> (64 - NGX_HTTP_HUFF_DECODE_FAST_BITS);
+
+        code = ngx_http_huff_decode_fast_codes[n];
+        len = code >> 8;
+
+        if (len == 0) {
+            break;
+        }
+
+        *d++ = (u_char) code;
+
+        buf <<= len;
+        bits -= len;
+
+        if ((bits & 7) == 0) {
+            pos = src - bits / 8;
+            last = d;
+        }
+    }
+
+    *dst = last;
+
+    return pos;
+}
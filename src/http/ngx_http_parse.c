@@ -9,6 +9,20 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#if (NGX_HAVE_GCC_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+
+static ngx_inline u_char *ngx_http_parse_skip_uri(u_char *p, u_char *last);
+static ngx_inline u_char *ngx_http_parse_skip_name(u_char *p, u_char *last);
+static ngx_inline u_char *ngx_http_parse_skip_value(u_char *p, u_char *last);
+#if (NGX_HAVE_GCC_X86_SIMD)
+static u_char *ngx_http_parse_skip_uri_avx2(u_char *p, u_char *last);
+static u_char *ngx_http_parse_skip_name_avx2(u_char *p, u_char *last);
+static u_char *ngx_http_parse_skip_value_avx2(u_char *p, u_char *last);
+#endif
+
 
 static uint32_t  usual[] = {
     0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
@@ -604,6 +618,9 @@ ngx_http_parse_request_line(ngx_http_request_t *r, ngx_buf_t *b)
         /* URI */
         case sw_uri:
 
+            p = ngx_http_parse_skip_uri(p, b->last);
+            ch = *p;
+
             if (usual[ch >> 5] & (1U << (ch & 0x1f))) {
                 break;
             }
@@ -819,14 +836,13 @@ ngx_int_t
 ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
     ngx_uint_t allow_underscores)
 {
-    u_char      c, ch, *p;
+    u_char      c, ch, *p, *m;
     ngx_uint_t  hash, i;
     enum {
         sw_start = 0,
         sw_name,
         sw_space_before_value,
         sw_value,
-        sw_space_after_value,
         sw_ignore_line,
         sw_almost_done,
         sw_header_almost_done
@@ -909,6 +925,15 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
 
         /* header name */
         case sw_name:
+
+            for (m = ngx_http_parse_skip_name(p, b->last); p < m; p++) {
+                c = lowcase[*p];
+                hash = ngx_hash(hash, c);
+                r->lowcase_header[i++] = c;
+                i &= (NGX_HTTP_LC_HEADER_LEN - 1);
+            }
+
+            ch = *p;
             c = lowcase[ch];
 
             if (c) {
@@ -995,42 +1020,28 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
             }
             break;
 
-        /* header value */
+        /*
+         * header value, the value starts with a non-space character,
+         * trailing spaces are skipped when the end of line is found
+         */
         case sw_value:
-            switch (ch) {
-            case ' ':
-                r->header_end = p;
-                state = sw_space_after_value;
-                break;
-            case CR:
-                r->header_end = p;
-                state = sw_almost_done;
-                break;
-            case LF:
-                r->header_end = p;
-                goto done;
-            case '\0':
-                r->header_end = p;
-                return NGX_HTTP_PARSE_INVALID_HEADER;
-            }
-            break;
 
-        /* space* before end of header line */
-        case sw_space_after_value:
+            p = ngx_http_parse_skip_value(p, b->last);
+            ch = *p;
+
             switch (ch) {
-            case ' ':
-                break;
             case CR:
+                for (m = p; m[-1] == ' '; m--) { /* void */ }
+                r->header_end = m;
                 state = sw_almost_done;
                 break;
             case LF:
+                for (m = p; m[-1] == ' '; m--) { /* void */ }
+                r->header_end = m;
                 goto done;
             case '\0':
                 r->header_end = p;
                 return NGX_HTTP_PARSE_INVALID_HEADER;
-            default:
-                state = sw_value;
-                break;
             }
             break;
 
@@ -2413,3 +2424,227 @@ invalid:
 
     return NGX_ERROR;
 }
+
+
+/*
+ * the ngx_http_parse_skip_*() functions return the end of a run of bytes
+ * that need no processing in the corresponding parser state: the first
+ * byte that does, or a position less than 16 bytes before the end of
+ * the buffer, the rest is handled byte by byte
+ */
+
+static ngx_inline u_char *
+ngx_http_parse_skip_uri(u_char *p, u_char *last)
+{
+#if (NGX_HAVE_GCC_X86_SIMD)
+    int      m;
+    __m128i  v, sp, del, hash;
+
+    /* control characters, space, DEL, and '#' */
+
+    if (ngx_cpu_features & NGX_CPU_AVX2) {
+        p = ngx_http_parse_skip_uri_avx2(p, last);
+    }
+
+    sp = _mm_set1_epi8(' ');
+    del = _mm_set1_epi8(0x7f);
+    hash = _mm_set1_epi8('#');
+
+    while (last - p > 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        m = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, sp), v),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, del),
+                                          _mm_cmpeq_epi8(v, hash))));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 16;
+    }
+#endif
+
+    return p;
+}
+
+
+static ngx_inline u_char *
+ngx_http_parse_skip_name(u_char *p, u_char *last)
+{
+#if (NGX_HAVE_GCC_X86_SIMD)
+    int      m;
+    __m128i  v, l, d, a, z, zero, nine, dash, lower;
+
+    /* anything but letters, digits, and '-' */
+
+    if (ngx_cpu_features & NGX_CPU_AVX2) {
+        p = ngx_http_parse_skip_name_avx2(p, last);
+    }
+
+    a = _mm_set1_epi8('a');
+    z = _mm_set1_epi8('z' - 'a');
+    zero = _mm_set1_epi8('0');
+    nine = _mm_set1_epi8('9' - '0');
+    dash = _mm_set1_epi8('-');
+    lower = _mm_set1_epi8(0x20);
+
+    while (last - p > 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        l = _mm_sub_epi8(_mm_or_si128(v, lower), a);
+        l = _mm_cmpeq_epi8(_mm_min_epu8(l, z), l);
+
+        d = _mm_sub_epi8(v, zero);
+        d = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+
+        v = _mm_or_si128(_mm_cmpeq_epi8(v, dash), _mm_or_si128(l, d));
+
+        m = _mm_movemask_epi8(v) ^ 0xffff;
+
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 16;
+    }
+#endif
+
+    return p;
+}
+
+
+static ngx_inline u_char *
+ngx_http_parse_skip_value(u_char *p, u_char *last)
+{
+#if (NGX_HAVE_GCC_X86_SIMD)
+    int      m;
+    __m128i  v, cr, lf, zero;
+
+    /* CR, LF, and '\0' */
+
+    if (ngx_cpu_features & NGX_CPU_AVX2) {
+        p = ngx_http_parse_skip_value_avx2(p, last);
+    }
+
+    cr = _mm_set1_epi8(CR);
+    lf = _mm_set1_epi8(LF);
+    zero = _mm_setzero_si128();
+
+    while (last - p > 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        m = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, lf),
+                                          _mm_cmpeq_epi8(v, zero))));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 16;
+    }
+#endif
+
+    return p;
+}
+
+
+#if (NGX_HAVE_GCC_X86_SIMD)
+
+__attribute__ ((target ("avx2")))
+static u_char *
+ngx_http_parse_skip_uri_avx2(u_char *p, u_char *last)
+{
+    unsigned  m;
+    __m256i   v, sp, del, hash;
+
+    sp = _mm256_set1_epi8(' ');
+    del = _mm256_set1_epi8(0x7f);
+    hash = _mm256_set1_epi8('#');
+
+    while (last - p > 32) {
+        v = _mm256_loadu_si256((__m256i *) p);
+
+        m = _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, sp), v),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(v, del),
+                                                _mm256_cmpeq_epi8(v, hash))));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 32;
+    }
+
+    return p;
+}
+
+
+__attribute__ ((target ("avx2")))
+static u_char *
+ngx_http_parse_skip_name_avx2(u_char *p, u_char *last)
+{
+    unsigned  m;
+    __m256i   v, l, d, a, z, zero, nine, dash, lower;
+
+    a = _mm256_set1_epi8('a');
+    z = _mm256_set1_epi8('z' - 'a');
+    zero = _mm256_set1_epi8('0');
+    nine = _mm256_set1_epi8('9' - '0');
+    dash = _mm256_set1_epi8('-');
+    lower = _mm256_set1_epi8(0x20);
+
+    while (last - p > 32) {
+        v = _mm256_loadu_si256((__m256i *) p);
+
+        l = _mm256_sub_epi8(_mm256_or_si256(v, lower), a);
+        l = _mm256_cmpeq_epi8(_mm256_min_epu8(l, z), l);
+
+        d = _mm256_sub_epi8(v, zero);
+        d = _mm256_cmpeq_epi8(_mm256_min_epu8(d, nine), d);
+
+        v = _mm256_or_si256(_mm256_cmpeq_epi8(v, dash), _mm256_or_si256(l, d));
+
+        m = ~ (unsigned) _mm256_movemask_epi8(v);
+
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 32;
+    }
+
+    return p;
+}
+
+
+__attribute__ ((target ("avx2")))
+static u_char *
+ngx_http_parse_skip_value_avx2(u_char *p, u_char *last)
+{
+    unsigned  m;
+    __m256i   v, cr, lf, zero;
+
+    cr = _mm256_set1_epi8(CR);
+    lf = _mm256_set1_epi8(LF);
+    zero = _mm256_setzero_si256();
+
+    while (last - p > 32) {
+        v = _mm256_loadu_si256((__m256i *) p);
+
+        m = _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(v, lf),
+                                                _mm256_cmpeq_epi8(v, zero))));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+
+        p += 32;
+    }
+
+    return p;
+}
+
+#endif
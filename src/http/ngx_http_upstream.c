@@ -77,6 +77,12 @@ static void
 static void
     ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
     ngx_uint_t do_write);
+#if (NGX_HAVE_SPLICE)
+static ngx_int_t ngx_http_upstream_init_splice(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_process_splice(ngx_http_request_t *r,
+    ngx_http_upstream_t *u);
+#endif
 #if (NGX_THREADS)
 static ngx_int_t ngx_http_upstream_thread_handler(ngx_thread_task_t *task,
     ngx_file_t *file);
@@ -848,6 +854,8 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
             return NGX_ERROR;
         }
 
+        r->cache->file_cache = cache;
+
         if (u->create_key(r) != NGX_OK) {
             return NGX_ERROR;
         }
@@ -873,7 +881,6 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
         c->body_start = u->conf->buffer_size;
         c->min_uses = u->conf->cache_min_uses;
-        c->file_cache = cache;
 
         switch (ngx_http_test_predicates(r, u->conf->cache_bypass)) {
 
@@ -3662,6 +3669,18 @@ ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
 
     for ( ;; ) {
 
+#if (NGX_HAVE_SPLICE)
+
+        if (u->splice_pipe) {
+            if (ngx_http_upstream_process_splice(r, u) == NGX_DONE) {
+                return;
+            }
+
+            break;
+        }
+
+#endif
+
         if (do_write) {
 
             if (u->out_bufs || u->busy_bufs || downstream->buffered) {
@@ -3702,6 +3721,23 @@ ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
 
                 b->pos = b->start;
                 b->last = b->start;
+
+#if (NGX_HAVE_SPLICE)
+
+                if (u->splice) {
+                    rc = ngx_http_upstream_init_splice(r, u);
+
+                    if (rc == NGX_ERROR) {
+                        ngx_http_upstream_finalize_request(r, u, NGX_ERROR);
+                        return;
+                    }
+
+                    if (rc == NGX_OK) {
+                        continue;
+                    }
+                }
+
+#endif
             }
         }
 
@@ -3772,6 +3808,156 @@ ngx_http_upstream_process_non_buffered_request(ngx_http_request_t *r,
 }
 
 
+#if (NGX_HAVE_SPLICE)
+
+static ngx_int_t
+ngx_http_upstream_init_splice(ngx_http_request_t *r, ngx_http_upstream_t *u)
+{
+    ngx_connection_t  *c;
+
+    c = r->connection;
+
+    u->splice = 0;
+
+    /*
+     * the spliced body bypasses the body filters, so let them see
+     * the start of the body and check that none of them needs the data
+     */
+
+    if (ngx_http_send_special(r, NGX_HTTP_FLUSH) == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (r != r->main
+        || c->data != r
+        || r->postponed
+        || c->buffered
+        || r->chunked
+        || r->allow_ranges
+        || r->filter_need_in_memory
+        || r->main_filter_need_in_memory
+        || r->filter_need_temporary
+        || c->write->delayed
+#if (NGX_HTTP_SSL)
+        || c->ssl
+        || u->peer.connection->ssl
+#endif
+#if (NGX_HTTP_V2)
+        || r->stream
+#endif
+        )
+    {
+        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                       "http upstream splice disabled");
+        return NGX_DECLINED;
+    }
+
+    u->splice_pipe = ngx_create_splice_pipe(r->pool, c->log);
+    if (u->splice_pipe == NULL) {
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->log, 0, "http upstream splice");
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_process_splice(ngx_http_request_t *r, ngx_http_upstream_t *u)
+{
+    size_t              size;
+    ssize_t             n;
+    ngx_uint_t          moved;
+    ngx_connection_t   *downstream, *upstream;
+    ngx_splice_pipe_t  *p;
+
+    downstream = r->connection;
+    upstream = u->peer.connection;
+    p = u->splice_pipe;
+
+    do {
+        moved = 0;
+
+        if (p->size && downstream->write->ready) {
+
+            n = ngx_splice_send(downstream, p, p->size);
+
+            if (n == NGX_ERROR) {
+                ngx_http_upstream_finalize_request(r, u, NGX_ERROR);
+                return NGX_DONE;
+            }
+
+            if (n > 0) {
+                moved = 1;
+            }
+        }
+
+        if (p->size == 0) {
+
+            if (u->length == 0
+                || (upstream->read->eof && u->length == -1))
+            {
+                ngx_http_upstream_finalize_request(r, u, 0);
+                return NGX_DONE;
+            }
+
+            if (upstream->read->eof) {
+                ngx_log_error(NGX_LOG_ERR, upstream->log, 0,
+                              "upstream prematurely closed connection");
+
+                ngx_http_upstream_finalize_request(r, u,
+                                                   NGX_HTTP_BAD_GATEWAY);
+                return NGX_DONE;
+            }
+
+            if (upstream->read->error) {
+                ngx_http_upstream_finalize_request(r, u,
+                                                   NGX_HTTP_BAD_GATEWAY);
+                return NGX_DONE;
+            }
+        }
+
+        if (u->length
+            && p->size < NGX_SPLICE_PIPE_SIZE
+            && upstream->read->ready)
+        {
+            size = NGX_SPLICE_PIPE_SIZE;
+
+            if (u->length != -1 && (off_t) size > u->length) {
+                size = (size_t) u->length;
+            }
+
+            n = ngx_splice_recv(upstream, p, size);
+
+            if (n == NGX_AGAIN) {
+                continue;
+            }
+
+            moved = 1;
+
+            if (n > 0) {
+                u->state->bytes_received += n;
+                u->state->response_length += n;
+
+                if (u->length != -1) {
+                    u->length -= n;
+
+                    if (u->length == 0) {
+                        u->keepalive = !u->headers_in.connection_close;
+                    }
+                }
+            }
+        }
+
+    } while (moved);
+
+    return NGX_OK;
+}
+
+#endif
+
+
 ngx_int_t
 ngx_http_upstream_non_buffered_filter_init(void *data)
 {
@@ -6067,6 +6253,13 @@ ngx_http_upstream_server(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+        if (ngx_strcmp(value[i].data, "resolve") == 0) {
+            us->resolve = 1;
+            continue;
+        }
+#endif
+
         goto invalid;
     }
 
@@ -6074,6 +6267,7 @@ ngx_http_upstream_server(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     u.url = value[1];
     u.default_port = 80;
+    u.no_resolve = us->resolve;
 
     if (ngx_parse_url(cf->pool, &u) != NGX_OK) {
         if (u.err) {
@@ -6084,6 +6278,33 @@ ngx_http_upstream_server(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+    if (us->resolve) {
+
+        if (u.naddrs) {
+            /* an address, nothing to resolve */
+            us->resolve = 0;
+
+        } else {
+            us->host = u.host;
+            us->port = u.port;
+
+            /*
+             * the name is also resolved at startup, if this fails
+             * the server is added later when the name is resolved
+             */
+
+            if (ngx_inet_resolve_host(cf->pool, &u) != NGX_OK) {
+                ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                                   "%s in upstream \"%V\"", u.err, &u.url);
+                u.naddrs = 0;
+            }
+        }
+    }
+
+#endif
+
     us->name = u.url;
     us->addrs = u.addrs;
     us->naddrs = u.naddrs;
@@ -102,9 +102,13 @@ typedef struct {
     ngx_msec_t                       slow_start;
     ngx_uint_t                       down;
 
+    ngx_str_t                        host;
+    in_port_t                        port;
+
     unsigned                         backup:1;
+    unsigned                         resolve:1;
 
-    NGX_COMPAT_BEGIN(6)
+    NGX_COMPAT_BEGIN(3)
     NGX_COMPAT_END
 } ngx_http_upstream_server_t;
 
@@ -133,6 +137,8 @@ struct ngx_http_upstream_srv_conf_s {
 
 #if (NGX_HTTP_UPSTREAM_ZONE)
     ngx_shm_zone_t                  *shm_zone;
+    ngx_resolver_t                  *resolver;
+    ngx_msec_t                       resolver_timeout;
 #endif
 };
 
@@ -174,6 +180,7 @@ typedef struct {
     ngx_uint_t                       next_upstream_tries;
     ngx_flag_t                       buffering;
     ngx_flag_t                       request_buffering;
+    ngx_flag_t                       splice;
     ngx_flag_t                       pass_request_headers;
     ngx_flag_t                       pass_request_body;
 
@@ -328,6 +335,10 @@ struct ngx_http_upstream_s {
 
     ngx_event_pipe_t                *pipe;
 
+#if (NGX_HAVE_SPLICE)
+    ngx_splice_pipe_t               *splice_pipe;
+#endif
+
     ngx_chain_t                     *request_bufs;
 
     ngx_output_chain_ctx_t           output;
@@ -393,6 +404,7 @@ struct ngx_http_upstream_s {
 #endif
 
     unsigned                         buffering:1;
+    unsigned                         splice:1;
     unsigned                         keepalive:1;
     unsigned                         upgrade:1;
     unsigned                         error:1;
@@ -17,6 +17,19 @@
 static ngx_http_upstream_rr_peer_t *ngx_http_upstream_get_peer(
     ngx_http_upstream_rr_peer_data_t *rrp);
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static ngx_int_t ngx_http_upstream_update_round_robin_peer(
+    ngx_http_upstream_rr_peer_data_t *rrp);
+static void ngx_http_upstream_rr_peer_account(
+    ngx_http_upstream_rr_peer_data_t *rrp, ngx_http_upstream_rr_peer_t *peer,
+    ngx_uint_t state);
+static void ngx_http_upstream_rr_stats_update(
+    ngx_http_upstream_rr_peer_stats_t *shared, ngx_http_upstream_state_t *us,
+    ngx_uint_t state);
+
+#endif
+
 #if (NGX_HTTP_SSL)
 
 static ngx_int_t ngx_http_upstream_empty_set_session(ngx_peer_connection_t *pc,
@@ -32,7 +45,7 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
     ngx_http_upstream_srv_conf_t *us)
 {
     ngx_url_t                      u;
-    ngx_uint_t                     i, j, n, w, t;
+    ngx_uint_t                     i, j, n, w, t, r;
     ngx_http_upstream_server_t    *server;
     ngx_http_upstream_rr_peer_t   *peer, **peerp;
     ngx_http_upstream_rr_peers_t  *peers, *backup;
@@ -45,8 +58,21 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
         n = 0;
         w = 0;
         t = 0;
+        r = 0;
 
         for (i = 0; i < us->servers->nelts; i++) {
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+            if (server[i].resolve && us->shm_zone == NULL) {
+                ngx_log_error(NGX_LOG_EMERG, cf->log, 0,
+                              "resolving names at run time requires "
+                              "upstream \"%V\" in %s:%ui "
+                              "to be in shared memory",
+                              &us->host, us->file_name, us->line);
+                return NGX_ERROR;
+            }
+#endif
+
             if (server[i].backup) {
                 continue;
             }
@@ -57,9 +83,13 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
             if (!server[i].down) {
                 t += server[i].naddrs;
             }
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+            r += server[i].resolve;
+#endif
         }
 
-        if (n == 0) {
+        if (n == 0 && r == 0) {
             ngx_log_error(NGX_LOG_EMERG, cf->log, 0,
                           "no servers in upstream \"%V\" in %s:%ui",
                           &us->host, us->file_name, us->line);
@@ -103,6 +133,9 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
                 peer[n].fail_timeout = server[i].fail_timeout;
                 peer[n].down = server[i].down;
                 peer[n].server = server[i].name;
+#if (NGX_HTTP_UPSTREAM_ZONE)
+                peer[n].host = server[i].resolve ? &server[i] : NULL;
+#endif
 
                 *peerp = &peer[n];
                 peerp = &peer[n].next;
@@ -117,6 +150,7 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
         n = 0;
         w = 0;
         t = 0;
+        r = 0;
 
         for (i = 0; i < us->servers->nelts; i++) {
             if (!server[i].backup) {
@@ -129,9 +163,13 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
             if (!server[i].down) {
                 t += server[i].naddrs;
             }
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+            r += server[i].resolve;
+#endif
         }
 
-        if (n == 0) {
+        if (n == 0 && r == 0) {
             return NGX_OK;
         }
 
@@ -173,6 +211,9 @@ ngx_http_upstream_init_round_robin(ngx_conf_t *cf,
                 peer[n].fail_timeout = server[i].fail_timeout;
                 peer[n].down = server[i].down;
                 peer[n].server = server[i].name;
+#if (NGX_HTTP_UPSTREAM_ZONE)
+                peer[n].host = server[i].resolve ? &server[i] : NULL;
+#endif
 
                 *peerp = &peer[n];
                 peerp = &peer[n].next;
@@ -257,7 +298,7 @@ ngx_int_t
 ngx_http_upstream_init_round_robin_peer(ngx_http_request_t *r,
     ngx_http_upstream_srv_conf_t *us)
 {
-    ngx_uint_t                         n;
+    ngx_uint_t                         n, tries;
     ngx_http_upstream_rr_peer_data_t  *rrp;
 
     rrp = r->upstream->peer.data;
@@ -274,6 +315,15 @@ ngx_http_upstream_init_round_robin_peer(ngx_http_request_t *r,
     rrp->peers = us->peer.data;
     rrp->current = NULL;
     rrp->config = 0;
+    rrp->upstream = r->upstream;
+
+    ngx_http_upstream_rr_peers_rlock(rrp->peers);
+
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (rrp->peers->config) {
+        rrp->config = *rrp->peers->config;
+    }
+#endif
 
     n = rrp->peers->number;
 
@@ -281,9 +331,14 @@ ngx_http_upstream_init_round_robin_peer(ngx_http_request_t *r,
         n = rrp->peers->next->number;
     }
 
+    tries = ngx_http_upstream_tries(rrp->peers);
+
+    ngx_http_upstream_rr_peers_unlock(rrp->peers);
+
     if (n <= 8 * sizeof(uintptr_t)) {
         rrp->tried = &rrp->data;
         rrp->data = 0;
+        n = 1;
 
     } else {
         n = (n + (8 * sizeof(uintptr_t) - 1)) / (8 * sizeof(uintptr_t));
@@ -294,9 +349,14 @@ ngx_http_upstream_init_round_robin_peer(ngx_http_request_t *r,
         }
     }
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    rrp->pool = r->pool;
+    rrp->ntried = n;
+#endif
+
     r->upstream->peer.get = ngx_http_upstream_get_round_robin_peer;
     r->upstream->peer.free = ngx_http_upstream_free_round_robin_peer;
-    r->upstream->peer.tries = ngx_http_upstream_tries(rrp->peers);
+    r->upstream->peer.tries = tries;
 #if (NGX_HTTP_SSL)
     r->upstream->peer.set_session =
                                ngx_http_upstream_set_round_robin_peer_session;
@@ -400,6 +460,7 @@ ngx_http_upstream_create_round_robin_peer(ngx_http_request_t *r,
     rrp->peers = peers;
     rrp->current = NULL;
     rrp->config = 0;
+    rrp->upstream = r->upstream;
 
     if (rrp->peers->number <= 8 * sizeof(uintptr_t)) {
         rrp->tried = &rrp->data;
@@ -446,6 +507,15 @@ ngx_http_upstream_get_round_robin_peer(ngx_peer_connection_t *pc, void *data)
     peers = rrp->peers;
     ngx_http_upstream_rr_peers_wlock(peers);
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (ngx_http_upstream_rr_peers_changed(rrp)
+        && ngx_http_upstream_update_round_robin_peer(rrp) != NGX_OK)
+    {
+        ngx_http_upstream_rr_peers_unlock(peers);
+        return NGX_ERROR;
+    }
+#endif
+
     if (peers->single) {
         peer = peers->peer;
 
@@ -518,6 +588,49 @@ failed:
 }
 
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static ngx_int_t
+ngx_http_upstream_update_round_robin_peer(
+    ngx_http_upstream_rr_peer_data_t *rrp)
+{
+    ngx_uint_t  n;
+
+    /*
+     * the list of peers was changed since the request was started,
+     * peers tried so far cannot be matched with the new list, so
+     * the selection is continued with the tried bitmap reset
+     */
+
+    n = rrp->peers->number;
+
+    if (rrp->peers->next && rrp->peers->next->number > n) {
+        n = rrp->peers->next->number;
+    }
+
+    n = (n + (8 * sizeof(uintptr_t) - 1)) / (8 * sizeof(uintptr_t));
+
+    if (n > rrp->ntried) {
+        rrp->tried = ngx_pcalloc(rrp->pool, n * sizeof(uintptr_t));
+        if (rrp->tried == NULL) {
+            return NGX_ERROR;
+        }
+
+        rrp->ntried = n;
+
+    } else {
+        ngx_memzero(rrp->tried, rrp->ntried * sizeof(uintptr_t));
+    }
+
+    rrp->config = *rrp->peers->config;
+    rrp->current = NULL;
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static ngx_http_upstream_rr_peer_t *
 ngx_http_upstream_get_peer(ngx_http_upstream_rr_peer_data_t *rrp)
 {
@@ -615,6 +728,12 @@ ngx_http_upstream_free_round_robin_peer(ngx_peer_connection_t *pc, void *data,
     ngx_http_upstream_rr_peers_rlock(rrp->peers);
     ngx_http_upstream_rr_peer_lock(rrp->peers, peer);
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    if (ngx_worker < rrp->peers->workers) {
+        ngx_http_upstream_rr_peer_account(rrp, peer, state);
+    }
+#endif
+
     if (rrp->peers->single) {
 
         peer->conns--;
@@ -670,6 +789,105 @@ ngx_http_upstream_free_round_robin_peer(ngx_peer_connection_t *pc, void *data,
 }
 
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+static void
+ngx_http_upstream_rr_peer_account(ngx_http_upstream_rr_peer_data_t *rrp,
+    ngx_http_upstream_rr_peer_t *peer, ngx_uint_t state)
+{
+    ngx_http_upstream_state_t  *us;
+
+    us = rrp->upstream ? rrp->upstream->state : NULL;
+
+    if (peer->stats) {
+        ngx_http_upstream_rr_stats_update(peer->stats, us, state);
+    }
+
+    if (rrp->peers->stats) {
+        ngx_http_upstream_rr_stats_update(rrp->peers->stats, us, state);
+    }
+}
+
+
+static void
+ngx_http_upstream_rr_stats_update(ngx_http_upstream_rr_peer_stats_t *shared,
+    ngx_http_upstream_state_t *us, ngx_uint_t state)
+{
+    ngx_uint_t                          status;
+    ngx_http_upstream_rr_peer_stats_t  *stats;
+
+    /* the slot is only updated by the current worker process */
+
+    stats = ngx_http_upstream_rr_stats(shared, ngx_worker);
+
+    stats->requests++;
+
+    if (state & NGX_PEER_FAILED) {
+        stats->fails++;
+    }
+
+    if (us == NULL) {
+        return;
+    }
+
+    stats->sent += us->bytes_sent;
+    stats->received += us->bytes_received;
+
+    if (state & NGX_PEER_FAILED) {
+        return;
+    }
+
+    status = us->status;
+
+    if (status >= 100 && status < 600) {
+        stats->responses[status / 100 - 1]++;
+    }
+
+    /* the histograms are shared by worker processes */
+
+    if (us->connect_time != (ngx_msec_t) -1) {
+        ngx_histogram_add_atomic(&shared->connect_time, us->connect_time);
+    }
+
+    if (us->header_time != (ngx_msec_t) -1) {
+        ngx_histogram_add_atomic(&shared->header_time, us->header_time);
+    }
+
+    if (us->response_time != (ngx_msec_t) -1) {
+        ngx_histogram_add_atomic(&shared->response_time, us->response_time);
+    }
+}
+
+
+void
+ngx_http_upstream_rr_stats_merge(ngx_http_upstream_rr_peer_stats_t *dst,
+    ngx_http_upstream_rr_peer_stats_t *stats, ngx_uint_t workers)
+{
+    ngx_uint_t                          i, k;
+    ngx_http_upstream_rr_peer_stats_t  *src;
+
+    for (i = 0; i < workers; i++) {
+        src = ngx_http_upstream_rr_stats(stats, i);
+
+        dst->requests += src->requests;
+
+        for (k = 0; k < 5; k++) {
+            dst->responses[k] += src->responses[k];
+        }
+
+        dst->fails += src->fails;
+        dst->sent += src->sent;
+        dst->received += src->received;
+    }
+
+    ngx_histogram_merge(&dst->connect_time, &stats->connect_time);
+    ngx_histogram_merge(&dst->header_time, &stats->header_time);
+    ngx_histogram_merge(&dst->response_time, &stats->response_time);
+}
+
+#endif
+
+
 #if (NGX_HTTP_SSL)
 
 ngx_int_t
@@ -16,6 +16,18 @@
 
 typedef struct ngx_http_upstream_rr_peer_s   ngx_http_upstream_rr_peer_t;
 
+
+typedef struct {
+    ngx_uint_t                      requests;
+    ngx_uint_t                      responses[5];
+    ngx_uint_t                      fails;
+    uint64_t                        sent;
+    uint64_t                        received;
+    ngx_histogram_t                 connect_time;
+    ngx_histogram_t                 header_time;
+    ngx_histogram_t                 response_time;
+} ngx_http_upstream_rr_peer_stats_t;
+
 struct ngx_http_upstream_rr_peer_s {
     struct sockaddr                *sockaddr;
     socklen_t                       socklen;
@@ -40,6 +52,10 @@ struct ngx_http_upstream_rr_peer_s {
 
     ngx_uint_t                      down;
 
+    /* peak EWMA of the response time in microseconds, and when updated */
+    ngx_uint_t                      ewma;
+    ngx_msec_t                      ewma_time;
+
 #if (NGX_HTTP_SSL || NGX_COMPAT)
     void                           *ssl_session;
     int                             ssl_session_len;
@@ -47,11 +63,21 @@ struct ngx_http_upstream_rr_peer_s {
 
 #if (NGX_HTTP_UPSTREAM_ZONE)
     ngx_atomic_t                    lock;
+
+    /* server with the "resolve" parameter the peer was resolved from */
+    ngx_http_upstream_server_t     *host;
+
+    /* statistics, see ngx_http_upstream_rr_stats() */
+    ngx_http_upstream_rr_peer_stats_t  *stats;
+
+    /* consecutive results of active health checks */
+    ngx_uint_t                      check_fails;
+    ngx_uint_t                      check_passes;
 #endif
 
     ngx_http_upstream_rr_peer_t    *next;
 
-    NGX_COMPAT_BEGIN(32)
+    NGX_COMPAT_BEGIN(26)
     NGX_COMPAT_END
 };
 
@@ -65,6 +91,18 @@ struct ngx_http_upstream_rr_peers_s {
     ngx_slab_pool_t                *shpool;
     ngx_atomic_t                    rwlock;
     ngx_http_upstream_rr_peers_t   *zone_next;
+
+    /* incremented each time the list of peers is changed */
+    ngx_uint_t                     *config;
+
+    /* removed peers still in use by requests */
+    ngx_http_upstream_rr_peer_t    *zombies;
+
+    /* number of per worker statistics slots allocated for peers */
+    ngx_uint_t                      workers;
+
+    /* statistics of the whole upstream, shared with backup */
+    ngx_http_upstream_rr_peer_stats_t  *stats;
 #endif
 
     ngx_uint_t                      total_weight;
@@ -114,6 +152,39 @@ struct ngx_http_upstream_rr_peers_s {
         ngx_rwlock_unlock(&peer->lock);                                       \
     }
 
+
+#define ngx_http_upstream_rr_peers_changed(rrp)                               \
+    ((rrp)->peers->config && (rrp)->config != *(rrp)->peers->config)
+
+
+/*
+ * set in peer->down by active health checks, in addition to
+ * the "down" parameter of the server
+ */
+#define NGX_HTTP_UPSTREAM_RR_CHECK_DOWN  0x02
+
+/*
+ * statistics in the zone start with histograms shared by worker processes
+ * and updated atomically, followed by per worker process slots with
+ * counters, each on its own cache line
+ */
+
+#define NGX_HTTP_UPSTREAM_RR_STATS_SHARED                                     \
+    ngx_align(sizeof(ngx_http_upstream_rr_peer_stats_t), NGX_CPU_CACHE_LINE)
+
+#define NGX_HTTP_UPSTREAM_RR_STATS_SLOT                                       \
+    ngx_align(offsetof(ngx_http_upstream_rr_peer_stats_t, connect_time),      \
+              NGX_CPU_CACHE_LINE)
+
+#define ngx_http_upstream_rr_stats_size(workers)                              \
+    (NGX_HTTP_UPSTREAM_RR_STATS_SHARED                                        \
+     + (workers) * NGX_HTTP_UPSTREAM_RR_STATS_SLOT)
+
+#define ngx_http_upstream_rr_stats(stats, n)                                  \
+    ((ngx_http_upstream_rr_peer_stats_t *)                                    \
+         ((u_char *) (stats) + NGX_HTTP_UPSTREAM_RR_STATS_SHARED              \
+          + (n) * NGX_HTTP_UPSTREAM_RR_STATS_SLOT))
+
 #else
 
 #define ngx_http_upstream_rr_peers_rlock(peers)
@@ -121,6 +192,7 @@ struct ngx_http_upstream_rr_peers_s {
 #define ngx_http_upstream_rr_peers_unlock(peers)
 #define ngx_http_upstream_rr_peer_lock(peers, peer)
 #define ngx_http_upstream_rr_peer_unlock(peers, peer)
+#define ngx_http_upstream_rr_peers_changed(rrp)  0
 
 #endif
 
@@ -131,6 +203,11 @@ typedef struct {
     ngx_http_upstream_rr_peer_t    *current;
     uintptr_t                      *tried;
     uintptr_t                       data;
+    ngx_http_upstream_t            *upstream;
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    ngx_pool_t                     *pool;
+    ngx_uint_t                      ntried;
+#endif
 } ngx_http_upstream_rr_peer_data_t;
 
 
@@ -145,6 +222,11 @@ ngx_int_t ngx_http_upstream_get_round_robin_peer(ngx_peer_connection_t *pc,
 void ngx_http_upstream_free_round_robin_peer(ngx_peer_connection_t *pc,
     void *data, ngx_uint_t state);
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+void ngx_http_upstream_rr_stats_merge(ngx_http_upstream_rr_peer_stats_t *dst,
+    ngx_http_upstream_rr_peer_stats_t *stats, ngx_uint_t workers);
+#endif
+
 #if (NGX_HTTP_SSL)
 ngx_int_t
     ngx_http_upstream_set_round_robin_peer_session(ngx_peer_connection_t *pc,
@@ -274,6 +274,10 @@ ngx_http_v2_init(ngx_event_t *rev)
 
     h2c->frame_size = NGX_HTTP_V2_DEFAULT_FRAME_SIZE;
 
+    h2c->hpack_enc.size = NGX_HTTP_V2_TABLE_SIZE;
+    h2c->hpack_enc.free = NGX_HTTP_V2_TABLE_SIZE;
+    h2c->hpack_enc.limit = NGX_HTTP_V2_TABLE_SIZE;
+
     h2scf = ngx_http_get_module_srv_conf(hc->conf_ctx, ngx_http_v2_module);
 
     h2c->concurrent_pushes = h2scf->concurrent_pushes;
@@ -2282,6 +2286,7 @@ ngx_http_v2_state_settings_params(ngx_http_v2_connection_t *h2c, u_char *pos,
 
         case NGX_HTTP_V2_HEADER_TABLE_SIZE_SETTING:
 
+            h2c->hpack_enc.limit = value;
             h2c->table_update = 1;
             break;
 
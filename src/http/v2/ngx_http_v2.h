@@ -53,6 +53,8 @@
 
 #define NGX_HTTP_V2_DEFAULT_WEIGHT       16
 
+#define NGX_HTTP_V2_TABLE_SIZE           4096
+
 
 typedef struct ngx_http_v2_connection_s   ngx_http_v2_connection_t;
 typedef struct ngx_http_v2_node_s         ngx_http_v2_node_t;
@@ -114,6 +116,28 @@ typedef struct {
 } ngx_http_v2_hpack_t;
 
 
+typedef struct {
+    ngx_uint_t                       hash;
+    ngx_str_t                        name;
+    ngx_str_t                        value;
+    unsigned                         valid:1;
+} ngx_http_v2_hpack_entry_t;
+
+
+typedef struct {
+    ngx_http_v2_hpack_entry_t       *entries;
+
+    ngx_uint_t                       added;
+    ngx_uint_t                       deleted;
+
+    size_t                           size;
+    size_t                           free;
+    size_t                           limit;
+    u_char                          *storage;
+    u_char                          *pos;
+} ngx_http_v2_hpack_enc_t;
+
+
 struct ngx_http_v2_connection_s {
     ngx_connection_t                *connection;
     ngx_http_connection_t           *http_connection;
@@ -140,6 +164,7 @@ struct ngx_http_v2_connection_s {
     ngx_http_v2_state_t              state;
 
     ngx_http_v2_hpack_t              hpack;
+    ngx_http_v2_hpack_enc_t          hpack_enc;
 
     ngx_pool_t                      *pool;
 
@@ -310,6 +335,12 @@ ngx_int_t ngx_http_v2_add_header(ngx_http_v2_connection_t *h2c,
     ngx_http_v2_header_t *header);
 ngx_int_t ngx_http_v2_table_size(ngx_http_v2_connection_t *h2c, size_t size);
 
+u_char *ngx_http_v2_table_update(ngx_http_v2_connection_t *h2c, u_char *pos);
+ngx_uint_t ngx_http_v2_table_find(ngx_http_v2_connection_t *h2c,
+    ngx_str_t *name, ngx_str_t *value, ngx_uint_t *index);
+ngx_int_t ngx_http_v2_table_insert(ngx_http_v2_connection_t *h2c,
+    ngx_str_t *name, ngx_str_t *value);
+
 
 #define ngx_http_v2_prefix(bits)  ((1 << (bits)) - 1)
 
@@ -411,6 +442,7 @@ ngx_int_t ngx_http_v2_table_size(ngx_http_v2_connection_t *h2c, size_t size);
 
 u_char *ngx_http_v2_string_encode(u_char *dst, u_char *src, size_t len,
     u_char *tmp, ngx_uint_t lower);
+u_char *ngx_http_v2_write_int(u_char *pos, ngx_uint_t prefix, ngx_uint_t value);
 
 
 #endif /* _NGX_HTTP_V2_H_INCLUDED_ */
@@ -27,6 +27,12 @@
 #define NGX_HTTP_V2_NO_TRAILERS           (ngx_http_v2_out_frame_t *) -1
 
 
+/* literal header field representations */
+#define NGX_HTTP_V2_LITERAL_NOT_INDEXED    0x00
+#define NGX_HTTP_V2_LITERAL_NEVER_INDEXED  0x10
+#define NGX_HTTP_V2_LITERAL_INDEXED        0x40
+
+
 typedef struct {
     ngx_str_t      name;
     u_char         index;
@@ -52,6 +58,9 @@ static ngx_http_v2_push_header_t  ngx_http_v2_push_headers[] = {
     (sizeof(ngx_http_v2_push_headers) / sizeof(ngx_http_v2_push_header_t))
 
 
+static u_char *ngx_http_v2_write_header(ngx_http_v2_connection_t *h2c,
+    u_char *pos, ngx_uint_t type, ngx_uint_t index, ngx_str_t *name,
+    ngx_str_t *value, u_char *tmp);
 static ngx_int_t ngx_http_v2_push_resources(ngx_http_request_t *r);
 static ngx_int_t ngx_http_v2_push_resource(ngx_http_request_t *r,
     ngx_str_t *path, ngx_str_t *binary);
@@ -135,8 +144,8 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
 {
     u_char                     status, *pos, *start, *p, *tmp;
     size_t                     len, tmp_len;
-    ngx_str_t                  host, location;
-    ngx_uint_t                 i, port, fin;
+    ngx_str_t                  host, location, value;
+    ngx_uint_t                 i, port, fin, type;
     ngx_list_part_t           *part;
     ngx_table_elt_t           *header;
     ngx_connection_t          *fc;
@@ -147,20 +156,15 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
     ngx_http_core_loc_conf_t  *clcf;
     ngx_http_core_srv_conf_t  *cscf;
     u_char                     addr[NGX_SOCKADDR_STRLEN];
+    u_char                     buf[sizeof("Wed, 31 Dec 1986 18:00:00 GMT")];
 
-    static const u_char nginx[5] = "\x84\xaa\x63\x55\xe7";
+    static ngx_str_t  nginx = ngx_string("nginx");
+    static ngx_str_t  nginx_ver = ngx_string(NGINX_VER);
+    static ngx_str_t  nginx_ver_build = ngx_string(NGINX_VER_BUILD);
 #if (NGX_HTTP_GZIP)
-    static const u_char accept_encoding[12] =
-        "\x8b\x84\x84\x2d\x69\x5b\x05\x44\x3c\x86\xaa\x6f";
+    static ngx_str_t  accept_encoding = ngx_string("Accept-Encoding");
 #endif
 
-    static size_t nginx_ver_len = ngx_http_v2_literal_size(NGINX_VER);
-    static u_char nginx_ver[ngx_http_v2_literal_size(NGINX_VER)];
-
-    static size_t nginx_ver_build_len =
-                                  ngx_http_v2_literal_size(NGINX_VER_BUILD);
-    static u_char nginx_ver_build[ngx_http_v2_literal_size(NGINX_VER_BUILD)];
-
     stream = r->stream;
 
     if (!stream) {
@@ -253,49 +257,78 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
         }
     }
 
-    len = h2c->table_update ? 1 : 0;
+    /* dynamic table indices may take several octets */
+
+    len = h2c->table_update ? 1 + NGX_HTTP_V2_INT_OCTETS : 0;
 
-    len += status ? 1 : 1 + ngx_http_v2_literal_size("418");
+    len += status ? 1 : NGX_HTTP_V2_INT_OCTETS
+                        + ngx_http_v2_literal_size("418");
 
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     if (r->headers_out.server == NULL) {
 
         if (clcf->server_tokens == NGX_HTTP_SERVER_TOKENS_ON) {
-            len += 1 + nginx_ver_len;
+            len += NGX_HTTP_V2_INT_OCTETS
+                   + ngx_http_v2_literal_size(NGINX_VER);
 
         } else if (clcf->server_tokens == NGX_HTTP_SERVER_TOKENS_BUILD) {
-            len += 1 + nginx_ver_build_len;
+            len += NGX_HTTP_V2_INT_OCTETS
+                   + ngx_http_v2_literal_size(NGINX_VER_BUILD);
 
         } else {
-            len += 1 + sizeof(nginx);
+            len += NGX_HTTP_V2_INT_OCTETS + ngx_http_v2_literal_size("nginx");
         }
     }
 
     if (r->headers_out.date == NULL) {
-        len += 1 + ngx_http_v2_literal_size("Wed, 31 Dec 1986 18:00:00 GMT");
+        len += NGX_HTTP_V2_INT_OCTETS
+               + ngx_http_v2_literal_size("Wed, 31 Dec 1986 18:00:00 GMT");
     }
 
     if (r->headers_out.content_type.len) {
-        len += 1 + NGX_HTTP_V2_INT_OCTETS + r->headers_out.content_type.len;
 
         if (r->headers_out.content_type_len == r->headers_out.content_type.len
             && r->headers_out.charset.len)
         {
-            len += sizeof("; charset=") - 1 + r->headers_out.charset.len;
+            value.len = r->headers_out.content_type.len
+                        + sizeof("; charset=") - 1
+                        + r->headers_out.charset.len;
+
+            value.data = ngx_pnalloc(r->pool, value.len);
+            if (value.data == NULL) {
+                return NGX_ERROR;
+            }
+
+            p = ngx_cpymem(value.data, r->headers_out.content_type.data,
+                           r->headers_out.content_type.len);
+
+            p = ngx_cpymem(p, "; charset=", sizeof("; charset=") - 1);
+
+            ngx_memcpy(p, r->headers_out.charset.data,
+                       r->headers_out.charset.len);
+
+            /* updated r->headers_out.content_type is also needed for logging */
+
+            r->headers_out.content_type = value;
         }
+
+        len += NGX_HTTP_V2_INT_OCTETS
+               + NGX_HTTP_V2_INT_OCTETS + r->headers_out.content_type.len;
     }
 
     if (r->headers_out.content_length == NULL
         && r->headers_out.content_length_n >= 0)
     {
-        len += 1 + ngx_http_v2_integer_octets(NGX_OFF_T_LEN) + NGX_OFF_T_LEN;
+        len += NGX_HTTP_V2_INT_OCTETS
+               + ngx_http_v2_integer_octets(NGX_OFF_T_LEN) + NGX_OFF_T_LEN;
     }
 
     if (r->headers_out.last_modified == NULL
         && r->headers_out.last_modified_time != -1)
     {
-        len += 1 + ngx_http_v2_literal_size("Wed, 31 Dec 1986 18:00:00 GMT");
+        len += NGX_HTTP_V2_INT_OCTETS
+               + ngx_http_v2_literal_size("Wed, 31 Dec 1986 18:00:00 GMT");
     }
 
     if (r->headers_out.location && r->headers_out.location->value.len) {
@@ -373,7 +406,8 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
 
         r->headers_out.location->hash = 0;
 
-        len += 1 + NGX_HTTP_V2_INT_OCTETS + r->headers_out.location->value.len;
+        len += NGX_HTTP_V2_INT_OCTETS
+               + NGX_HTTP_V2_INT_OCTETS + r->headers_out.location->value.len;
     }
 
     tmp_len = len;
@@ -381,7 +415,8 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
 #if (NGX_HTTP_GZIP)
     if (r->gzip_vary) {
         if (clcf->gzip_vary) {
-            len += 1 + sizeof(accept_encoding);
+            len += NGX_HTTP_V2_INT_OCTETS
+                   + ngx_http_v2_literal_size("Accept-Encoding");
 
         } else {
             r->gzip_vary = 0;
@@ -444,10 +479,7 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
     start = pos;
 
     if (h2c->table_update) {
-        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, fc->log, 0,
-                       "http2 table size update: 0");
-        *pos++ = (1 << 5) | 0;
-        h2c->table_update = 0;
+        pos = ngx_http_v2_table_update(h2c, pos);
     }
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, fc->log, 0,
@@ -458,9 +490,14 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
         *pos++ = status;
 
     } else {
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_STATUS_INDEX);
-        *pos++ = NGX_HTTP_V2_ENCODE_RAW | 3;
-        pos = ngx_sprintf(pos, "%03ui", r->headers_out.status);
+        value.len = 3;
+        value.data = buf;
+
+        ngx_sprintf(buf, "%03ui", r->headers_out.status);
+
+        pos = ngx_http_v2_write_header(h2c, pos, NGX_HTTP_V2_LITERAL_INDEXED,
+                                       NGX_HTTP_V2_STATUS_INDEX, NULL,
+                                       &value, tmp);
     }
 
     if (r->headers_out.server == NULL) {
@@ -470,39 +507,29 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
                            "http2 output header: \"server: %s\"",
                            NGINX_VER);
 
+            pos = ngx_http_v2_write_header(h2c, pos,
+                                           NGX_HTTP_V2_LITERAL_INDEXED,
+                                           NGX_HTTP_V2_SERVER_INDEX, NULL,
+                                           &nginx_ver, tmp);
+
         } else if (clcf->server_tokens == NGX_HTTP_SERVER_TOKENS_BUILD) {
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, fc->log, 0,
                            "http2 output header: \"server: %s\"",
                            NGINX_VER_BUILD);
 
+            pos = ngx_http_v2_write_header(h2c, pos,
+                                           NGX_HTTP_V2_LITERAL_INDEXED,
+                                           NGX_HTTP_V2_SERVER_INDEX, NULL,
+                                           &nginx_ver_build, tmp);
+
         } else {
             ngx_log_debug0(NGX_LOG_DEBUG_HTTP, fc->log, 0,
                            "http2 output header: \"server: nginx\"");
-        }
-
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_SERVER_INDEX);
-
-        if (clcf->server_tokens == NGX_HTTP_SERVER_TOKENS_ON) {
-            if (nginx_ver[0] == '\0') {
-                p = ngx_http_v2_write_value(nginx_ver, (u_char *) NGINX_VER,
-                                            sizeof(NGINX_VER) - 1, tmp);
-                nginx_ver_len = p - nginx_ver;
-            }
-
-            pos = ngx_cpymem(pos, nginx_ver, nginx_ver_len);
-
-        } else if (clcf->server_tokens == NGX_HTTP_SERVER_TOKENS_BUILD) {
-            if (nginx_ver_build[0] == '\0') {
-                p = ngx_http_v2_write_value(nginx_ver_build,
-                                            (u_char *) NGINX_VER_BUILD,
-                                            sizeof(NGINX_VER_BUILD) - 1, tmp);
-                nginx_ver_build_len = p - nginx_ver_build;
-            }
 
-            pos = ngx_cpymem(pos, nginx_ver_build, nginx_ver_build_len);
-
-        } else {
-            pos = ngx_cpymem(pos, nginx, sizeof(nginx));
+            pos = ngx_http_v2_write_header(h2c, pos,
+                                           NGX_HTTP_V2_LITERAL_INDEXED,
+                                           NGX_HTTP_V2_SERVER_INDEX, NULL,
+                                           &nginx, tmp);
         }
     }
 
@@ -511,45 +538,22 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
                        "http2 output header: \"date: %V\"",
                        &ngx_cached_http_time);
 
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_DATE_INDEX);
-        pos = ngx_http_v2_write_value(pos, ngx_cached_http_time.data,
-                                      ngx_cached_http_time.len, tmp);
+        value.len = ngx_cached_http_time.len;
+        value.data = ngx_cached_http_time.data;
+
+        pos = ngx_http_v2_write_header(h2c, pos, NGX_HTTP_V2_LITERAL_INDEXED,
+                                       NGX_HTTP_V2_DATE_INDEX, NULL,
+                                       &value, tmp);
     }
 
     if (r->headers_out.content_type.len) {
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_CONTENT_TYPE_INDEX);
-
-        if (r->headers_out.content_type_len == r->headers_out.content_type.len
-            && r->headers_out.charset.len)
-        {
-            len = r->headers_out.content_type.len + sizeof("; charset=") - 1
-                  + r->headers_out.charset.len;
-
-            p = ngx_pnalloc(r->pool, len);
-            if (p == NULL) {
-                return NGX_ERROR;
-            }
-
-            p = ngx_cpymem(p, r->headers_out.content_type.data,
-                           r->headers_out.content_type.len);
-
-            p = ngx_cpymem(p, "; charset=", sizeof("; charset=") - 1);
-
-            p = ngx_cpymem(p, r->headers_out.charset.data,
-                           r->headers_out.charset.len);
-
-            /* updated r->headers_out.content_type is also needed for logging */
-
-            r->headers_out.content_type.len = len;
-            r->headers_out.content_type.data = p - len;
-        }
-
         ngx_log_debug1(NGX_LOG_DEBUG_HTTP, fc->log, 0,
                        "http2 output header: \"content-type: %V\"",
                        &r->headers_out.content_type);
 
-        pos = ngx_http_v2_write_value(pos, r->headers_out.content_type.data,
-                                      r->headers_out.content_type.len, tmp);
+        pos = ngx_http_v2_write_header(h2c, pos, NGX_HTTP_V2_LITERAL_INDEXED,
+                                       NGX_HTTP_V2_CONTENT_TYPE_INDEX, NULL,
+                                       &r->headers_out.content_type, tmp);
     }
 
     if (r->headers_out.content_length == NULL
@@ -559,30 +563,31 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
                        "http2 output header: \"content-length: %O\"",
                        r->headers_out.content_length_n);
 
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_CONTENT_LENGTH_INDEX);
+        value.data = buf;
+        value.len = ngx_sprintf(buf, "%O", r->headers_out.content_length_n)
+                    - buf;
 
-        p = pos;
-        pos = ngx_sprintf(pos + 1, "%O", r->headers_out.content_length_n);
-        *p = NGX_HTTP_V2_ENCODE_RAW | (u_char) (pos - p - 1);
+        pos = ngx_http_v2_write_header(h2c, pos,
+                                       NGX_HTTP_V2_LITERAL_NOT_INDEXED,
+                                       NGX_HTTP_V2_CONTENT_LENGTH_INDEX, NULL,
+                                       &value, tmp);
     }
 
     if (r->headers_out.last_modified == NULL
         && r->headers_out.last_modified_time != -1)
     {
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_LAST_MODIFIED_INDEX);
+        value.data = buf;
+        value.len = ngx_http_time(buf, r->headers_out.last_modified_time)
+                    - buf;
 
-        ngx_http_time(pos, r->headers_out.last_modified_time);
-        len = sizeof("Wed, 31 Dec 1986 18:00:00 GMT") - 1;
-
-        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, fc->log, 0,
-                       "http2 output header: \"last-modified: %*s\"",
-                       len, pos);
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, fc->log, 0,
+                       "http2 output header: \"last-modified: %V\"",
+                       &value);
 
-        /*
-         * Date will always be encoded using huffman in the temporary buffer,
-         * so it's safe here to use src and dst pointing to the same address.
-         */
-        pos = ngx_http_v2_write_value(pos, pos, len, tmp);
+        pos = ngx_http_v2_write_header(h2c, pos,
+                                       NGX_HTTP_V2_LITERAL_NOT_INDEXED,
+                                       NGX_HTTP_V2_LAST_MODIFIED_INDEX, NULL,
+                                       &value, tmp);
     }
 
     if (r->headers_out.location && r->headers_out.location->value.len) {
@@ -590,9 +595,10 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
                        "http2 output header: \"location: %V\"",
                        &r->headers_out.location->value);
 
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_LOCATION_INDEX);
-        pos = ngx_http_v2_write_value(pos, r->headers_out.location->value.data,
-                                      r->headers_out.location->value.len, tmp);
+        pos = ngx_http_v2_write_header(h2c, pos,
+                                       NGX_HTTP_V2_LITERAL_NOT_INDEXED,
+                                       NGX_HTTP_V2_LOCATION_INDEX, NULL,
+                                       &r->headers_out.location->value, tmp);
     }
 
 #if (NGX_HTTP_GZIP)
@@ -600,8 +606,9 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
         ngx_log_debug0(NGX_LOG_DEBUG_HTTP, fc->log, 0,
                        "http2 output header: \"vary: Accept-Encoding\"");
 
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_VARY_INDEX);
-        pos = ngx_cpymem(pos, accept_encoding, sizeof(accept_encoding));
+        pos = ngx_http_v2_write_header(h2c, pos, NGX_HTTP_V2_LITERAL_INDEXED,
+                                       NGX_HTTP_V2_VARY_INDEX, NULL,
+                                       &accept_encoding, tmp);
     }
 #endif
 
@@ -634,13 +641,19 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
         }
 #endif
 
-        *pos++ = 0;
+        if (header[i].key.len == sizeof("Set-Cookie") - 1
+            && ngx_strncasecmp(header[i].key.data, (u_char *) "Set-Cookie",
+                               sizeof("Set-Cookie") - 1)
+               == 0)
+        {
+            type = NGX_HTTP_V2_LITERAL_NEVER_INDEXED;
 
-        pos = ngx_http_v2_write_name(pos, header[i].key.data,
-                                     header[i].key.len, tmp);
+        } else {
+            type = NGX_HTTP_V2_LITERAL_INDEXED;
+        }
 
-        pos = ngx_http_v2_write_value(pos, header[i].value.data,
-                                      header[i].value.len, tmp);
+        pos = ngx_http_v2_write_header(h2c, pos, type, 0, &header[i].key,
+                                       &header[i].value, tmp);
     }
 
     fin = r->header_only
@@ -648,6 +661,8 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
 
     frame = ngx_http_v2_create_headers_frame(r, start, pos, fin);
     if (frame == NULL) {
+        /* the client's table will be reset with the next header block */
+        h2c->table_update = 1;
         return NGX_ERROR;
     }
 
@@ -670,6 +685,45 @@ ngx_http_v2_header_filter(ngx_http_request_t *r)
 }
 
 
+static u_char *
+ngx_http_v2_write_header(ngx_http_v2_connection_t *h2c, u_char *pos,
+    ngx_uint_t type, ngx_uint_t index, ngx_str_t *name, ngx_str_t *value,
+    u_char *tmp)
+{
+    ngx_uint_t  n;
+
+    if (name == NULL) {
+        name = ngx_http_v2_get_static_name(index);
+    }
+
+    n = ngx_http_v2_table_find(h2c, name, value, &index);
+
+    if (n) {
+        *pos = ngx_http_v2_indexed(0);
+        return ngx_http_v2_write_int(pos, ngx_http_v2_prefix(7), n);
+    }
+
+    if (type == NGX_HTTP_V2_LITERAL_INDEXED
+        && ngx_http_v2_table_insert(h2c, name, value) != NGX_OK)
+    {
+        type = NGX_HTTP_V2_LITERAL_NOT_INDEXED;
+    }
+
+    *pos = (u_char) type;
+
+    pos = ngx_http_v2_write_int(pos, type == NGX_HTTP_V2_LITERAL_INDEXED
+                                     ? ngx_http_v2_prefix(6)
+                                     : ngx_http_v2_prefix(4),
+                                index);
+
+    if (index == 0) {
+        pos = ngx_http_v2_write_name(pos, name->data, name->len, tmp);
+    }
+
+    return ngx_http_v2_write_value(pos, value->data, value->len, tmp);
+}
+
+
 static ngx_int_t
 ngx_http_v2_push_resources(ngx_http_request_t *r)
 {
@@ -975,7 +1029,7 @@ ngx_http_v2_push_resource(ngx_http_request_t *r, ngx_str_t *path,
 
             value = &(*h)->value;
 
-            len = 1 + NGX_HTTP_V2_INT_OCTETS + value->len;
+            len = NGX_HTTP_V2_INT_OCTETS + NGX_HTTP_V2_INT_OCTETS + value->len;
 
             pos = ngx_pnalloc(r->pool, len);
             if (pos == NULL) {
@@ -984,14 +1038,18 @@ ngx_http_v2_push_resource(ngx_http_request_t *r, ngx_str_t *path,
 
             binary[i].data = pos;
 
-            *pos++ = ngx_http_v2_inc_indexed(ph[i].index);
+            /* pushed requests headers are not added to the table */
+
+            *pos = NGX_HTTP_V2_LITERAL_NOT_INDEXED;
+            pos = ngx_http_v2_write_int(pos, ngx_http_v2_prefix(4),
+                                        ph[i].index);
             pos = ngx_http_v2_write_value(pos, value->data, value->len, tmp);
 
             binary[i].len = pos - binary[i].data;
         }
     }
 
-    len = (h2c->table_update ? 1 : 0)
+    len = (h2c->table_update ? 1 + NGX_HTTP_V2_INT_OCTETS : 0)
           + 1
           + 1 + NGX_HTTP_V2_INT_OCTETS + path->len
           + 1 + NGX_HTTP_V2_INT_OCTETS + r->schema.len;
@@ -1008,10 +1066,7 @@ ngx_http_v2_push_resource(ngx_http_request_t *r, ngx_str_t *path,
     start = pos;
 
     if (h2c->table_update) {
-        ngx_log_debug0(NGX_LOG_DEBUG_HTTP, fc->log, 0,
-                       "http2 table size update: 0");
-        *pos++ = (1 << 5) | 0;
-        h2c->table_update = 0;
+        pos = ngx_http_v2_table_update(h2c, pos);
     }
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, fc->log, 0,
@@ -1022,7 +1077,7 @@ ngx_http_v2_push_resource(ngx_http_request_t *r, ngx_str_t *path,
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, fc->log, 0,
                    "http2 push header: \":path: %V\"", path);
 
-    *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_PATH_INDEX);
+    *pos++ = NGX_HTTP_V2_LITERAL_NOT_INDEXED | NGX_HTTP_V2_PATH_INDEX;
     pos = ngx_http_v2_write_value(pos, path->data, path->len, tmp);
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, fc->log, 0,
@@ -1037,7 +1092,8 @@ ngx_http_v2_push_resource(ngx_http_request_t *r, ngx_str_t *path,
         *pos++ = ngx_http_v2_indexed(NGX_HTTP_V2_SCHEME_HTTP_INDEX);
 
     } else {
-        *pos++ = ngx_http_v2_inc_indexed(NGX_HTTP_V2_SCHEME_HTTP_INDEX);
+        *pos++ = NGX_HTTP_V2_LITERAL_NOT_INDEXED
+                 | NGX_HTTP_V2_SCHEME_HTTP_INDEX;
         pos = ngx_http_v2_write_value(pos, r->schema.data, r->schema.len, tmp);
     }
 
@@ -1057,6 +1113,7 @@ ngx_http_v2_push_resource(ngx_http_request_t *r, ngx_str_t *path,
 
     frame = ngx_http_v2_create_push_frame(r, start, pos);
     if (frame == NULL) {
+        h2c->table_update = 1;
         return NGX_ERROR;
     }
 
@@ -10,11 +10,13 @@
 #include <ngx_http.h>
 
 
-#define NGX_HTTP_V2_TABLE_SIZE  4096
+/* each entry takes at least 32 octets of the table size */
+#define NGX_HTTP_V2_TABLE_ENTRIES  (NGX_HTTP_V2_TABLE_SIZE / 32)
 
 
 static ngx_int_t ngx_http_v2_table_account(ngx_http_v2_connection_t *h2c,
     size_t size);
+static ngx_uint_t ngx_http_v2_table_hash(ngx_str_t *name, ngx_str_t *value);
 
 
 static ngx_http_v2_header_t  ngx_http_v2_static_table[] = {
@@ -361,3 +363,195 @@ ngx_http_v2_table_size(ngx_http_v2_connection_t *h2c, size_t size)
 
     return NGX_OK;
 }
+
+
+/*
+ * The encoder table mirrors the client's decoder table for the header
+ * blocks sent.  Entries data are kept in a ring buffer, and entries whose
+ * data were overwritten remain accounted but are no longer looked up.
+ */
+
+u_char *
+ngx_http_v2_table_update(ngx_http_v2_connection_t *h2c, u_char *pos)
+{
+    size_t                    size;
+    ngx_http_v2_hpack_enc_t  *hpack;
+
+    hpack = &h2c->hpack_enc;
+
+    size = ngx_min(hpack->limit, NGX_HTTP_V2_TABLE_SIZE);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 table size update: %uz", size);
+
+    /*
+     * the table is always emptied first, so the smallest of possibly
+     * several sizes is signalled, and the tables are in sync afterwards
+     */
+
+    *pos++ = (1 << 5) | 0;
+
+    if (size) {
+        *pos = 1 << 5;
+        pos = ngx_http_v2_write_int(pos, ngx_http_v2_prefix(5), size);
+    }
+
+    hpack->deleted = hpack->added;
+    hpack->size = size;
+    hpack->free = size;
+    hpack->pos = hpack->storage;
+
+    h2c->table_update = 0;
+
+    return pos;
+}
+
+
+ngx_uint_t
+ngx_http_v2_table_find(ngx_http_v2_connection_t *h2c, ngx_str_t *name,
+    ngx_str_t *value, ngx_uint_t *index)
+{
+    ngx_uint_t                  i, n, hash;
+    ngx_http_v2_hpack_enc_t    *hpack;
+    ngx_http_v2_hpack_entry_t  *entry;
+
+    if (*index == 0) {
+        for (i = 0; i < NGX_HTTP_V2_STATIC_TABLE_ENTRIES; i++) {
+            if (ngx_http_v2_static_table[i].name.len == name->len
+                && ngx_strncasecmp(ngx_http_v2_static_table[i].name.data,
+                                   name->data, name->len)
+                   == 0)
+            {
+                *index = i + 1;
+                break;
+            }
+        }
+    }
+
+    hpack = &h2c->hpack_enc;
+
+    hash = ngx_http_v2_table_hash(name, value);
+
+    for (i = hpack->added; i != hpack->deleted; i--) {
+        entry = &hpack->entries[(i - 1) % NGX_HTTP_V2_TABLE_ENTRIES];
+
+        if (!entry->valid
+            || entry->name.len != name->len
+            || ngx_strncasecmp(entry->name.data, name->data, name->len) != 0)
+        {
+            continue;
+        }
+
+        n = NGX_HTTP_V2_STATIC_TABLE_ENTRIES + hpack->added - i + 1;
+
+        if (entry->hash == hash
+            && entry->value.len == value->len
+            && ngx_memcmp(entry->value.data, value->data, value->len) == 0)
+        {
+            ngx_log_debug2(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                           "http2 table hit: \"%V\" %ui", name, n);
+
+            return n;
+        }
+
+        if (*index == 0) {
+            *index = n;
+        }
+    }
+
+    return 0;
+}
+
+
+ngx_int_t
+ngx_http_v2_table_insert(ngx_http_v2_connection_t *h2c, ngx_str_t *name,
+    ngx_str_t *value)
+{
+    u_char                     *end;
+    size_t                      len;
+    ngx_uint_t                  i;
+    ngx_http_v2_hpack_enc_t    *hpack;
+    ngx_http_v2_hpack_entry_t  *entry;
+
+    hpack = &h2c->hpack_enc;
+
+    len = name->len + value->len;
+
+    /* large entries would evict most of the table */
+
+    if (32 + len > hpack->size / 4 * 3) {
+        return NGX_DECLINED;
+    }
+
+    if (hpack->entries == NULL) {
+        hpack->entries = ngx_palloc(h2c->connection->pool,
+                                    sizeof(ngx_http_v2_hpack_entry_t)
+                                    * NGX_HTTP_V2_TABLE_ENTRIES);
+        if (hpack->entries == NULL) {
+            return NGX_ERROR;
+        }
+
+        hpack->storage = ngx_palloc(h2c->connection->pool,
+                                    NGX_HTTP_V2_TABLE_SIZE);
+        if (hpack->storage == NULL) {
+            return NGX_ERROR;
+        }
+
+        hpack->pos = hpack->storage;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, h2c->connection->log, 0,
+                   "http2 table insert: \"%V: %V\"", name, value);
+
+    while (32 + len > hpack->free) {
+        entry = &hpack->entries[hpack->deleted++ % NGX_HTTP_V2_TABLE_ENTRIES];
+        hpack->free += 32 + entry->name.len + entry->value.len;
+    }
+
+    hpack->free -= 32 + len;
+
+    if ((size_t) (hpack->storage + NGX_HTTP_V2_TABLE_SIZE - hpack->pos) < len) {
+        hpack->pos = hpack->storage;
+    }
+
+    end = hpack->pos + len;
+
+    for (i = hpack->deleted; i != hpack->added; i++) {
+        entry = &hpack->entries[i % NGX_HTTP_V2_TABLE_ENTRIES];
+
+        if (entry->valid
+            && entry->name.data < end
+            && entry->value.data + entry->value.len > hpack->pos)
+        {
+            entry->valid = 0;
+        }
+    }
+
+    entry = &hpack->entries[hpack->added++ % NGX_HTTP_V2_TABLE_ENTRIES];
+
+    entry->hash = ngx_http_v2_table_hash(name, value);
+    entry->valid = 1;
+
+    entry->name.len = name->len;
+    entry->name.data = hpack->pos;
+    ngx_strlow(entry->name.data, name->data, name->len);
+
+    entry->value.len = value->len;
+    entry->value.data = hpack->pos + name->len;
+    ngx_memcpy(entry->value.data, value->data, value->len);
+
+    hpack->pos = end;
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+ngx_http_v2_table_hash(ngx_str_t *name, ngx_str_t *value)
+{
+    ngx_uint_t  hash;
+
+    hash = ngx_hash_key_lc(name->data, name->len);
+
+    return ngx_hash(hash, ngx_hash_key(value->data, value->len));
+}
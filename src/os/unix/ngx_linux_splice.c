@@ -0,0 +1,192 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+/*
+ * A pipe is used to move data between two sockets with splice() without
+ * copying it to userland.  The number of bytes in the pipe is tracked
+ * in p->size and never exceeds NGX_SPLICE_PIPE_SIZE, the minimum pipe
+ * capacity.  Note that the pipe may still be full with fewer bytes in it,
+ * as each socket buffer fragment occupies a separate pipe slot.
+ */
+
+
+static void ngx_splice_pipe_cleanup(void *data);
+
+
+ngx_splice_pipe_t *
+ngx_create_splice_pipe(ngx_pool_t *pool, ngx_log_t *log)
+{
+    ngx_splice_pipe_t   *p;
+    ngx_pool_cleanup_t  *cln;
+
+    cln = ngx_pool_cleanup_add(pool, sizeof(ngx_splice_pipe_t));
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    p = cln->data;
+
+    if (pipe(p->fd) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, "pipe() failed");
+        return NULL;
+    }
+
+    p->size = 0;
+    p->log = log;
+
+    cln->handler = ngx_splice_pipe_cleanup;
+
+    if (ngx_nonblocking(p->fd[0]) == -1
+        || ngx_nonblocking(p->fd[1]) == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_nonblocking_n " pipe failed");
+        return NULL;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "splice pipe: %d:%d", p->fd[0], p->fd[1]);
+
+    return p;
+}
+
+
+ssize_t
+ngx_splice_recv(ngx_connection_t *c, ngx_splice_pipe_t *p, size_t size)
+{
+    ssize_t       n;
+    ngx_err_t     err;
+    ngx_event_t  *rev;
+
+    rev = c->read;
+
+    if (size > NGX_SPLICE_PIPE_SIZE - p->size) {
+        size = NGX_SPLICE_PIPE_SIZE - p->size;
+    }
+
+    for ( ;; ) {
+        n = splice(c->fd, NULL, p->fd[1], NULL, size,
+                   SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "splice recv: fd:%d %z of %uz", c->fd, n, size);
+
+        if (n > 0) {
+            p->size += n;
+            return n;
+        }
+
+        if (n == 0) {
+            rev->ready = 0;
+            rev->eof = 1;
+            return 0;
+        }
+
+        err = ngx_socket_errno;
+
+        if (err == NGX_EAGAIN) {
+
+            /*
+             * EAGAIN is also returned if the pipe is full,
+             * so the socket is known to be empty only if the pipe is empty
+             */
+
+            if (p->size == 0) {
+                rev->ready = 0;
+            }
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "splice() not ready");
+            return NGX_AGAIN;
+        }
+
+        if (err != NGX_EINTR) {
+            rev->ready = 0;
+            rev->error = 1;
+            (void) ngx_connection_error(c, err, "splice() failed");
+            return NGX_ERROR;
+        }
+    }
+}
+
+
+ssize_t
+ngx_splice_send(ngx_connection_t *c, ngx_splice_pipe_t *p, size_t size)
+{
+    ssize_t       n;
+    ngx_err_t     err;
+    ngx_event_t  *wev;
+
+    wev = c->write;
+
+    if (size > p->size) {
+        size = p->size;
+    }
+
+    for ( ;; ) {
+        n = splice(p->fd[0], NULL, c->fd, NULL, size,
+                   SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "splice send: fd:%d %z of %uz", c->fd, n, size);
+
+        if (n > 0) {
+            if (n < (ssize_t) size) {
+                wev->ready = 0;
+            }
+
+            p->size -= n;
+            c->sent += n;
+
+            return n;
+        }
+
+        err = ngx_socket_errno;
+
+        if (n == 0) {
+            ngx_log_error(NGX_LOG_ALERT, c->log, err, "splice() returned zero");
+            wev->ready = 0;
+            return n;
+        }
+
+        if (err == NGX_EAGAIN) {
+            wev->ready = 0;
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "splice() not ready");
+            return NGX_AGAIN;
+        }
+
+        if (err != NGX_EINTR) {
+            wev->error = 1;
+            (void) ngx_connection_error(c, err, "splice() failed");
+            return NGX_ERROR;
+        }
+    }
+}
+
+
+static void
+ngx_splice_pipe_cleanup(void *data)
+{
+    ngx_splice_pipe_t  *p = data;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, p->log, 0,
+                   "splice pipe cleanup: %d:%d", p->fd[0], p->fd[1]);
+
+    if (close(p->fd[0]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, p->log, ngx_errno, "close() pipe failed");
+    }
+
+    if (close(p->fd[1]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, p->log, ngx_errno, "close() pipe failed");
+    }
+}
@@ -10,20 +10,34 @@
 #include <ngx_event.h>
 
 
+#if (NGX_HAVE_SENDMMSG)
+#define NGX_UDP_SEND_BATCH  16
+#else
+#define NGX_UDP_SEND_BATCH  1
+#endif
+
+
 static ngx_chain_t *ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec,
     ngx_chain_t *in, ngx_log_t *log);
-static ssize_t ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec);
+static ssize_t ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec,
+    ngx_uint_t nvec);
+#if (NGX_HAVE_SENDMMSG)
+static ssize_t ngx_sendmmsg(ngx_connection_t *c, struct mmsghdr *msgs,
+    ngx_uint_t nmsgs);
+#endif
 
 
 ngx_chain_t *
 ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 {
+    size_t         size;
     ssize_t        n;
     off_t          send;
-    ngx_chain_t   *cl;
+    ngx_uint_t     nvec;
+    ngx_chain_t   *cl, *next;
     ngx_event_t   *wev;
-    ngx_iovec_t    vec;
-    struct iovec   iovs[NGX_IOVS_PREALLOCATE];
+    ngx_iovec_t    vec[NGX_UDP_SEND_BATCH];
+    struct iovec  *iov, iovs[NGX_IOVS_PREALLOCATE];
 
     wev = c->write;
 
@@ -50,45 +64,69 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 
     send = 0;
 
-    vec.iovs = iovs;
-    vec.nalloc = NGX_IOVS_PREALLOCATE;
-
     for ( ;; ) {
 
-        /* create the iovec and coalesce the neighbouring bufs */
+        /*
+         * create the iovecs and coalesce the neighbouring bufs,
+         * several complete datagrams are sent with a single sendmmsg()
+         */
 
-        cl = ngx_udp_output_chain_to_iovec(&vec, in, c->log);
+        nvec = 0;
+        size = 0;
+        iov = iovs;
+        cl = in;
 
-        if (cl == NGX_CHAIN_ERROR) {
-            return NGX_CHAIN_ERROR;
-        }
+        do {
+            vec[nvec].iovs = iov;
+            vec[nvec].nalloc = NGX_IOVS_PREALLOCATE - (iov - iovs);
 
-        if (cl && cl->buf->in_file) {
-            ngx_log_error(NGX_LOG_ALERT, c->log, 0,
-                          "file buf in sendmsg "
-                          "t:%d r:%d f:%d %p %p-%p %p %O-%O",
-                          cl->buf->temporary,
-                          cl->buf->recycled,
-                          cl->buf->in_file,
-                          cl->buf->start,
-                          cl->buf->pos,
-                          cl->buf->last,
-                          cl->buf->file,
-                          cl->buf->file_pos,
-                          cl->buf->file_last);
+            next = ngx_udp_output_chain_to_iovec(&vec[nvec], cl, c->log);
 
-            ngx_debug_point();
+            if (next == NGX_CHAIN_ERROR) {
+                return NGX_CHAIN_ERROR;
+            }
 
-            return NGX_CHAIN_ERROR;
-        }
+            if (next && next->buf->in_file) {
+                ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                              "file buf in sendmsg "
+                              "t:%d r:%d f:%d %p %p-%p %p %O-%O",
+                              next->buf->temporary,
+                              next->buf->recycled,
+                              next->buf->in_file,
+                              next->buf->start,
+                              next->buf->pos,
+                              next->buf->last,
+                              next->buf->file,
+                              next->buf->file_pos,
+                              next->buf->file_last);
+
+                ngx_debug_point();
+
+                return NGX_CHAIN_ERROR;
+            }
+
+            if (next == cl) {
+                break;
+            }
+
+            iov += vec[nvec].count;
+            size += vec[nvec].size;
+            nvec++;
+
+            cl = next;
 
-        if (cl == in) {
+        } while (cl
+                 && nvec < NGX_UDP_SEND_BATCH
+                 && iov < iovs + NGX_IOVS_PREALLOCATE
+                 && send + (off_t) size < limit);
+
+        if (nvec == 0) {
             return in;
         }
 
-        send += vec.size;
+        send += size;
 
-        n = ngx_sendmsg(c, &vec);
+        n = ngx_sendmsg(c, vec, nvec);
 
         if (n == NGX_ERROR) {
             return NGX_CHAIN_ERROR;
@@ -166,6 +204,12 @@ ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec, ngx_chain_t *in, ngx_log_t *log)
 
         } else {
             if (n == vec->nalloc) {
+
+                if (vec->nalloc < NGX_IOVS_PREALLOCATE) {
+                    /* the rest of a batch is too small, send it later */
+                    return cl;
+                }
+
                 ngx_log_error(NGX_LOG_ALERT, log, 0,
                               "too many parts in a datagram");
                 return NGX_CHAIN_ERROR;
@@ -204,12 +248,17 @@ ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec, ngx_chain_t *in, ngx_log_t *log)
 
 
 static ssize_t
-ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec)
+ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec, ngx_uint_t nvec)
 {
     ssize_t        n;
     ngx_err_t      err;
     struct msghdr  msg;
 
+#if (NGX_HAVE_SENDMMSG)
+    ngx_uint_t      i;
+    struct mmsghdr  msgs[NGX_UDP_SEND_BATCH];
+#endif
+
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
 #if (NGX_HAVE_IP_SENDSRCADDR)
@@ -310,6 +359,24 @@ ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec)
 
 #endif
 
+#if (NGX_HAVE_SENDMMSG)
+
+    if (nvec > 1) {
+
+        /* datagrams differ only in data */
+
+        for (i = 0; i < nvec; i++) {
+            msgs[i].msg_hdr = msg;
+            msgs[i].msg_hdr.msg_iov = vec[i].iovs;
+            msgs[i].msg_hdr.msg_iovlen = vec[i].count;
+            msgs[i].msg_len = 0;
+        }
+
+        return ngx_sendmmsg(c, msgs, nvec);
+    }
+
+#endif
+
 eintr:
 
     n = sendmsg(c->fd, &msg, 0);
@@ -340,3 +407,58 @@ eintr:
 
     return n;
 }
+
+
+#if (NGX_HAVE_SENDMMSG)
+
+static ssize_t
+ngx_sendmmsg(ngx_connection_t *c, struct mmsghdr *msgs, ngx_uint_t nmsgs)
+{
+    int         n;
+    ssize_t     sent;
+    ngx_err_t   err;
+    ngx_uint_t  i;
+
+eintr:
+
+    n = sendmmsg(c->fd, msgs, nmsgs, 0);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmmsg: %d of %ui", n, nmsgs);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+        case NGX_EAGAIN:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmmsg() not ready");
+            return NGX_AGAIN;
+
+        case NGX_EINTR:
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendmmsg() was interrupted");
+            goto eintr;
+
+        default:
+            c->write->error = 1;
+            ngx_connection_error(c, err, "sendmmsg() failed");
+            return NGX_ERROR;
+        }
+    }
+
+    /*
+     * an error on a datagram other than the first one is not reported,
+     * it is returned by the next call
+     */
+
+    sent = 0;
+
+    for (i = 0; i < (ngx_uint_t) n; i++) {
+        sent += msgs[i].msg_len;
+    }
+
+    return sent;
+}
+
+#endif
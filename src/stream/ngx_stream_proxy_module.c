@@ -32,6 +32,7 @@ typedef struct {
     ngx_flag_t                       next_upstream;
     ngx_flag_t                       proxy_protocol;
     ngx_flag_t                       half_close;
+    ngx_flag_t                       splice;
     ngx_stream_upstream_local_t     *local;
     ngx_flag_t                       socket_keepalive;
 
@@ -76,6 +77,11 @@ static void ngx_stream_proxy_connect_handler(ngx_event_t *ev);
 static ngx_int_t ngx_stream_proxy_test_connect(ngx_connection_t *c);
 static void ngx_stream_proxy_process(ngx_stream_session_t *s,
     ngx_uint_t from_upstream, ngx_uint_t do_write);
+#if (NGX_HAVE_SPLICE)
+static ngx_int_t ngx_stream_proxy_process_splice(ngx_stream_session_t *s,
+    ngx_uint_t from_upstream, ngx_connection_t *src, ngx_connection_t *dst,
+    ngx_splice_pipe_t *p);
+#endif
 static ngx_int_t ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
     ngx_uint_t from_upstream);
 static void ngx_stream_proxy_next_upstream(ngx_stream_session_t *s);
@@ -253,6 +259,13 @@ static ngx_command_t  ngx_stream_proxy_commands[] = {
       offsetof(ngx_stream_proxy_srv_conf_t, half_close),
       NULL },
 
+    { ngx_string("proxy_splice"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_proxy_srv_conf_t, splice),
+      NULL },
+
 #if (NGX_STREAM_SSL)
 
     { ngx_string("proxy_ssl"),
@@ -921,6 +934,20 @@ ngx_stream_proxy_init_upstream(ngx_stream_session_t *s)
     u->upload_rate = ngx_stream_complex_value_size(s, pscf->upload_rate, 0);
     u->download_rate = ngx_stream_complex_value_size(s, pscf->download_rate, 0);
 
+#if (NGX_HAVE_SPLICE)
+
+    if (pscf->splice && pc->type == SOCK_STREAM) {
+        u->splice = 1;
+
+#if (NGX_STREAM_SSL)
+        if (c->ssl || pc->ssl) {
+            u->splice = 0;
+        }
+#endif
+    }
+
+#endif
+
     u->connected = 1;
 
     pc->read->handler = ngx_stream_proxy_upstream_handler;
@@ -1595,6 +1622,9 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
     ngx_log_handler_pt            handler;
     ngx_stream_upstream_t        *u;
     ngx_stream_proxy_srv_conf_t  *pscf;
+#if (NGX_HAVE_SPLICE)
+    ngx_splice_pipe_t           **sp;
+#endif
 
     u = s->upstream;
 
@@ -1629,6 +1659,9 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
         busy = &u->downstream_busy;
         recv_action = "proxying and reading from upstream";
         send_action = "proxying and sending to client";
+#if (NGX_HAVE_SPLICE)
+        sp = &u->downstream_pipe;
+#endif
 
     } else {
         src = c;
@@ -1641,10 +1674,30 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
         busy = &u->upstream_busy;
         recv_action = "proxying and reading from client";
         send_action = "proxying and sending to upstream";
+#if (NGX_HAVE_SPLICE)
+        sp = &u->upstream_pipe;
+#endif
     }
 
     for ( ;; ) {
 
+#if (NGX_HAVE_SPLICE)
+
+        if (*sp) {
+            c->log->action = recv_action;
+
+            if (ngx_stream_proxy_process_splice(s, from_upstream, src, dst, *sp)
+                != NGX_OK)
+            {
+                ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+                return;
+            }
+
+            break;
+        }
+
+#endif
+
         if (do_write && dst) {
 
             if (*out || *busy || dst->buffered) {
@@ -1665,6 +1718,26 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
                     b->last = b->start;
                 }
             }
+
+#if (NGX_HAVE_SPLICE)
+
+            if (u->splice && *out == NULL && *busy == NULL && !dst->buffered) {
+
+                /* the rest of data is moved with splice() */
+
+                *sp = ngx_create_splice_pipe(c->pool, c->log);
+
+                if (*sp) {
+                    ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                                   "stream proxy splice to %s",
+                                   from_upstream ? "client" : "upstream");
+                    continue;
+                }
+
+                u->splice = 0;
+            }
+
+#endif
         }
 
         size = b->end - b->last;
@@ -1796,6 +1869,119 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 }
 
 
+#if (NGX_HAVE_SPLICE)
+
+static ngx_int_t
+ngx_stream_proxy_process_splice(ngx_stream_session_t *s,
+    ngx_uint_t from_upstream, ngx_connection_t *src, ngx_connection_t *dst,
+    ngx_splice_pipe_t *p)
+{
+    off_t                  *received, limit;
+    size_t                  size, limit_rate;
+    ssize_t                 n;
+    ngx_uint_t             *packets, moved;
+    ngx_msec_t              delay;
+    ngx_stream_upstream_t  *u;
+
+    u = s->upstream;
+
+    if (from_upstream) {
+        limit_rate = u->download_rate;
+        received = &u->received;
+        packets = &u->responses;
+
+    } else {
+        limit_rate = u->upload_rate;
+        received = &s->received;
+        packets = &u->requests;
+    }
+
+    do {
+        moved = 0;
+
+        if (p->size && dst->write->ready) {
+
+            n = ngx_splice_send(dst, p, p->size);
+
+            if (n == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if (n > 0) {
+                moved = 1;
+            }
+        }
+
+        if (p->size < NGX_SPLICE_PIPE_SIZE
+            && src->read->ready && !src->read->delayed && !src->read->error)
+        {
+            size = NGX_SPLICE_PIPE_SIZE;
+
+            if (limit_rate) {
+                limit = (off_t) limit_rate * (ngx_time() - u->start_sec + 1)
+                        - *received;
+
+                if (limit <= 0) {
+                    src->read->delayed = 1;
+                    delay = (ngx_msec_t) (- limit * 1000 / limit_rate + 1);
+                    ngx_add_timer(src->read, delay);
+                    break;
+                }
+
+                if ((off_t) size > limit) {
+                    size = (size_t) limit;
+                }
+            }
+
+            n = ngx_splice_recv(src, p, size);
+
+            if (n == NGX_AGAIN) {
+                continue;
+            }
+
+            if (n == NGX_ERROR) {
+                src->read->eof = 1;
+                n = 0;
+            }
+
+            if (limit_rate) {
+                delay = (ngx_msec_t) (n * 1000 / limit_rate);
+
+                if (delay > 0) {
+                    src->read->delayed = 1;
+                    ngx_add_timer(src->read, delay);
+                }
+            }
+
+            if (from_upstream) {
+                if (u->state->first_byte_time == (ngx_msec_t) -1) {
+                    u->state->first_byte_time = ngx_current_msec
+                                                - u->start_time;
+                }
+            }
+
+            (*packets)++;
+            *received += n;
+            moved = 1;
+        }
+
+    } while (moved);
+
+    /* data in the pipe delay closing of the connection */
+
+    if (p->size) {
+        dst->buffered |= NGX_SPLICE_BUFFERED;
+
+    } else {
+        dst->buffered &= ~NGX_SPLICE_BUFFERED;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
     ngx_uint_t from_upstream)
@@ -2086,6 +2272,7 @@ ngx_stream_proxy_create_srv_conf(ngx_conf_t *cf)
     conf->local = NGX_CONF_UNSET_PTR;
     conf->socket_keepalive = NGX_CONF_UNSET;
     conf->half_close = NGX_CONF_UNSET;
+    conf->splice = NGX_CONF_UNSET;
 
 #if (NGX_STREAM_SSL)
     conf->ssl_enable = NGX_CONF_UNSET;
@@ -2146,6 +2333,8 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_value(conf->half_close, prev->half_close, 0);
 
+    ngx_conf_merge_value(conf->splice, prev->splice, 0);
+
 #if (NGX_STREAM_SSL)
 
     ngx_conf_merge_value(conf->ssl_enable, prev->ssl_enable, 0);
@@ -126,6 +126,11 @@ typedef struct {
     ngx_chain_t                       *downstream_out;
     ngx_chain_t                       *downstream_busy;
 
+#if (NGX_HAVE_SPLICE)
+    ngx_splice_pipe_t                 *upstream_pipe;
+    ngx_splice_pipe_t                 *downstream_pipe;
+#endif
+
     off_t                              received;
     time_t                             start_sec;
     ngx_uint_t                         requests;
@@ -143,6 +148,7 @@ typedef struct {
     unsigned                           connected:1;
     unsigned                           proxy_protocol:1;
     unsigned                           half_closed:1;
+    unsigned                           splice:1;
 } ngx_stream_upstream_t;
 
 
@@ -40,6 +40,10 @@ struct ngx_stream_upstream_rr_peer_s {
 
     ngx_uint_t                       down;
 
+    /* peak EWMA of the response time in microseconds, and when updated */
+    ngx_uint_t                       ewma;
+    ngx_msec_t                       ewma_time;
+
     void                            *ssl_session;
     int                              ssl_session_len;
 
@@ -49,7 +53,7 @@ struct ngx_stream_upstream_rr_peer_s {
 
     ngx_stream_upstream_rr_peer_t   *next;
 
-    NGX_COMPAT_BEGIN(25)
+    NGX_COMPAT_BEGIN(23)
     NGX_COMPAT_END
 };
 